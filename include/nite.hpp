@@ -5,17 +5,21 @@
 #include <cstddef>
 #include <cstdint>
 #include <ctime>
+#include <deque>
 #include <format>
 #include <functional>
 #include <initializer_list>
+#include <limits>
+#include <memory_resource>
 #include <optional>
+#include <span>
 #include <string>
+#include <string_view>
 #include <memory>
-#include <list>
 #include <unordered_map>
-#include <unordered_set>
 #include <utility>
 #include <variant>
+#include <vector>
 #include <type_traits>
 
 // --------------------------------
@@ -24,15 +28,15 @@
 
 namespace nite
 {
-    /// Converts a wide character to mutiple byte string
+    /// Converts a wide character to UTF-8 string
     std::string wc_to_str(const wchar_t wc);
-    /// Converts a mutiple byte string to wide character
+    /// Converts a UTF-8 string to wide character
     wchar_t str_to_wc(const std::string &str);
     /// Converts a single byte (char) to wide character
     wchar_t c_to_wc(const char c);
-    /// Converts a multiple byte string to wide string
+    /// Converts a UTF-8 string to wide string, does not depend on the locale
     std::wstring str_to_wstr(const std::string &str);
-    /// Converts a wide string to multiple byte string
+    /// Converts a wide string to UTF-8 string, does not depend on the locale
     std::string wstr_to_str(const std::wstring &str);
 
     class Result {
@@ -724,6 +728,9 @@ namespace nite
 
 namespace nite
 {
+    // Forward declaration
+    class OutputSink;
+
     namespace internal
     {
         namespace console
@@ -732,10 +739,30 @@ namespace nite
             Result clear();
             Result size(size_t &width, size_t &height);
             Result print(const std::string &text = "");
+            /**
+             * Writes all of the text, counting the system calls it took
+             * @param text the text to write
+             * @param [inout] calls incremented for every system call made
+             */
+            Result write_all(std::string_view text, size_t &calls);
+            /// Redirects all of the output to the sink, back to the console if null
+            void set_sink(std::shared_ptr<OutputSink> sink);
 
             void set_style(const Style style);
             void gotoxy(const size_t col, const size_t row);
             void set_cell(const size_t col, const size_t row, const wchar_t value, const Style style);
+            /// Appends the sequence that draws the glyph of cluster taking width columns to out,
+            /// skipping the cursor position and style if they are unchanged since the previous cell
+            void encode_cell(std::string &out, const size_t col, const size_t row, std::span<const wchar_t> cluster, const size_t width, const Style style);
+
+            /**
+             * Prepares the console for drawing at a new size
+             * @param [in] old_size the size of the previous frame
+             * @param [in] new_size the size of the next frame
+             * @param [out] preserved set if the previous content is kept in place,
+             *                        otherwise the console is cleared
+             */
+            Result resize(const Size old_size, const Size new_size, bool &preserved);
 
             Result init();
             Result restore();
@@ -745,11 +772,17 @@ namespace nite
          * Represents the information of a screen cell
          */
         struct Cell {
+            /// The character, or the offset of the characters in the cluster pool of the buffer if cluster_size is not 0
             wchar_t value = ' ';
             Style style = {};
+            /// Number of columns taken by the glyph, 0 for the cell after a wide glyph which continues it
+            uint8_t width = 1;
+            /// Number of characters of a grapheme cluster made of more than one character, 0 otherwise
+            uint8_t cluster_size = 0;
 
+            /// Clusters are compared by their offsets, use CellBuffer::same_cell() to compare their characters
             constexpr bool operator==(const Cell &other) const {
-                return value == other.value && style == other.style;
+                return value == other.value && style == other.style && width == other.width && cluster_size == other.cluster_size;
             }
 
             constexpr bool operator!=(const Cell &other) const {
@@ -763,18 +796,21 @@ namespace nite
         class CellBuffer {
             size_t width;
             size_t height;
+            size_t capacity;    // Number of allocated cells, never shrinks
             std::unique_ptr<Cell[]> cells;
+            std::vector<wchar_t> clusters;    // Characters of the clusters, emptied by fill()
 
           public:
-            CellBuffer(size_t width, size_t height) : width(width), height(height) {
+            CellBuffer(size_t width, size_t height) : width(width), height(height), capacity(width * height) {
                 cells = std::make_unique<Cell[]>(width * height);
             }
 
-            CellBuffer(const Size size) : width(size.width), height(size.height) {
+            CellBuffer(const Size size) : width(size.width), height(size.height), capacity(size.width * size.height) {
                 cells = std::make_unique<Cell[]>(size.width * size.height);
             }
 
-            CellBuffer(const CellBuffer &other) : width(other.width), height(other.height) {
+            CellBuffer(const CellBuffer &other)
+                : width(other.width), height(other.height), capacity(other.width * other.height), clusters(other.clusters) {
                 cells = std::make_unique<Cell[]>(width * height);
                 for (size_t i = 0; i < width * height; i++)
                     cells[i] = other.cells[i];
@@ -786,18 +822,157 @@ namespace nite
                 if (this == &other)
                     return *this;
 
+                if (capacity < other.width * other.height) {
+                    capacity = other.width * other.height;
+                    cells = std::make_unique<Cell[]>(capacity);
+                }
                 width = other.width;
                 height = other.height;
-
-                cells = std::make_unique<Cell[]>(width * height);
                 for (size_t i = 0; i < width * height; i++)
                     cells[i] = other.cells[i];
+                clusters = other.clusters;
                 return *this;
             }
 
             CellBuffer &operator=(CellBuffer &&other) = default;
             ~CellBuffer() = default;
 
+            /**
+             * Sets every cell of the buffer to the given cell
+             * @param cell the cell to fill with
+             */
+            void fill(const Cell cell) {
+                std::fill_n(cells.get(), width * height, cell);
+                clusters.clear();
+            }
+
+            /**
+             * Changes the dimensions of the buffer, reallocating only when it grows
+             * beyond the largest size seen so far. The cells in the region common to
+             * both sizes keep their positions, the exposed cells are set to fill
+             * @param size the new size
+             * @param fill the cell to set the exposed cells to
+             */
+            void resize(const Size size, const Cell fill = {}) {
+                if (size.width == width && size.height == height)
+                    return;
+
+                const size_t keep_width = std::min(width, size.width);
+                const size_t keep_height = std::min(height, size.height);
+                if (capacity < size.width * size.height) {
+                    capacity = size.width * size.height;
+                    auto new_cells = std::make_unique<Cell[]>(capacity);
+                    for (size_t row = 0; row < keep_height; row++)
+                        std::copy_n(&cells[row * width], keep_width, &new_cells[row * size.width]);
+                    cells = std::move(new_cells);
+                } else if (size.width < width) {
+                    // Rows move towards the start, so copy them front to back
+                    for (size_t row = 1; row < keep_height; row++)
+                        std::copy_n(&cells[row * width], keep_width, &cells[row * size.width]);
+                } else if (size.width > width) {
+                    // Rows move towards the end, so copy them back to front
+                    for (size_t row = keep_height; row-- > 1;)
+                        std::copy_backward(&cells[row * width], &cells[row * width + keep_width], &cells[row * size.width + keep_width]);
+                }
+
+                for (size_t row = 0; row < keep_height; row++)
+                    std::fill(&cells[row * size.width + keep_width], &cells[(row + 1) * size.width], fill);
+                std::fill(&cells[keep_height * size.width], &cells[size.height * size.width], fill);
+                // A wide glyph cut by the new right edge is replaced with a blank
+                if (keep_width > 0 && keep_width == size.width)
+                    for (size_t row = 0; row < keep_height; row++) {
+                        Cell &cell = cells[row * size.width + keep_width - 1];
+                        if (cell.width == 2)
+                            cell = Cell{.value = ' ', .style = cell.style};
+                    }
+                width = size.width;
+                height = size.height;
+            }
+
+            /// Returns the characters of the glyph in cell, which is a cell of this buffer
+            std::span<const wchar_t> get_cluster(const Cell &cell) const {
+                if (cell.cluster_size == 0)
+                    return {&cell.value, 1};
+                return {clusters.data() + static_cast<size_t>(cell.value), cell.cluster_size};
+            }
+
+            /// Checks whether cell of this buffer and other_cell of other draw the same glyph in the same style
+            bool same_cell(const Cell &cell, const CellBuffer &other, const Cell &other_cell) const {
+                if (cell.cluster_size == 0 || other_cell.cluster_size == 0)
+                    return cell == other_cell;
+                if (cell.style != other_cell.style || cell.width != other_cell.width || cell.cluster_size != other_cell.cluster_size)
+                    return false;
+                const auto chars = get_cluster(cell);
+                return std::equal(chars.begin(), chars.end(), other.get_cluster(other_cell).begin());
+            }
+
+            /**
+             * Replaces the wide glyph that covers the cell with blanks of the same style,
+             * so that the cell can be overwritten without leaving half of a wide glyph
+             * @param col the column of the cell
+             * @param row the row of the cell
+             */
+            void split_glyph(size_t col, size_t row) {
+                Cell &cell = at(col, row);
+                if (cell.width == 0 && col > 0) {
+                    Cell &lead = at(col - 1, row);
+                    lead = Cell{.value = ' ', .style = lead.style};
+                    cell = Cell{.value = ' ', .style = cell.style};
+                } else if (cell.width == 2 && col + 1 < width) {
+                    Cell &next = at(col + 1, row);
+                    next = Cell{.value = ' ', .style = next.style};
+                    cell = Cell{.value = ' ', .style = cell.style};
+                }
+            }
+
+            /**
+             * Appends a character to the grapheme cluster of the glyph that covers the cell.
+             * The character is dropped if the cluster cannot grow any further
+             * @param col the column of the cell
+             * @param row the row of the cell
+             * @param value the character to append
+             */
+            void append_to_cluster(size_t col, size_t row, const wchar_t value) {
+                if (at(col, row).width == 0 && col > 0)
+                    col--;
+                Cell &cell = at(col, row);
+                const size_t size = cell.cluster_size == 0 ? 1 : cell.cluster_size;
+                if (size >= std::numeric_limits<uint8_t>::max() || clusters.size() + size >= static_cast<size_t>(std::numeric_limits<wchar_t>::max()))
+                    return;
+
+                // The cluster moves to the end of the pool unless it is there already
+                const size_t offset = cell.cluster_size == 0 ? 0 : static_cast<size_t>(cell.value);
+                if (cell.cluster_size == 0 || offset + size != clusters.size()) {
+                    const size_t new_offset = clusters.size();
+                    for (size_t i = 0; i < size; i++) {
+                        const wchar_t c = cell.cluster_size == 0 ? cell.value : clusters[offset + i];
+                        clusters.push_back(c);
+                    }
+                    cell.value = static_cast<wchar_t>(new_offset);
+                }
+                clusters.push_back(value);
+                cell.cluster_size = static_cast<uint8_t>(size + 1);
+            }
+
+            /// Returns the number of characters in the cluster pool, including the ones no longer used
+            size_t get_cluster_pool_size() const {
+                return clusters.size();
+            }
+
+            /// Drops the characters of the cluster pool that are no longer used
+            void compact_clusters() {
+                std::vector<wchar_t> compacted;
+                for (size_t i = 0; i < width * height; i++) {
+                    Cell &cell = cells[i];
+                    if (cell.cluster_size == 0)
+                        continue;
+                    const auto chars = get_cluster(cell);
+                    cell.value = static_cast<wchar_t>(compacted.size());
+                    compacted.insert(compacted.end(), chars.begin(), chars.end());
+                }
+                clusters = std::move(compacted);
+            }
+
             bool contains(size_t col, size_t row) const {
                 return col < width && row < height;
             }
@@ -841,6 +1016,7 @@ namespace nite
 {
     // Forward declaration
     struct State;
+    class InputSource;
 
 #define KEY_SHIFT ((uint8_t) (1 << 0))    // Shift key
 #define KEY_CTRL  ((uint8_t) (1 << 1))    // Control on macOS, Ctrl on other platforms
@@ -968,6 +1144,9 @@ namespace nite
         SPACE,
     };
 
+    /// Number of key codes
+    inline constexpr size_t KEY_CODE_COUNT = static_cast<size_t>(KeyCode::SPACE) + 1;
+
     // TODO: debug thing do not use this
     struct KeyCodeInfo {
         KeyCodeInfo() = delete;
@@ -1207,6 +1386,8 @@ namespace nite
         KeyCode key_code;
         char key_char;
         uint8_t modifiers = 0;
+        /// Whether this press is an automatic repeat of a held key (only reported by some terminals)
+        bool repeat = false;
     };
 
     enum class MouseEventKind {
@@ -1231,6 +1412,8 @@ namespace nite
         MouseButton button = MouseButton::NONE;
         Position pos;
         uint8_t modifiers = 0;
+        /// Number of scroll steps this event stands for (greater than 1 only when events are coalesced)
+        size_t count = 1;
     };
 
     struct FocusEvent {
@@ -1245,11 +1428,19 @@ namespace nite
         std::string text;
     };
 
-    using Event = std::variant<KeyEvent, MouseEvent, FocusEvent, ResizeEvent, DebugEvent>;
+    /// Represents text pasted into the terminal (only delivered when the terminal supports bracketed paste)
+    struct PasteEvent {
+        std::string text;
+    };
+
+    using Event = std::variant<KeyEvent, MouseEvent, FocusEvent, ResizeEvent, DebugEvent, PasteEvent>;
 
     namespace internal
     {
         bool PollRawEvent(Event &event);
+        Result SetInputThread(bool enabled);
+        /// Makes PollRawEvent read from the source instead of the console, from the console if null
+        Result SetInputSource(std::shared_ptr<InputSource> source);
 
         template<typename Fn, typename Event>
         consteval bool is_handler_of_this_event() {
@@ -1300,6 +1491,48 @@ namespace nite
      */
     bool PollEvent(State &state, Event &event);
 
+    /**
+     * @brief Enables or disables event coalescing
+     *
+     * When enabled, PollEvent merges consecutive mouse motion events into the latest one
+     * and consecutive scroll events in the same direction into one event whose
+     * MouseEvent::count is the number of merged steps. This bounds the number of events
+     * the widgets have to go through in a frame. Coalescing is disabled by default.
+     *
+     * @param [inout] state the console state to work on
+     * @param [in] enabled whether events should be coalesced
+     */
+    void SetEventCoalescing(const State &state, bool enabled);
+    /**
+     * @brief Enables or disables the input thread
+     *
+     * When enabled, a dedicated thread waits for input, parses it as soon as it
+     * arrives and queues the events for PollEvent. Input is then timestamped on arrival
+     * instead of when the app polls, so double click detection stays accurate during long frames.
+     * The thread is stopped by Cleanup.
+     *
+     * \note Only the Linux terminal backend supports the input thread
+     *
+     * @param [inout] state the console state to work on
+     * @param [in] enabled whether input should be read on a dedicated thread
+     * @return Result
+     */
+    Result SetInputThread(State &state, bool enabled);
+    /**
+     * Returns whether input is read on a dedicated thread
+     * @param [inout] state the console state to work on
+     * @return true if the input thread is running
+     * @return false otherwise
+     */
+    bool IsInputThreadEnabled(const State &state);
+    /**
+     * Returns whether event coalescing is enabled
+     * @param [inout] state the console state to work on
+     * @return true if events are coalesced
+     * @return false otherwise
+     */
+    bool IsEventCoalescing(const State &state);
+
     /**
      * This concept defines a valid event handler
      * @tparam Fn type of the event handler
@@ -1327,7 +1560,7 @@ namespace nite
      * @param [in] handlers the handlers provided
      */
     template<Handler... Handlers>
-    inline void HandleEvent(Event event, Handlers &&...handlers) {
+    inline void HandleEvent(const Event &event, Handlers &&...handlers) {
         if constexpr (internal::has_all_event_handlers<Handlers...>())
             std::visit(HandlerMechanism{handlers...}, event);
         else
@@ -1335,8 +1568,16 @@ namespace nite
     }
 
     // Keyboard
+    // Keys are held down until their release is reported. Terminals without key release
+    // reporting (the kitty keyboard protocol) release every key right after its press.
+
+    /// Returns whether the key went down in the current frame
     bool IsKeyPressed(const State &state, KeyCode key_code);
+    /// Returns whether the key went up in the current frame
+    bool IsKeyReleased(const State &state, KeyCode key_code);
+    /// Returns whether the key is held down
     bool IsKeyDown(const State &state, KeyCode key_code);
+    /// Returns whether the key is not held down
     bool IsKeyUp(const State &state, KeyCode key_code);
 
     // Mouse
@@ -1357,6 +1598,50 @@ namespace nite
     template<typename T>
     using HandlerFn = std::function<void(T &)>;
 
+    /**
+     * @brief Defines a non-owning reference to a handler for the XXXXViewInfo structs.
+     * Unlike HandlerFn it neither copies nor allocates the callable, so the callable must
+     * outlive the call of the widget. A lambda written in the call of the widget does.
+     * @tparam T the type of the struct
+     */
+    template<typename T>
+    class HandlerRef {
+        union Target {
+            void *object;
+            void (*function)();
+        };
+
+        Target target = {.object = nullptr};
+        void (*invoke)(Target, T &) = nullptr;
+
+      public:
+        HandlerRef() = default;
+
+        HandlerRef(std::nullptr_t) {}
+
+        template<typename F>
+            requires(!std::is_same_v<std::remove_cvref_t<F>, HandlerRef> && std::is_invocable_v<F &, T &>)
+        HandlerRef(F &&fn) {
+            if constexpr (std::is_function_v<std::remove_pointer_t<std::remove_cvref_t<F>>>) {
+                using Function = std::remove_pointer_t<std::remove_cvref_t<F>> *;
+                target.function = reinterpret_cast<void (*)()>(static_cast<Function>(fn));
+                invoke = [](Target target, T &value) { reinterpret_cast<Function>(target.function)(value); };
+            } else {
+                using Callable = std::remove_reference_t<F>;
+                target.object = const_cast<void *>(static_cast<const void *>(std::addressof(fn)));
+                invoke = [](Target target, T &value) { (*static_cast<Callable *>(target.object))(value); };
+            }
+        }
+
+        void operator()(T &value) const {
+            invoke(target, value);
+        }
+
+        explicit operator bool() const {
+            return invoke != nullptr;
+        }
+    };
+
     /**
      * Represents a library state
      */
@@ -1373,6 +1658,93 @@ namespace nite
         State &operator==(State &&) = delete;
     };
 
+    /// Identifies a widget across frames, 0 is never a valid ID
+    using WidgetID = uint32_t;
+
+    namespace internal
+    {
+        inline constexpr WidgetID ROOT_ID_SEED = 2166136261u;
+
+        // FNV-1a hash of the bytes seeded with a parent ID
+        // Refer to: http://www.isthe.com/chongo/tech/comp/fnv/index.html#FNV-1a
+        inline constexpr WidgetID hash_id(const std::string_view bytes, const WidgetID seed = ROOT_ID_SEED) {
+            WidgetID hash = seed;
+            for (const char c: bytes) {
+                hash ^= static_cast<uint8_t>(c);
+                hash *= 16777619u;
+            }
+            return hash == 0 ? 1 : hash;
+        }
+
+        inline constexpr WidgetID hash_id(const uint64_t value, const WidgetID seed = ROOT_ID_SEED) {
+            WidgetID hash = seed;
+            for (size_t i = 0; i < sizeof(value); i++) {
+                hash ^= static_cast<uint8_t>(value >> (i * 8));
+                hash *= 16777619u;
+            }
+            return hash == 0 ? 1 : hash;
+        }
+
+        void *FindWidgetState(State &state, WidgetID id, const void *type, void *(*create)(), void (*destroy)(void *));
+    }    // namespace internal
+
+    /**
+     * Pushes \p str onto the ID stack, so the IDs created until the
+     * corresponding PopID call are unique to this scope.
+     * The mouse events find the widgets by their order in the scope, so a widget
+     * which is not drawn in every frame should have a scope of its own
+     * @param [inout] state the console state to work on
+     * @param [in] str the name of the scope
+     */
+    void PushID(State &state, std::string_view str);
+    /**
+     * Pushes \p id onto the ID stack, so the IDs created until the
+     * corresponding PopID call are unique to this scope
+     * @param [inout] state the console state to work on
+     * @param [in] id the index of the scope
+     */
+    void PushID(State &state, uint64_t id);
+    /**
+     * Pops the last ID pushed onto the ID stack
+     * @param [inout] state the console state to work on
+     */
+    void PopID(State &state);
+    /**
+     * Returns the ID of \p str in the current scope of the ID stack
+     * @param [inout] state the console state to work on
+     * @param [in] str the name of the widget
+     * @return WidgetID
+     */
+    WidgetID GetID(const State &state, std::string_view str);
+    /**
+     * Returns the ID of \p id in the current scope of the ID stack
+     * @param [inout] state the console state to work on
+     * @param [in] id the index of the widget
+     * @return WidgetID
+     */
+    WidgetID GetID(const State &state, uint64_t id);
+
+    /**
+     * @brief Returns the state of the widget with \p id
+     *
+     * The state is default constructed when it is first requested and lives as long as
+     * it is requested at least once every frame. It is destroyed at the end of the first
+     * frame it is not requested in.
+     *
+     * @tparam T the type of the state, a different type for the same ID replaces the state
+     * @param [inout] state the console state to work on
+     * @param [in] id the ID of the widget
+     * @return T& the state of the widget
+     */
+    template<typename T>
+        requires std::is_default_constructible_v<T>
+    T &GetWidgetState(State &state, const WidgetID id) {
+        static constexpr char type_tag = 0;
+        return *static_cast<T *>(internal::FindWidgetState(
+                state, id, &type_tag, []() -> void * { return new T(); }, [](void *data) { delete static_cast<T *>(data); }
+        ));
+    }
+
     /**
      * Gets the size of the console window
      * @return Size
@@ -1384,6 +1756,197 @@ namespace nite
      */
     State &GetState();
 
+    /**
+     * Represents a destination for the encoded output of the renderer
+     */
+    class OutputSink {
+      public:
+        virtual ~OutputSink() = default;
+
+        /**
+         * Writes all of the data
+         * @param data the data to write
+         * @param [inout] calls incremented for every system call made
+         * @return Result
+         */
+        virtual Result write(std::string_view data, size_t &calls) = 0;
+    };
+
+    /**
+     * An OutputSink which writes to a file descriptor, such as a pty or a pipe.
+     * The file descriptor is not closed by the sink
+     */
+    class FdSink : public OutputSink {
+      protected:
+        int fd;
+
+      public:
+        explicit FdSink(int fd);
+
+        int get_fd() const {
+            return fd;
+        }
+
+        Result write(std::string_view data, size_t &calls) override;
+    };
+
+    /**
+     * An OutputSink which opens and owns a file, the file is truncated when opened
+     */
+    class FileSink : public FdSink {
+      public:
+        explicit FileSink(const std::string &path);
+        FileSink(const FileSink &) = delete;
+        FileSink(FileSink &&) = delete;
+        FileSink &operator=(const FileSink &) = delete;
+        FileSink &operator=(FileSink &&) = delete;
+        ~FileSink();
+
+        /// Returns whether the file was opened
+        bool is_open() const {
+            return fd >= 0;
+        }
+    };
+
+    /**
+     * An OutputSink which appends to a growable memory buffer
+     */
+    class MemorySink : public OutputSink {
+        std::string buffer;
+
+      public:
+        MemorySink() = default;
+
+        /// Returns the data written so far
+        const std::string &get_data() const {
+            return buffer;
+        }
+
+        /// Discards the data written so far, keeping the memory
+        void clear() {
+            buffer.clear();
+        }
+
+        Result write(std::string_view data, size_t &calls) override;
+    };
+
+    /**
+     * An OutputSink which interprets the escape sequences written to it and keeps
+     * an in-memory model of the screen, as a terminal would. It understands cursor
+     * movement (CUP, CUU, CUD, CUF, CUB, CHA, VPA), erasing (ED, EL, ECH), scrolling
+     * (SU, SD, IL, DL) and SGR attributes with true colors. Modes, mouse and keyboard
+     * protocol requests and OSC strings are counted but otherwise ignored.
+     *
+     * Erased cells are blanks with the current colors and no attributes.
+     */
+    class VirtualTerminal : public OutputSink {
+      public:
+        class VirtualTerminalImpl;
+
+        struct Stats {
+            /// Number of bytes written
+            size_t bytes = 0;
+            /// Number of escape sequences
+            size_t sequences = 0;
+            /// Number of characters printed
+            size_t printed = 0;
+        };
+
+      private:
+        std::unique_ptr<VirtualTerminalImpl> impl;
+
+      public:
+        explicit VirtualTerminal(Size size);
+        VirtualTerminal(const VirtualTerminal &) = delete;
+        VirtualTerminal(VirtualTerminal &&) = delete;
+        VirtualTerminal &operator=(const VirtualTerminal &) = delete;
+        VirtualTerminal &operator=(VirtualTerminal &&) = delete;
+        ~VirtualTerminal();
+
+        Result write(std::string_view data, size_t &calls) override;
+
+        /// Returns the size of the screen
+        Size get_size() const;
+        /// Resizes the screen keeping the content of the region common to both sizes
+        void resize(Size size);
+        /// Returns the cell of the screen at (col, row)
+        StyledChar get_cell(size_t col, size_t row) const;
+        /// Returns the characters of the row of the screen encoded in UTF-8
+        std::string get_text(size_t row) const;
+        /// Returns the position of the cursor
+        Position get_cursor() const;
+
+        /// Returns the counters accumulated since the last reset_stats() call
+        const Stats &get_stats() const;
+        /// Resets the counters
+        void reset_stats();
+
+        /**
+         * Checks whether the screen shows the last frame rendered by the state.
+         * The STYLE_RESET flag is not compared, since it is an action rather than an attribute
+         * @param state the console state to compare against
+         * @param [out] mismatch if not null, set to the first cell that differs
+         * @return true if every cell matches
+         */
+        bool matches(const State &state, Position *mismatch = nullptr) const;
+    };
+
+    /**
+     * Represents a source of input bytes which are read in place of the console input
+     */
+    class InputSource {
+      public:
+        virtual ~InputSource() = default;
+
+        /**
+         * Reads the bytes available without waiting
+         * @param [out] buffer the buffer to read into
+         * @param size the size of the buffer
+         * @return size_t the number of bytes read, 0 if none are available
+         */
+        virtual size_t read(char *buffer, size_t size) = 0;
+    };
+
+    /**
+     * An InputSource which delivers the bytes pushed to it. The bytes pushed between
+     * two frames are delivered in the next PollEvent calls, so a script of terminal
+     * input can be replayed deterministically
+     */
+    class ScriptedInput : public InputSource {
+        std::string pending;
+        size_t offset = 0;
+
+      public:
+        ScriptedInput() = default;
+
+        /// Appends the bytes to the pending input
+        void push(std::string_view bytes) {
+            pending.append(bytes);
+        }
+
+        /// Returns whether all pushed bytes were read
+        bool is_empty() const {
+            return offset == pending.size();
+        }
+
+        size_t read(char *buffer, size_t size) override;
+    };
+
+    struct InitInfo {
+        /// Where the output is written. If set, the console is left untouched
+        /// and only the frames are written to the sink
+        std::shared_ptr<OutputSink> sink = nullptr;
+        /// Where the input is read from, the console if null. Only
+        /// supported by the escape sequence backend
+        std::shared_ptr<InputSource> input = nullptr;
+        /// Whether to fail when the output is not a terminal. If not required and the output
+        /// is not a terminal, the console is left untouched and the frames are written to it
+        bool require_tty = true;
+        /// Size of the frames, the size of the console window if empty.
+        /// Must be set when the output is not a terminal or goes to a sink
+        std::optional<Size> size = std::nullopt;
+    };
+
     /**
      * Initializes the console and prepares all necessary components.
      * Caps the FPS of the console screen at 60.
@@ -1391,6 +1954,14 @@ namespace nite
      * @return Result
      */
     Result Initialize(State &state);
+    /**
+     * Initializes the library with the specified information provided by the InitInfo struct.
+     * Caps the FPS of the console screen at 60.
+     * @param [inout] state the console state to work on
+     * @param [in] info the init info
+     * @return Result
+     */
+    Result Initialize(State &state, InitInfo info);
     /**
      * Cleanups the console and restores the terminal state
      * @param [inout] state the console state to work on
@@ -1441,6 +2012,146 @@ namespace nite
      * @param [inout] state the console state to work on
      */
     void SetTargetFPS(const State &state, double fps);
+
+    /**
+     * Represents the measurements of a single frame. Times are in seconds
+     */
+    struct FrameStats {
+        /// Time between the end of the previous frame and the end of this frame, including the sleep
+        double frame_time = 0;
+        /// Time spent by the app drawing, from BeginDrawing to EndDrawing
+        double draw_time = 0;
+        /// Time spent comparing the frame with the previous frame
+        double diff_time = 0;
+        /// Time spent encoding the changed cells
+        double encode_time = 0;
+        /// Time spent writing the encoded cells to the console
+        double write_time = 0;
+        /// Time spent sleeping to meet the target FPS
+        double sleep_time = 0;
+        /// Number of cells set by the widgets
+        size_t cells_written = 0;
+        /// Number of cells compared with the previous frame
+        size_t cells_diffed = 0;
+        /// Number of changed cells sent to the console
+        size_t cells_emitted = 0;
+        /// Number of bytes written to the console
+        size_t bytes_written = 0;
+        /// Number of write system calls made
+        size_t write_calls = 0;
+        /// Number of events polled for the frame
+        size_t events_processed = 0;
+        /// Number of heap allocations made since the previous frame ended.
+        /// The allocations are only counted if nite is built with NITE_TRACK_ALLOCATIONS
+        size_t allocations = 0;
+        /// Number of heap allocations made while polling the events
+        size_t event_allocations = 0;
+        /// Number of heap allocations made from BeginDrawing to EndDrawing
+        size_t draw_allocations = 0;
+        /// Number of heap allocations made while diffing, encoding and writing the frame
+        size_t present_allocations = 0;
+        /// Number of bytes taken from the frame allocator
+        size_t arena_bytes = 0;
+    };
+
+    /**
+     * Returns the statistics of the previous frame
+     * @param state the console state to work on
+     * @return FrameStats
+     */
+    FrameStats GetFrameStats(const State &state);
+    /**
+     * Returns the number of heap allocations the process has made so far.
+     * nite replaces the global operator new to count them only if it is built
+     * with NITE_TRACK_ALLOCATIONS, otherwise this always returns 0
+     * @return size_t
+     */
+    size_t GetAllocationCount();
+    /**
+     * Returns the given percentile of every field of the statistics over the
+     * recorded frames. Each field is computed on its own, so the result is not
+     * the statistics of any single frame
+     * @param state the console state to work on
+     * @param percentile the percentile in the range [0, 100]
+     * @return FrameStats
+     */
+    FrameStats GetFrameStatsPercentile(const State &state, double percentile);
+    /**
+     * Sets the number of most recent frames the percentiles are computed over
+     * and discards the recorded frames. The default is 120 frames
+     * @param state the console state to work on
+     * @param frames the number of frames, at least 1
+     */
+    void SetFrameStatsWindow(const State &state, size_t frames);
+
+    struct HUDInfo {
+        /// Whether the HUD is shown
+        bool visible = false;
+        /// Key that shows or hides the HUD, the HUD cannot be toggled by a key if empty
+        std::optional<KeyCode> toggle_key = KeyCode::F12;
+        /// Number of frames shown by the frame time graph, limited by the frame statistics window
+        size_t graph_frames = 32;
+    };
+
+    /**
+     * Configures the performance HUD. The HUD is drawn in the top right corner over the
+     * content of the app in EndDrawing. It shows a graph of the recent frame times and
+     * the statistics of the previous frame, see FrameStats. By default the HUD is hidden
+     * and F12 toggles it
+     * @param state the console state to work on
+     * @param info the HUD info
+     */
+    void SetHUD(const State &state, HUDInfo info);
+    /**
+     * Returns whether the performance HUD is shown
+     * @param state the console state to work on
+     */
+    bool IsHUDVisible(const State &state);
+
+    /**
+     * Represents the measurements of a pane in a frame. A scope includes
+     * the scopes of the panes nested in it
+     */
+    struct ProfileScope {
+        /// Name of the pane given by the caller
+        std::string name;
+        /// Number of scopes enclosing this scope
+        size_t depth = 0;
+        /// Time from BeginDrawing to the creation of the pane, in seconds
+        double start = 0;
+        /// Time from the creation of the pane to its EndPane call, in seconds
+        double duration = 0;
+        /// Number of cells set inside the pane
+        size_t cells = 0;
+    };
+
+    /**
+     * Enables or disables the profiling of panes. While enabled, every pane created by
+     * BeginPane, BeginScrollPane, BeginGridPane and BeginGridCell records a ProfileScope.
+     * Any recorded frames are discarded
+     * @param state the console state to work on
+     * @param enabled whether to profile
+     * @param frames the number of most recent frames to keep, at least 1
+     */
+    void SetProfiling(const State &state, bool enabled, size_t frames = 256);
+    /**
+     * Returns whether the panes are being profiled
+     * @param state the console state to work on
+     */
+    bool IsProfiling(const State &state);
+    /**
+     * Returns the profile scopes of the previous frame in the order the panes were created.
+     * The returned reference is valid until the next EndDrawing call
+     * @param state the console state to work on
+     */
+    const std::vector<ProfileScope> &GetProfileScopes(const State &state);
+    /**
+     * Writes the recorded frames to a file in the Chrome trace event format,
+     * which can be opened in chrome://tracing or https://ui.perfetto.dev
+     * @param state the console state to work on
+     * @param path the path of the file
+     */
+    Result ExportProfileTrace(const State &state, const std::string &path);
     /**
      * Returns whether the console window should be closed
      * @param [inout] state the console state to work on
@@ -1450,16 +2161,25 @@ namespace nite
     bool ShouldWindowClose(const State &state);
 
     /**
-     * Creates and pushes a new screen buffer to the swapchain
+     * Prepares the back buffer for drawing a new frame
      * @param [inout] state the console state to work on
      */
     void BeginDrawing(State &state);
     /**
-     * Pops the latest frame from the swapchain and selectively renders 
-     * the screen buffer on the console window
+     * Renders the cells of the back buffer that differ from the front buffer
+     * on the console window, then swaps the buffers
      * @param [inout] state the console state to work on
      */
     void EndDrawing(State &state);
+    /**
+     * Returns the memory resource for the temporaries of the current frame, such as
+     * std::pmr::vector<int> values(GetFrameAllocator(state)). The memory is released
+     * all at once by the next BeginDrawing, so nothing allocated from it may be used
+     * after that. Once the frames are of a steady size it does not allocate on the heap
+     * @param [inout] state the console state to work on
+     * @return std::pmr::memory_resource*
+     */
+    std::pmr::memory_resource *GetFrameAllocator(State &state);
     /**
      * Closes the console window
      * @param [inout] state the console state to work on
@@ -1467,13 +2187,25 @@ namespace nite
     void CloseWindow(State &state);
 
     /**
-     * Sets a specific cell on the console window
+     * Sets a specific cell on the console window. A wide character takes the cell after it as well,
+     * a zero width character joins the character in the cell before it
      * @param [inout] state the console state to work on
      * @param [in] value the cell text
      * @param [in] position the position of the cell
      * @param [in] style the style of the cell
      */
     void SetCell(State &state, wchar_t value, const Position position, const Style style = {});
+    /**
+     * Returns the number of columns a character takes on the console window,
+     * 2 for the wide characters and 0 for the ones joining the character before them
+     * @param [in] value the character
+     */
+    size_t GetCharWidth(wchar_t value);
+    /**
+     * Returns the number of columns a UTF-8 text takes on the console window
+     * @param [in] text the text
+     */
+    size_t GetTextWidth(std::string_view text);
     /**
      * Sets the style of a specific cell on the console window
      * @param [inout] state the console state to work on
@@ -1592,10 +2324,13 @@ namespace nite
      * @param [inout] state the console state to work on
      * @param [in] top_left the position of the top left corner of the pane
      * @param [in] size the size of the pane
+     * @param [in] name the name of the pane in the profiler
      */
-    void BeginPane(State &state, const Position top_left, const Size size);
+    void BeginPane(State &state, const Position top_left, const Size size, const std::string_view name = "Pane");
 
     struct ScrollPaneInfo {
+        /// Name of the scroll pane in the profiler
+        std::string_view name = "ScrollPane";
         /// Position of the scroll pane (top left corner)
         Position pos = {};
         /// Minimum size (actual viewport size) of the scroll pane
@@ -1631,8 +2366,20 @@ namespace nite
      * @param [in] info the scroll pane info
      */
     void BeginScrollPane(State &state, Position &pivot, ScrollPaneInfo info);
+    /**
+     * Creates a scroll pane on the screen with the specified information
+     * provided by the ScrollPaneInfo struct. The scroll state is kept
+     * by the library for the widget with \p id.
+     * 
+     * @param [inout] state the console state to work on
+     * @param [in] id the ID of the scroll pane
+     * @param [in] info the scroll pane info
+     */
+    void BeginScrollPane(State &state, WidgetID id, ScrollPaneInfo info);
 
     struct GridPaneInfo {
+        /// Name of the grid pane in the profiler
+        std::string_view name = "GridPane";
         /// Position of the grid pane (top left corner)
         Position pos = {};
         /// Size of the grid pane
@@ -1669,8 +2416,9 @@ namespace nite
      * @param [inout] state the console state to work on
      * @param [in] col the column index of the grid cell
      * @param [in] row the row index of the grid cell
+     * @param [in] name the name of the grid cell in the profiler
      */
-    void BeginGridCell(State &state, size_t col, size_t row);
+    void BeginGridCell(State &state, size_t col, size_t row, const std::string_view name = "GridCell");
 
     /**
      * Creates a NoPane on the screen. Any screen updates before the corresponding EndPane call
@@ -1735,9 +2483,20 @@ namespace nite
     void DrawVDivider(State &state, size_t col, wchar_t fill = L'│', Style style = {});
 
     class FocusTable {
-        std::list<std::string> keys;
-        std::unordered_set<std::string> table;
-        std::list<std::string>::iterator focused = std::end(keys);
+        // Elements in the focus order, the names are kept for get_focus_name
+        std::vector<WidgetID> keys;
+        std::vector<std::string> names;
+        std::unordered_map<WidgetID, size_t> table;
+        size_t focused = NO_FOCUS;
+
+        static constexpr size_t NO_FOCUS = std::numeric_limits<size_t>::max();
+
+        void add(const WidgetID id, const std::string_view name) {
+            if (table.emplace(id, keys.size()).second) {
+                keys.push_back(id);
+                names.emplace_back(name);
+            }
+        }
 
       public:
         FocusTable() = default;
@@ -1754,33 +2513,69 @@ namespace nite
 
         /// Returns whether the table is empty
         bool empty() const {
-            return table.empty();
+            return keys.empty();
         }
 
         /// Returns the size of the table
         size_t size() const {
-            return table.size();
+            return keys.size();
         }
 
         /// Clears the entire table and nothing is focused
         void clear() {
             keys.clear();
+            names.clear();
             table.clear();
-            focused = std::end(keys);
+            focused = NO_FOCUS;
+        }
+
+        /// Returns whether the element with \p id exists in the table
+        bool contains(const WidgetID id) const {
+            return table.find(id) != table.end();
         }
 
         /// Returns whether \p name exists in the table
-        bool contains(const std::string &name) const {
-            return table.find(name) != table.end();
+        bool contains(const std::string_view name) const {
+            return contains(internal::hash_id(name));
+        }
+
+        /// Removes the element with \p id
+        void erase(const WidgetID id) {
+            const auto it = table.find(id);
+            if (it == table.end())
+                return;
+
+            const size_t index = it->second;
+            if (focused == index)
+                focused = NO_FOCUS;
+            else if (focused != NO_FOCUS && focused > index)
+                focused--;
+
+            table.erase(it);
+            keys.erase(keys.begin() + index);
+            names.erase(names.begin() + index);
+            for (size_t i = index; i < keys.size(); i++)
+                table[keys[i]] = i;
         }
 
         /// Removes the element with \p name
-        void erase(const std::string &name) {
-            if (*focused == name)
-                focused = std::end(keys);
+        void erase(const std::string_view name) {
+            erase(internal::hash_id(name));
+        }
+
+        /**
+         * Sets focus to the element with the ID
+         * @param id the ID of the element
+         * @param focus the focus value
+         */
+        void set_focus(const WidgetID id, bool focus) {
+            add(id, {});
+            const size_t index = table.find(id)->second;
 
-            keys.remove(name);
-            table.erase(name);
+            if (focus)
+                focused = index;
+            else if (focused == index)
+                focused = NO_FOCUS;
         }
 
         /**
@@ -1788,18 +2583,18 @@ namespace nite
          * @param name the name of the element
          * @param focus the focus value
          */
-        void set_focus(const std::string &name, bool focus) {
-            if (table.find(name) == table.end())
-                keys.push_back(name);
-            table.insert(name);
-
-            if (focus) {
-                if (focused == std::end(keys) || *focused != name)
-                    focused = std::find(std::begin(keys), std::end(keys), name);
-            } else {
-                if (focused != std::end(keys) && *focused == name)
-                    focused = std::end(keys);
-            }
+        void set_focus(const std::string_view name, bool focus) {
+            add(internal::hash_id(name), name);
+            set_focus(internal::hash_id(name), focus);
+        }
+
+        /**
+         * @param id the ID of the element
+         * @return true if the element with \p id has focus
+         * @return false if the element with \p id does not have focus
+         */
+        bool has_focus(const WidgetID id) const {
+            return focused != NO_FOCUS && keys[focused] == id;
         }
 
         /**
@@ -1807,8 +2602,18 @@ namespace nite
          * @return true if \p name has focus
          * @return false if \p name does not have focus
          */
-        bool has_focus(const std::string &name) const {
-            return focused != std::end(keys) && *focused == name;
+        bool has_focus(const std::string_view name) const {
+            return has_focus(internal::hash_id(name));
+        }
+
+        /**
+         * Returns the ID of the focused element as an std::optional
+         * @return std::optional<WidgetID>
+         */
+        std::optional<WidgetID> get_focus_id() const {
+            if (focused == NO_FOCUS)
+                return std::nullopt;
+            return keys[focused];
         }
 
         /**
@@ -1816,9 +2621,9 @@ namespace nite
          * @return std::optional<std::string> 
          */
         std::optional<std::string> get_focus_name() const {
-            if (focused == std::end(keys))
+            if (focused == NO_FOCUS)
                 return std::nullopt;
-            return *focused;
+            return names[focused];
         }
 
         /**
@@ -1828,61 +2633,42 @@ namespace nite
          * @return false if focused element is not present
          */
         bool get_focus_name(std::string &name) const {
-            if (focused == std::end(keys))
+            if (focused == NO_FOCUS)
                 return false;
-            name = *focused;
+            name = names[focused];
             return true;
         }
 
         /// Focuses the first element
         void focus_front() {
-            if (table.empty()) {
-                focused = std::end(keys);
-                return;
-            }
-            focused = std::begin(keys);
+            focused = keys.empty() ? NO_FOCUS : 0;
         }
 
         /// Focuses the last element
         void focus_back() {
-            if (table.empty()) {
-                focused = std::end(keys);
-                return;
-            }
-            focused = std::end(keys);
-            focused--;
+            focused = keys.empty() ? NO_FOCUS : keys.size() - 1;
         }
 
         /// Focuses the next element
         void focus_next() {
-            if (table.empty()) {
-                focused = std::end(keys);
-                return;
-            }
-
-            if (focused == std::end(keys))
-                focused = std::begin(keys);
-            else {
+            if (keys.empty())
+                focused = NO_FOCUS;
+            else if (focused == NO_FOCUS || focused + 1 == keys.size())
+                focused = 0;
+            else
                 focused++;
-                if (focused == std::end(keys))
-                    focused = std::begin(keys);
-            }
         }
 
-        /// Focuses the previous element
+        /// Focuses the previous element, the first one if none is focused
         void focus_prev() {
-            if (table.empty()) {
-                focused = std::end(keys);
-                return;
-            }
-
-            if (focused == std::end(keys))
-                focused = std::begin(keys);
-            else {
-                if (focused == std::begin(keys))
-                    focused = std::end(keys);
+            if (keys.empty())
+                focused = NO_FOCUS;
+            else if (focused == NO_FOCUS)
+                focused = 0;
+            else if (focused == 0)
+                focused = keys.size() - 1;
+            else
                 focused--;
-            }
         }
     };
 
@@ -1915,6 +2701,35 @@ namespace nite
      */
     size_t Text(State &state, TextInfo info);
 
+    struct TextViewInfo {
+        /// The text to display, not copied
+        std::string_view text = {};
+        /// Position of the text
+        Position pos = {};
+        /// Style of the text
+        Style style = {};
+        /// Whether the thing is focused
+        bool focus = false;
+
+        /// Handler triggered when mouse is hovered
+        HandlerRef<TextViewInfo> on_hover = {};
+        /// Handler triggered when mouse clicks on this
+        HandlerRef<TextViewInfo> on_click = {};
+        /// Handler triggered when mouse double clicks on this
+        HandlerRef<TextViewInfo> on_click2 = {};
+        /// Handler triggered when mouse right clicks on this
+        HandlerRef<TextViewInfo> on_menu = {};
+    };
+
+    /**
+     * Same as Text, but draws the text of the caller without copying it or the handlers.
+     * This does not support multi-line text.
+     * @param [inout] state the console state to work on
+     * @param [in] info the text information provided
+     * @return size_t 
+     */
+    size_t TextView(State &state, TextViewInfo info);
+
     struct RichTextInfo {
         /// The text to display (with style)
         std::vector<StyledChar> text = {};
@@ -1942,6 +2757,33 @@ namespace nite
      */
     size_t RichText(State &state, RichTextInfo info);
 
+    struct RichTextViewInfo {
+        /// The text to display (with style), not copied
+        std::span<const StyledChar> text = {};
+        /// Position of the text
+        Position pos = {};
+        /// Whether the thing is focused
+        bool focus = false;
+
+        /// Handler triggered when mouse is hovered
+        HandlerRef<RichTextViewInfo> on_hover = {};
+        /// Handler triggered when mouse clicks on this
+        HandlerRef<RichTextViewInfo> on_click = {};
+        /// Handler triggered when mouse double clicks on this
+        HandlerRef<RichTextViewInfo> on_click2 = {};
+        /// Handler triggered when mouse right clicks on this
+        HandlerRef<RichTextViewInfo> on_menu = {};
+    };
+
+    /**
+     * Same as RichText, but draws the text of the caller without copying it or the handlers.
+     * This does not support multi-line text.
+     * @param [inout] state the console state to work on
+     * @param [in] info the text information provided
+     * @return size_t 
+     */
+    size_t RichTextView(State &state, RichTextViewInfo info);
+
     struct TextBoxInfo {
         /// The text to display
         std::string text = {};
@@ -1953,6 +2795,8 @@ namespace nite
         Style style = {};
         /// Whether text should be wrapped
         bool wrap = true;
+        /// Whether wrapping breaks the lines between words rather than anywhere
+        bool word_wrap = true;
         /// Alignment of the text inside the text box
         Align align = Align::TOP_LEFT;
         /// Whether the thing is focused
@@ -1971,11 +2815,49 @@ namespace nite
     /**
      * Draws a text box with the specified info provided by \p info .
      * This supports multi-line text.
+     * The lines are laid out once and reused while the text, the width and the wrapping stay the same.
+     * Text which does not fit is clipped at the right and the bottom whatever the alignment.
      * @param [inout] state the console state to work on
      * @param [in] info the text box info
      */
     void TextBox(State &state, TextBoxInfo info);
 
+    struct TextBoxViewInfo {
+        /// The text to display, not copied
+        std::string_view text = {};
+        /// Position of the text box
+        Position pos = {};
+        /// Size of the text box
+        Size size = {};
+        /// Style of the text box
+        Style style = {};
+        /// Whether text should be wrapped
+        bool wrap = true;
+        /// Whether wrapping breaks the lines between words rather than anywhere
+        bool word_wrap = true;
+        /// Alignment of the text inside the text box
+        Align align = Align::TOP_LEFT;
+        /// Whether the thing is focused
+        bool focus = false;
+
+        /// Handler triggered when mouse is hovered
+        HandlerRef<TextBoxViewInfo> on_hover = {};
+        /// Handler triggered when mouse clicks on this
+        HandlerRef<TextBoxViewInfo> on_click = {};
+        /// Handler triggered when mouse double clicks on this
+        HandlerRef<TextBoxViewInfo> on_click2 = {};
+        /// Handler triggered when mouse right clicks on this
+        HandlerRef<TextBoxViewInfo> on_menu = {};
+    };
+
+    /**
+     * Same as TextBox, but draws the text of the caller without copying it or the handlers.
+     * This supports multi-line text.
+     * @param [inout] state the console state to work on
+     * @param [in] info the text box info
+     */
+    void TextBoxView(State &state, TextBoxViewInfo info);
+
     struct RichTextBoxInfo {
         /// The text to display (with style)
         std::vector<StyledChar> text = {};
@@ -1987,6 +2869,8 @@ namespace nite
         Style style = {};
         /// Whether text should be wrapped
         bool wrap = true;
+        /// Whether wrapping breaks the lines between words rather than anywhere
+        bool word_wrap = true;
         /// Alignment of the text inside the text box
         Align align = Align::TOP_LEFT;
         /// Whether the thing is focused
@@ -2005,11 +2889,49 @@ namespace nite
     /**
      * Draws a rich text box the specified info provided by \p info .
      * This supports multi-line text.
+     * The lines are laid out once and reused while the text, the width and the wrapping stay the same.
+     * Text which does not fit is clipped at the right and the bottom whatever the alignment.
      * @param [inout] state the console state to work on
      * @param [in] info the rich text box info
      */
     void RichTextBox(State &state, RichTextBoxInfo info);
 
+    struct RichTextBoxViewInfo {
+        /// The text to display (with style), not copied
+        std::span<const StyledChar> text = {};
+        /// Position of the rich text box
+        Position pos = {};
+        /// Size of the rich text box
+        Size size = {};
+        /// Default style of the rich text box
+        Style style = {};
+        /// Whether text should be wrapped
+        bool wrap = true;
+        /// Whether wrapping breaks the lines between words rather than anywhere
+        bool word_wrap = true;
+        /// Alignment of the text inside the text box
+        Align align = Align::TOP_LEFT;
+        /// Whether the thing is focused
+        bool focus = false;
+
+        /// Handler triggered when mouse is hovered
+        HandlerRef<RichTextBoxViewInfo> on_hover = {};
+        /// Handler triggered when mouse clicks on this
+        HandlerRef<RichTextBoxViewInfo> on_click = {};
+        /// Handler triggered when mouse double clicks on this
+        HandlerRef<RichTextBoxViewInfo> on_click2 = {};
+        /// Handler triggered when mouse right clicks on this
+        HandlerRef<RichTextBoxViewInfo> on_menu = {};
+    };
+
+    /**
+     * Same as RichTextBox, but draws the text of the caller without copying it or the handlers.
+     * This supports multi-line text.
+     * @param [inout] state the console state to work on
+     * @param [in] info the rich text box info
+     */
+    void RichTextBoxView(State &state, RichTextBoxViewInfo info);
+
     // TODO: find a better way to describe progress bar motion
 
     inline static constexpr std::array DEFAULT_MOTION = {
@@ -2101,41 +3023,560 @@ namespace nite
      */
     Size SimpleTable(State &state, SimpleTableInfo info);
 
+    struct SimpleTableViewInfo {
+        /// Data of the table, not copied
+        std::span<const std::string> data = {};
+        /// Whether to treat the top row as table header row
+        bool include_header_row = true;
+        /// Number columns in the table
+        size_t num_cols = 0;
+        /// Number rows in the table
+        size_t num_rows = 0;
+
+        /// Position of the table
+        Position pos = {};
+        /// Header row style of the table
+        Style header_style = {.mode = STYLE_BOLD};
+        /// Style of other cells of the table (not header row)
+        Style table_style = {};
+
+        /// Whether to show borders
+        bool show_border = false;
+        /// Border style of the table
+        TableBorder border = TABLE_BORDER_DEFAULT;
+
+        /// Whether the thing is focused
+        bool focus = false;
+    };
+
+    /**
+     * Same as SimpleTable, but draws the data of the caller without copying it
+     * 
+     * @param [inout] state the console state to work on
+     * @param [in] info the info describing the table
+     * @return Size 
+     */
+    Size SimpleTableView(State &state, SimpleTableViewInfo info);
+
+    /**
+     * Represents a column oriented source of data for a DataGrid.
+     * The grid only asks for the cells it actually displays, so the data
+     * is never copied into the grid.
+     */
+    class GridDataSource {
+      public:
+        virtual ~GridDataSource() = default;
+
+        /// Returns the number of columns
+        virtual size_t num_cols() const = 0;
+        /// Returns the number of rows (without the header row)
+        virtual size_t num_rows() const = 0;
+        /// Returns the header text of the column
+        virtual std::string_view header(size_t col) const = 0;
+        /// Returns the text of the cell at (col, row)
+        virtual std::string_view cell(size_t col, size_t row) const = 0;
+
+        /**
+         * Returns the revision of the data. The revision must change whenever
+         * existing cells are modified or removed, so that the cached column widths
+         * are measured again. Appending rows must not change the revision.
+         * @return uint64_t
+         */
+        virtual uint64_t revision() const {
+            return 0;
+        }
+    };
+
+    /**
+     * A simple GridDataSource which owns its data and stores it column by column
+     */
+    class GridColumns : public GridDataSource {
+        std::vector<std::string> headers;
+        std::vector<std::vector<std::string>> columns;
+        size_t rows = 0;
+        uint64_t rev = 0;
+
+      public:
+        GridColumns() = default;
+        GridColumns(const GridColumns &) = default;
+        GridColumns(GridColumns &&) = default;
+        GridColumns &operator=(const GridColumns &) = default;
+        GridColumns &operator=(GridColumns &&) = default;
+        ~GridColumns() = default;
+
+        GridColumns(std::initializer_list<std::string> list) : headers(list), columns(list.size()) {}
+
+        /// Appends a row, missing cells are left empty and extra cells are ignored
+        void append_row(std::initializer_list<std::string_view> row) {
+            auto it = row.begin();
+            for (auto &column: columns)
+                column.emplace_back(it != row.end() ? *it++ : std::string_view());
+            rows++;
+        }
+
+        /// Appends a row, missing cells are left empty and extra cells are ignored
+        void append_row(const std::vector<std::string> &row) {
+            for (size_t col = 0; col < columns.size(); col++)
+                columns[col].push_back(col < row.size() ? row[col] : std::string());
+            rows++;
+        }
+
+        /// Reserves space for \p count rows
+        void reserve(size_t count) {
+            for (auto &column: columns)
+                column.reserve(count);
+        }
+
+        /// Sets the text of the cell at (col, row)
+        void set_cell(size_t col, size_t row, std::string text) {
+            if (col >= columns.size() || row >= rows)
+                return;
+            columns[col][row] = std::move(text);
+            rev++;
+        }
+
+        /// Removes all the rows
+        void clear() {
+            for (auto &column: columns)
+                column.clear();
+            rows = 0;
+            rev++;
+        }
+
+        size_t num_cols() const override {
+            return columns.size();
+        }
+
+        size_t num_rows() const override {
+            return rows;
+        }
+
+        std::string_view header(size_t col) const override {
+            return col < headers.size() ? std::string_view(headers[col]) : std::string_view();
+        }
+
+        std::string_view cell(size_t col, size_t row) const override {
+            return col < columns.size() && row < rows ? std::string_view(columns[col][row]) : std::string_view();
+        }
+
+        uint64_t revision() const override {
+            return rev;
+        }
+    };
+
+    /**
+     * Represents the persistent state of a DataGrid, i.e. the scroll position
+     * and the cached column widths
+     */
+    class DataGridState {
+        size_t row_offset = 0;
+        size_t col_offset = 0;
+
+        std::vector<size_t> col_widths;
+        const GridDataSource *measured_source = nullptr;
+        uint64_t measured_revision = 0;
+        size_t measured_rows = 0;
+
+      public:
+        DataGridState() = default;
+        DataGridState(const DataGridState &) = default;
+        DataGridState(DataGridState &&) = default;
+        DataGridState &operator=(const DataGridState &) = default;
+        DataGridState &operator=(DataGridState &&) = default;
+        ~DataGridState() = default;
+
+        /**
+         * Updates the cached column widths. Only the rows which were appended since the
+         * last call are measured, unless the revision of \p source has changed.
+         * @param source the data source
+         */
+        void measure(const GridDataSource &source);
+
+        /// Forces the column widths to be measured again on the next frame
+        void invalidate() {
+            measured_source = nullptr;
+        }
+
+        /// Returns the cached width of the column
+        size_t get_col_width(size_t col) const {
+            return col < col_widths.size() ? col_widths[col] : 0;
+        }
+
+        /// Returns the index of the first visible row
+        size_t get_row_offset() const {
+            return row_offset;
+        }
+
+        /// Returns the index of the first visible column
+        size_t get_col_offset() const {
+            return col_offset;
+        }
+
+        /// Scrolls the grid so that \p row is the first visible row
+        void set_row_offset(size_t row) {
+            row_offset = row;
+        }
+
+        /// Scrolls the grid so that \p col is the first visible column
+        void set_col_offset(size_t col) {
+            col_offset = col;
+        }
+    };
+
+    struct DataGridInfo {
+        /// Position of the grid
+        Position pos = {};
+        /// Size of the grid (the viewport)
+        Size size = {};
+        /// Whether to show the header row
+        bool show_header = true;
+        /// Header row style of the grid
+        Style header_style = {.mode = STYLE_BOLD};
+        /// Style of other cells of the grid (not header row)
+        Style table_style = {};
+        /// Number of rows scrolled per mouse wheel step
+        size_t scroll_factor = 3;
+
+        /// Whether the thing is focused (enables keyboard navigation)
+        bool focus = false;
+    };
+
+    /**
+     * Draws a virtualized data grid on the screen. Only the visible rows and columns
+     * are read from \p source and drawn, and the column widths are cached in \p grid_state
+     * so that large tables can be drawn every frame.
+     *
+     * @param [inout] state the console state to work on
+     * @param [inout] grid_state the persistent state of the grid
+     * @param [in] source the data to display
+     * @param [in] info the info describing the grid
+     */
+    void DataGrid(State &state, DataGridState &grid_state, const GridDataSource &source, DataGridInfo info);
+
+    enum class SortOrder {
+        NONE,
+        ASCENDING,
+        DESCENDING,
+    };
+
+    struct DataViewQuery {
+        /// The column to sort by
+        size_t sort_col = 0;
+        /// The order to sort in, NONE keeps the order of the source
+        SortOrder order = SortOrder::NONE;
+        /// Compares two cells of the sort column, compares the text if not provided.
+        /// This is called from the worker threads
+        std::function<bool(std::string_view, std::string_view)> compare = nullptr;
+        /// Returns whether a row of the source should be kept, keeps all rows if not provided.
+        /// This is called from the worker threads
+        std::function<bool(const GridDataSource &, size_t)> filter = nullptr;
+    };
+
+    /**
+     * Represents a sorted and filtered view over a snapshot of a GridDataSource.
+     * The sorting and filtering runs on a pool of worker threads, and the
+     * view keeps showing the previous result until the new one is published.
+     *
+     * The snapshot must not be modified while the view holds it, and its const
+     * member functions must be safe to call from multiple threads.
+     * To change the data, pass a new snapshot to set_source().
+     */
+    class DataView : public GridDataSource {
+      public:
+        class DataViewImpl;
+
+      private:
+        std::unique_ptr<DataViewImpl> impl;
+
+      public:
+        /**
+         * Creates a data view with its own worker pool
+         * @param num_threads the number of worker threads, 0 means the number of hardware threads
+         */
+        explicit DataView(size_t num_threads = 0);
+        DataView(const DataView &) = delete;
+        DataView(DataView &&) = delete;
+        DataView &operator=(const DataView &) = delete;
+        DataView &operator=(DataView &&) = delete;
+        ~DataView();
+
+        /**
+         * Sets a new snapshot of the data and computes the current query over it
+         * @param source the snapshot
+         */
+        void set_source(std::shared_ptr<const GridDataSource> source);
+        /**
+         * Computes a new query over the current snapshot in the background.
+         * Any query which is still running is cancelled.
+         * @param query the query
+         */
+        void submit(DataViewQuery query);
+        /**
+         * Picks up the latest published result. This must be called once per frame
+         * from the thread that draws the view (DataGrid does this for you).
+         * @return true if the view has changed
+         */
+        bool update();
+
+        /// Returns whether a query is being computed
+        bool is_busy() const;
+        /// Returns the progress of the running query from 0 to 1
+        float get_progress() const;
+        /// Returns the snapshot which is currently displayed
+        const GridDataSource *get_source() const;
+        /// Returns the row of the snapshot which is displayed at \p row
+        size_t get_source_row(size_t row) const;
+
+        size_t num_cols() const override;
+        size_t num_rows() const override;
+        std::string_view header(size_t col) const override;
+        std::string_view cell(size_t col, size_t row) const override;
+        uint64_t revision() const override;
+    };
+
+    /**
+     * Draws a virtualized data grid of a DataView. Picks up the latest result
+     * of the view and shows a progress indicator while the view is busy.
+     * The column widths are measured on the snapshot of the view,
+     * so they are not measured again when the view is sorted or filtered.
+     *
+     * @param [inout] state the console state to work on
+     * @param [inout] grid_state the persistent state of the grid
+     * @param [inout] view the data to display
+     * @param [in] info the info describing the grid
+     */
+    void DataGrid(State &state, DataGridState &grid_state, DataView &view, DataGridInfo info);
+
+    namespace internal
+    {
+        /**
+         * A gap buffer, i.e. a vector with a movable gap so that
+         * insertions and deletions near the gap are O(1) amortised
+         * @tparam T the type of the elements
+         */
+        template<typename T>
+        class GapBuffer {
+            std::vector<T> buffer;
+            size_t gap_start = 0;
+            size_t gap_end = 0;
+
+            void grow(size_t count) {
+                if (gap_end - gap_start >= count)
+                    return;
+                const size_t tail = buffer.size() - gap_end;
+                const size_t capacity = std::max(buffer.size() * 2, size() + count + 64);
+                buffer.resize(capacity);
+                std::move_backward(buffer.begin() + gap_end, buffer.begin() + gap_end + tail, buffer.end());
+                gap_end = capacity - tail;
+            }
+
+          public:
+            GapBuffer() = default;
+            GapBuffer(const GapBuffer &) = default;
+            GapBuffer(GapBuffer &&) = default;
+            GapBuffer &operator=(const GapBuffer &) = default;
+            GapBuffer &operator=(GapBuffer &&) = default;
+            ~GapBuffer() = default;
+
+            size_t size() const {
+                return buffer.size() - (gap_end - gap_start);
+            }
+
+            bool empty() const {
+                return size() == 0;
+            }
+
+            /// Returns the index of the gap
+            size_t gap() const {
+                return gap_start;
+            }
+
+            const T &operator[](size_t index) const {
+                return index < gap_start ? buffer[index] : buffer[index + gap_end - gap_start];
+            }
+
+            T &operator[](size_t index) {
+                return index < gap_start ? buffer[index] : buffer[index + gap_end - gap_start];
+            }
+
+            /// Moves the gap so that it starts at \p index
+            void move_gap(size_t index) {
+                if (index < gap_start) {
+                    std::move_backward(buffer.begin() + index, buffer.begin() + gap_start, buffer.begin() + gap_end);
+                    gap_end -= gap_start - index;
+                    gap_start = index;
+                } else if (index > gap_start) {
+                    const size_t count = index - gap_start;
+                    std::move(buffer.begin() + gap_end, buffer.begin() + gap_end + count, buffer.begin() + gap_start);
+                    gap_start += count;
+                    gap_end += count;
+                }
+            }
+
+            void insert(size_t index, const T *values, size_t count) {
+                grow(count);
+                move_gap(index);
+                std::copy(values, values + count, buffer.begin() + gap_start);
+                gap_start += count;
+            }
+
+            void insert(size_t index, const T &value) {
+                insert(index, &value, 1);
+            }
+
+            void erase(size_t index, size_t count) {
+                move_gap(index);
+                gap_end += std::min(count, buffer.size() - gap_end);
+            }
+
+            void clear() {
+                gap_start = 0;
+                gap_end = buffer.size();
+            }
+
+            /// Copies \p count elements starting at \p index to \p out
+            template<typename OutputIt>
+            OutputIt copy(size_t index, size_t count, OutputIt out) const {
+                const size_t end = std::min(index + count, size());
+                for (; index < end && index < gap_start; index++)
+                    *out++ = buffer[index];
+                if (index < end)
+                    out = std::copy(buffer.begin() + (index + gap_end - gap_start), buffer.begin() + (end + gap_end - gap_start), out);
+                return out;
+            }
+        };
+
+        /**
+         * Stores text in a gap buffer together with an index of the line breaks.
+         * The line index is a gap buffer too, its gap follows the last edit.
+         * The positions before its gap are absolute and the positions after its
+         * gap are relative to the end of the text, so edits do not shift them.
+         */
+        class TextBuffer {
+            GapBuffer<char> text;
+            GapBuffer<size_t> breaks;
+
+            size_t break_pos(size_t index) const;
+            size_t count_breaks_before(size_t pos) const;
+            void move_breaks_gap(size_t index);
+
+          public:
+            size_t size() const {
+                return text.size();
+            }
+
+            char operator[](size_t pos) const {
+                return text[pos];
+            }
+
+            void insert(size_t pos, std::string_view str);
+            void erase(size_t pos, size_t count);
+            void clear();
+
+            /// Returns the number of lines
+            size_t line_count() const {
+                return breaks.size() + 1;
+            }
+
+            /// Returns the line containing \p pos
+            size_t line_of(size_t pos) const {
+                return count_breaks_before(pos);
+            }
+
+            /// Returns the position where the line starts
+            size_t line_start(size_t line) const;
+            /// Returns the position where the line ends (the line break or the end of text)
+            size_t line_end(size_t line) const;
+
+            std::string substr(size_t pos, size_t count) const;
+        };
+    }    // namespace internal
+
     class TextInputState {
+      protected:
         bool focus = true;
         bool insert_mode = false;
 
-        std::string data = "";
+        internal::TextBuffer data;
         size_t cursor = 0;
 
         bool selection_mode = false;
         size_t selection_pivot = 0;
 
+        // The first visible line and the row or column within it, kept between frames by process().
+        // The rows and columns are counted in cells, as the characters are shown
+        size_t scroll_line = 0;
+        size_t scroll_row = 0;
+        size_t scroll_col = 0;
+
+        // The formatting works on both std::vector and std::pmr::vector, so that no overload of process() copies
+        template<typename Container>
+        void format_line(
+                Container &result, size_t start, size_t end, bool is_line_end, const Style text_style, const Style selection_style,
+                const Style cur_style
+        ) const;
+
+        template<typename Container>
+        void format_window(
+                Container &result, const Style text_style, const Style selection_style, const Style cursor_style, const Style cursor_style_ins,
+                const Style cursor_style_sel, const Size window, const bool wrap
+        );
+
+        /// Every edit of the text goes through here
+        void text_insert(size_t pos, std::string_view text) {
+            pos = std::min(pos, data.size());
+            if (text.empty())
+                return;
+            on_insert(pos, text);
+            data.insert(pos, text);
+        }
+
+        /// Every edit of the text goes through here
+        void text_erase(size_t pos, size_t count) {
+            pos = std::min(pos, data.size());
+            count = std::min(count, data.size() - pos);
+            if (count == 0)
+                return;
+            on_erase(pos, count);
+            data.erase(pos, count);
+        }
+
+        /// Called before \p text is inserted at \p pos
+        virtual void on_insert(size_t, std::string_view) {}
+
+        /// Called before \p count bytes at \p pos are erased
+        virtual void on_erase(size_t, size_t) {}
+
       public:
         TextInputState() = default;
         TextInputState(const TextInputState &) = default;
         TextInputState(TextInputState &&) = default;
         TextInputState &operator=(const TextInputState &) = default;
         TextInputState &operator=(TextInputState &&) = default;
-        ~TextInputState() = default;
+        virtual ~TextInputState() = default;
 
         void insert_char(char c) {
-            if (insert_mode)
-                data.replace(cursor, 1, 1, c);
-            else
-                data.insert(data.begin() + cursor, c);
+            if (insert_mode && cursor < data.size())
+                text_erase(cursor, 1);
+            text_insert(cursor, std::string_view(&c, 1));
             move_right();
         }
 
+        /// Inserts the text at the cursor as a single edit
+        void insert_text(std::string_view text) {
+            text_insert(cursor, text);
+            move_right(text.size());
+        }
+
         void on_key_backspace() {
             if (1 <= cursor && cursor <= data.size())
-                data.erase(cursor - 1, 1);
+                text_erase(cursor - 1, 1);
             move_left();
         }
 
         void on_key_delete() {
-            if (cursor <= data.size() - 1)
-                data.erase(cursor, 1);
+            if (cursor < data.size())
+                text_erase(cursor, 1);
         }
 
         void move_left(size_t delta = 1) {
@@ -2153,13 +3594,11 @@ namespace nite
         }
 
         void go_home() {
-            const auto idx = data.substr(0, cursor).find_last_of('\n');
-            cursor = cursor == std::string::npos ? 0 : idx + 1;
+            cursor = data.line_start(data.line_of(cursor));
         }
 
         void go_end() {
-            const auto idx = data.substr(cursor).find_first_of('\n');
-            cursor = idx == std::string::npos ? data.size() : idx + cursor;
+            cursor = data.line_end(data.line_of(cursor));
         }
 
         void toggle_insert_mode() {
@@ -2177,7 +3616,7 @@ namespace nite
             if (!selection_mode)
                 return;
             const auto [selection_start, selection_end] = get_selection_range();
-            data.erase(selection_start, selection_end - selection_start);
+            text_erase(selection_start, selection_end - selection_start);
             cursor = selection_pivot = selection_start;
         }
 
@@ -2185,7 +3624,7 @@ namespace nite
             selection_mode = false;
         }
 
-        std::pair<size_t, size_t> get_selection_range() {
+        std::pair<size_t, size_t> get_selection_range() const {
             if (!selection_mode)
                 return {0, 0};
             const size_t selection_start = cursor >= selection_pivot ? selection_pivot : cursor;
@@ -2196,16 +3635,40 @@ namespace nite
         std::string get_selected_text() const {
             if (!selection_mode)
                 return "";
-            if (cursor >= selection_pivot)
-                return data.substr(selection_pivot, cursor - selection_pivot);
-            else
-                return data.substr(cursor, selection_pivot - cursor);
+            const auto [selection_start, selection_end] = get_selection_range();
+            return data.substr(selection_start, selection_end - selection_start);
         }
 
+        /**
+         * Formats the whole text with styles
+         * @return std::vector<StyledChar>
+         */
         std::vector<StyledChar>
         process(const Style text_style, const Style selection_style, const Style cursor_style, const Style cursor_style_ins,
                 const Style cursor_style_sel);
 
+        /**
+         * Formats only the part of the text which is visible in a window of the given size.
+         * The window is scrolled so that the cursor stays visible.
+         * @param window the size of the window
+         * @param wrap whether the lines are wrapped at the width of the window, the wrapped rows are separated by line breaks
+         * @return std::vector<StyledChar>
+         */
+        std::vector<StyledChar>
+        process(const Style text_style, const Style selection_style, const Style cursor_style, const Style cursor_style_ins,
+                const Style cursor_style_sel, const Size window, const bool wrap);
+
+        /**
+         * Formats only the part of the text which is visible in a window of the given size into result,
+         * which is cleared first. Give result the frame allocator to format without allocating on the heap.
+         * @param result the formatted text
+         * @param window the size of the window
+         * @param wrap whether the lines are wrapped at the width of the window, the wrapped rows are separated by line breaks
+         */
+        void
+        process(std::pmr::vector<StyledChar> &result, const Style text_style, const Style selection_style, const Style cursor_style,
+                const Style cursor_style_ins, const Style cursor_style_sel, const Size window, const bool wrap);
+
         std::string delete_line() {
             end_selection();
             go_home();
@@ -2218,11 +3681,12 @@ namespace nite
         }
 
         std::string delete_all() {
-            const auto result = data;
-            data = "";
+            auto result = get_text();
+            text_erase(0, data.size());
             cursor = 0;
             selection_mode = false;
             selection_pivot = 0;
+            scroll_line = scroll_row = scroll_col = 0;
             return result;
         }
 
@@ -2242,8 +3706,32 @@ namespace nite
             return selection_mode;
         }
 
-        const std::string &get_text() const {
-            return data;
+        std::string get_text() const {
+            return data.substr(0, data.size());
+        }
+
+        size_t get_text_size() const {
+            return data.size();
+        }
+
+        char get_char(size_t pos) const {
+            return data[pos];
+        }
+
+        size_t get_line_count() const {
+            return data.line_count();
+        }
+
+        size_t get_line_of(size_t pos) const {
+            return data.line_of(pos);
+        }
+
+        size_t get_line_start(size_t line) const {
+            return data.line_start(line);
+        }
+
+        size_t get_line_end(size_t line) const {
+            return data.line_end(line);
         }
 
         size_t get_cursor() const {
@@ -2251,9 +3739,7 @@ namespace nite
         }
 
         void set_cursor(size_t index) {
-            if (index >= data.size())
-                cursor = data.size();
-            cursor = index;
+            cursor = std::min(index, data.size());
         }
     };
 
@@ -2311,6 +3797,201 @@ namespace nite
 
     void TextField(State &state, TextInputState &text_state, TextFieldInfo info);
 
+    /**
+     * Represents the state of a multi-line text editor.
+     * Keeps an undo/redo history of the edits and the scroll position of the viewport.
+     */
+    class TextEditorState : public TextInputState {
+        // An edit, the text of the edit is stored in history_text
+        struct EditRecord {
+            size_t pos;
+            size_t text_offset;
+            size_t text_size;
+            size_t cursor;
+            /// Whether the text was erased (otherwise inserted)
+            bool erase;
+            /// Whether the text is stored in reverse (consecutive backspaces)
+            bool reversed;
+            /// Whether the edit is undone together with the previous one
+            bool joined;
+        };
+
+        std::deque<EditRecord> undo_records;
+        std::vector<EditRecord> redo_records;
+        std::string history_text;
+        size_t undo_steps = 0;
+        size_t history_limit = 1000;
+        bool sealed = true;
+        bool step_open = false;
+        size_t revision = 0;
+
+        size_t top_line = 0;
+        size_t left_col = 0;
+        // The cursor and the revision when the viewport was last scrolled
+        size_t scroll_cursor = 0;
+        size_t scroll_revision = 0;
+        size_t preferred_col = std::numeric_limits<size_t>::max();
+
+        void push_record(EditRecord record, std::string_view text);
+        void trim_history();
+        std::string record_text(const EditRecord &record) const;
+        void move_vertical(int64_t lines, size_t tab_width);
+
+      protected:
+        void on_insert(size_t pos, std::string_view text) override;
+        void on_erase(size_t pos, size_t count) override;
+
+      public:
+        TextEditorState() = default;
+        TextEditorState(const TextEditorState &) = default;
+        TextEditorState(TextEditorState &&) = default;
+        TextEditorState &operator=(const TextEditorState &) = default;
+        TextEditorState &operator=(TextEditorState &&) = default;
+        ~TextEditorState() = default;
+
+        /// Starts a new undo step, the edits until the next call are undone together
+        void begin_step() {
+            step_open = false;
+        }
+
+        /// Stops merging the following typing into the last edit
+        void seal() {
+            sealed = true;
+            preferred_col = std::numeric_limits<size_t>::max();
+        }
+
+        /**
+         * Undoes the last step
+         * @return true if something was undone
+         */
+        bool undo();
+        /**
+         * Redoes the last undone step
+         * @return true if something was redone
+         */
+        bool redo();
+
+        bool can_undo() const {
+            return !undo_records.empty();
+        }
+
+        bool can_redo() const {
+            return !redo_records.empty();
+        }
+
+        /// Returns a number which changes whenever the text changes
+        size_t get_revision() const {
+            return revision;
+        }
+
+        /// Forgets the undo/redo history
+        void clear_history() {
+            undo_records.clear();
+            redo_records.clear();
+            history_text.clear();
+            undo_steps = 0;
+            sealed = true;
+        }
+
+        /// Sets the number of undo steps kept, the oldest steps are forgotten beyond it
+        void set_history_limit(size_t steps) {
+            history_limit = steps;
+            trim_history();
+        }
+
+        size_t get_history_limit() const {
+            return history_limit;
+        }
+
+        /// Moves the cursor up by \p lines keeping its column
+        void move_up(size_t lines = 1, size_t tab_width = 4) {
+            move_vertical(-static_cast<int64_t>(lines), tab_width);
+        }
+
+        /// Moves the cursor down by \p lines keeping its column
+        void move_down(size_t lines = 1, size_t tab_width = 4) {
+            move_vertical(static_cast<int64_t>(lines), tab_width);
+        }
+
+        /**
+         * Returns the column where the character at \p pos is displayed
+         * @param pos the position in the text
+         * @param tab_width the width of a tab character
+         * @return size_t
+         */
+        size_t get_visual_col(size_t pos, size_t tab_width = 4) const;
+
+        /**
+         * Returns the position in the line displayed at the column \p col or the end of the line
+         * @param line the line
+         * @param col the column
+         * @param tab_width the width of a tab character
+         * @return size_t
+         */
+        size_t get_pos_at(size_t line, size_t col, size_t tab_width = 4) const;
+
+        size_t get_top_line() const {
+            return top_line;
+        }
+
+        size_t get_left_col() const {
+            return left_col;
+        }
+
+        /// Scrolls the viewport. When the editor is drawn after the cursor moved or the text changed,
+        /// the viewport is scrolled to the cursor again
+        void set_scroll(size_t line, size_t col) {
+            top_line = line;
+            left_col = col;
+            scroll_cursor = cursor;
+            scroll_revision = revision;
+        }
+
+        /// Returns whether the cursor moved or the text changed since the viewport was last scrolled
+        bool is_cursor_moved() const {
+            return cursor != scroll_cursor || revision != scroll_revision;
+        }
+    };
+
+    struct TextEditorInfo {
+        /// Position of the text editor
+        Position pos = {};
+        /// Size of the text editor
+        Size size = {};
+        /// Whether to show the line numbers
+        bool show_line_numbers = true;
+        /// Width of a tab character
+        size_t tab_width = 4;
+        /// Whether tab key inserts spaces instead of a tab character
+        bool expand_tabs = true;
+
+        /// Text style in normal mode
+        Style text_style = {.bg = COLOR_BLACK, .fg = COLOR_WHITE};
+        /// Style of the line numbers
+        Style gutter_style = {.bg = COLOR_BLACK, .fg = COLOR_GRAY};
+        /// Text style of selected text
+        Style selection_style = {.bg = Color::from_hex(0x3737ac), .fg = COLOR_WHITE};
+        /// Cursor style in normal mode
+        Style cursor_style = {.bg = COLOR_WHITE, .fg = COLOR_BLACK};
+        /// Cursor style in insert mode
+        Style cursor_style_ins = {.bg = Color::from_hex(0xe63f32), .fg = COLOR_WHITE};
+        /// Cursor style in selection mode
+        Style cursor_style_sel = {.bg = Color::from_hex(0x24acf2), .fg = COLOR_WHITE};
+
+        /// Handler triggered when the text is changed
+        HandlerFn<TextEditorInfo> on_change = {};
+    };
+
+    /**
+     * Draws a multi-line text editor. Only the visible lines and columns are drawn.
+     * Supports selection across lines, Ctrl+Z to undo, Ctrl+Y or Ctrl+Shift+Z to redo.
+     *
+     * @param [inout] state the console state to work on
+     * @param [inout] editor_state the state of the editor
+     * @param [in] info the info describing the editor
+     */
+    void TextEditor(State &state, TextEditorState &editor_state, TextEditorInfo info);
+
     enum class CheckBoxValue {
         UNCHECKED,
         CHECKED,
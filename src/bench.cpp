@@ -0,0 +1,456 @@
+// Renders canonical workloads without a terminal and reports the cost of a frame.
+// Every scenario prints one JSON object per line on stdout, so runs can be diffed
+// against a baseline:
+//
+//      nite_bench [--frames N] [--warmup N] [--size WxH] [--sink null|devnull|vt] [--filter NAME] [--check-zero-alloc]
+//
+// With --sink vt the output goes to a VirtualTerminal, which is checked against every
+// frame, so a scenario fails on the first frame the terminal would show differently.
+// The escape sequences per frame are reported then as well.
+// With --check-zero-alloc the exit status is 1 if a scenario marked zero_alloc
+// allocates after the warmup. The bench links nite built with NITE_TRACK_ALLOCATIONS,
+// so the allocations are also reported per phase of the frame.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <format>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "nite.hpp"
+
+using namespace nite;
+
+// --------------------------------
+//  Scenarios
+// --------------------------------
+
+// Discards the output, every write counts as the single system call a real sink would make
+// unless there is nothing to write
+class NullSink : public OutputSink {
+  public:
+    Result write(std::string_view data, size_t &calls) override {
+        if (!data.empty())
+            calls++;
+        return Result::Ok;
+    }
+};
+
+struct Scenario {
+    std::string_view name;
+    // Whether the frames must not allocate after the warmup
+    bool zero_alloc;
+    // Called once before the warmup, may prepare data and state
+    std::function<void(State &state)> setup;
+    // Renders one frame, feeding the input first
+    std::function<void(State &state, ScriptedInput &input, size_t frame)> frame;
+};
+
+static void drain_events(State &state) {
+    Event event;
+    while (PollEvent(state, event))
+        ;
+}
+
+static std::vector<Scenario> make_scenarios() {
+    std::vector<Scenario> scenarios;
+
+    // Every cell changes its character and colors in every frame
+    scenarios.push_back({
+            .name = "full_repaint",
+            .zero_alloc = true,
+            .setup = {},
+            .frame =
+                    [](State &state, ScriptedInput &, size_t frame) {
+                        drain_events(state);
+                        BeginDrawing(state);
+                        const Size size = GetBufferSize(state);
+                        const Style style = {.bg = Color::from_rgb(frame % 256, 32, 64), .fg = Color::from_rgb(255, 255 - frame % 256, 255)};
+                        for (size_t row = 0; row < size.height; row++)
+                            for (size_t col = 0; col < size.width; col++)
+                                SetCell(state, static_cast<wchar_t>('A' + (col + row + frame) % 26), {.col = col, .row = row}, style);
+                        EndDrawing(state);
+                    },
+    });
+
+    // A static screen where only a few cells change
+    scenarios.push_back({
+            .name = "sparse_updates",
+            .zero_alloc = true,
+            .setup = {},
+            .frame =
+                    [](State &state, ScriptedInput &, size_t frame) {
+                        static constexpr std::string_view LINE = "The quick brown fox jumps over the lazy dog. ";
+                        static constexpr std::string_view SPINNER = "|/-\\";
+
+                        drain_events(state);
+                        BeginDrawing(state);
+                        const Size size = GetBufferSize(state);
+                        for (size_t row = 1; row < size.height; row++)
+                            for (size_t col = 0; col < size.width; col++)
+                                SetCell(state, LINE[(col + row) % LINE.size()], {.col = col, .row = row});
+                        for (size_t i = 0; i < 8; i++)
+                            SetCell(state, SPINNER[(frame + i) % SPINNER.size()], {.col = i * 2, .row = 0});
+                        EndDrawing(state);
+                    },
+    });
+
+    // A log which gains a line in every frame and shows the most recent lines.
+    // TextView borrows the lines, so the frames do not copy them
+    scenarios.push_back({
+            .name = "scrolling_log",
+            .zero_alloc = true,
+            .setup = {},
+            .frame =
+                    [](State &state, ScriptedInput &, size_t frame) {
+                        static const std::vector<std::string> lines = []() {
+                            std::vector<std::string> lines;
+                            for (size_t i = 0; i < 1024; i++)
+                                lines.push_back(std::format("[{:06}] worker-{} processed request {:#x} in {} us", i, i % 7, i * 2654435761u, i % 997));
+                            return lines;
+                        }();
+
+                        drain_events(state);
+                        BeginDrawing(state);
+                        const Size size = GetBufferSize(state);
+                        for (size_t row = 0; row < size.height; row++)
+                            TextView(state, {.text = lines[(frame + row) % lines.size()], .pos = {.col = 0, .row = row}});
+                        EndDrawing(state);
+                    },
+    });
+
+    // The scrolling log with wide glyphs, combining marks and emoji clusters in every line
+    scenarios.push_back({
+            .name = "wide_text_log",
+            .zero_alloc = true,
+            .setup = {},
+            .frame =
+                    [](State &state, ScriptedInput &, size_t frame) {
+                        static const std::vector<std::string> lines = []() {
+                            static constexpr const char *WORDS[] = {"処理", "完了", "e\u0301tat", "na\u0303o", "\U0001F468\u200D\U0001F4BB", "ok", "요청", "✓"};
+                            std::vector<std::string> lines;
+                            for (size_t i = 0; i < 1024; i++) {
+                                std::string line = std::format("[{:06}]", i);
+                                for (size_t j = 0; j < 12; j++)
+                                    line += std::format(" {}", WORDS[(i + j * 3) % std::size(WORDS)]);
+                                lines.push_back(line);
+                            }
+                            return lines;
+                        }();
+
+                        drain_events(state);
+                        BeginDrawing(state);
+                        const Size size = GetBufferSize(state);
+                        for (size_t row = 0; row < size.height; row++)
+                            TextView(state, {.text = lines[(frame + row) % lines.size()], .pos = {.col = 0, .row = row}});
+                        EndDrawing(state);
+                    },
+    });
+
+    // A long word wrapped help screen that does not change and a status message that changes every frame
+    scenarios.push_back({
+            .name = "help_screen",
+            .zero_alloc = true,
+            .setup = {},
+            .frame =
+                    [](State &state, ScriptedInput &, size_t frame) {
+                        static const std::string help = []() {
+                            std::string help;
+                            for (size_t i = 0; i < 64; i++)
+                                help += std::format("Command {} moves the cursor to the {} match of the pattern and keeps the selection "
+                                                    "anchored where it was, so that pressing it again extends the selection.\n",
+                                                    i, i % 2 ? "next" : "previous");
+                            return help;
+                        }();
+                        static std::string status;
+
+                        drain_events(state);
+                        BeginDrawing(state);
+                        const Size size = GetBufferSize(state);
+                        TextBoxView(state, {.text = help, .pos = {.col = 0, .row = 0}, .size = {.width = size.width, .height = size.height - 2}});
+                        status.clear();
+                        std::format_to(std::back_inserter(status), "Frame {} of the help screen, the status line is rewritten every frame and wrapped "
+                                                                   "to the width of the terminal like the help text above it",
+                                       frame);
+                        TextBoxView(state, {.text = status, .pos = {.col = 0, .row = size.height - 2}, .size = {.width = size.width, .height = 2}});
+                        EndDrawing(state);
+                    },
+    });
+
+    // A moving true color gradient, every cell gets a different background
+    scenarios.push_back({
+            .name = "image_blit",
+            .zero_alloc = true,
+            .setup = {},
+            .frame =
+                    [](State &state, ScriptedInput &, size_t frame) {
+                        drain_events(state);
+                        BeginDrawing(state);
+                        const Size size = GetBufferSize(state);
+                        for (size_t row = 0; row < size.height; row++)
+                            for (size_t col = 0; col < size.width; col++) {
+                                const Color color = Color::from_rgb((col * 4 + frame) % 256, (row * 8) % 256, (col + row + frame * 2) % 256);
+                                SetCell(state, ' ', {.col = col, .row = row}, {.bg = color});
+                            }
+                        EndDrawing(state);
+                    },
+    });
+
+    // A table with 10k rows, laid out in every frame.
+    // SimpleTableView borrows the data, so the frames do not copy it
+    scenarios.push_back({
+            .name = "simple_table_10k",
+            .zero_alloc = true,
+            .setup = {},
+            .frame =
+                    [](State &state, ScriptedInput &, size_t) {
+                        static constexpr size_t NUM_ROWS = 10000;
+                        static const std::vector<std::string> data = []() {
+                            std::vector<std::string> data = {"ID", "Name", "Status", "Latency"};
+                            for (size_t i = 0; i < NUM_ROWS; i++) {
+                                data.push_back(std::to_string(i));
+                                data.push_back(std::format("service-{}", i % 113));
+                                data.push_back(i % 5 == 0 ? "degraded" : "ok");
+                                data.push_back(std::format("{} ms", i % 250));
+                            }
+                            return data;
+                        }();
+
+                        drain_events(state);
+                        BeginDrawing(state);
+                        SimpleTableView(state, {.data = data, .num_cols = 4, .num_rows = NUM_ROWS + 1});
+                        EndDrawing(state);
+                    },
+    });
+
+    // Typing into a text editor, with a new line every 40 characters.
+    // The document and its undo history grow, so the frames allocate now and then
+    scenarios.push_back({
+            .name = "text_editor_typing",
+            .zero_alloc = false,
+            .setup = {},
+            .frame =
+                    [](State &state, ScriptedInput &input, size_t frame) {
+                        static constexpr std::string_view TEXT = "lorem ipsum dolor sit amet consectetur ";
+                        static TextEditorState editor;
+
+                        input.push(frame % 40 == 39 ? std::string_view("\r") : TEXT.substr(frame % TEXT.size(), 1));
+                        drain_events(state);
+                        BeginDrawing(state);
+                        TextEditor(state, editor, {.pos = {}, .size = GetBufferSize(state)});
+                        EndDrawing(state);
+                    },
+    });
+
+    // Typing into a wrapping text input, erased after every 32 characters so its text stays bounded
+    scenarios.push_back({
+            .name = "text_input_editing",
+            .zero_alloc = true,
+            .setup = {},
+            .frame =
+                    [](State &state, ScriptedInput &input, size_t frame) {
+                        static constexpr std::string_view TEXT = "the quick brown fox jumps over the lazy dog ";
+                        static TextInputState text_input;
+                        text_input.set_focus(true);
+
+                        if (frame % 40 < 32)
+                            input.push(TEXT.substr(frame % TEXT.size(), 1));
+                        else
+                            input.push("\x7f\x7f\x7f\x7f");
+                        drain_events(state);
+                        BeginDrawing(state);
+                        TextInput(state, text_input, {.pos = {}, .size = {.width = 20, .height = 2}});
+                        EndDrawing(state);
+                    },
+    });
+
+    // Hundreds of mouse motion reports arriving between two frames
+    const auto mouse_storm = [](State &state, ScriptedInput &input, size_t frame) {
+        static std::string reports;
+        reports.clear();
+        for (size_t i = 0; i < 256; i++)
+            reports += std::format("\x1b[<35;{};{}M", (frame + i) % 200 + 1, i % 50 + 1);
+        input.push(reports);
+
+        drain_events(state);
+        BeginDrawing(state);
+        Text(state, {.text = "mouse storm", .pos = {}});
+        EndDrawing(state);
+    };
+    scenarios.push_back({.name = "mouse_storm", .zero_alloc = true, .setup = {}, .frame = mouse_storm});
+    scenarios.push_back({
+            .name = "mouse_storm_coalesced",
+            .zero_alloc = true,
+            .setup = [](State &state) { SetEventCoalescing(state, true); },
+            .frame = mouse_storm,
+    });
+
+    return scenarios;
+}
+
+// --------------------------------
+//  Runner
+// --------------------------------
+
+struct Options {
+    size_t frames = 500;
+    size_t warmup = 100;
+    Size size = {.width = 200, .height = 50};
+    std::string sink = "null";
+    std::string filter = "";
+    bool check_zero_alloc = false;
+};
+
+static Result run_scenario(const Scenario &scenario, const Options &options, size_t &allocations) {
+    State &state = GetState();
+    std::shared_ptr<OutputSink> sink;
+    std::shared_ptr<VirtualTerminal> terminal;
+    if (options.sink == "vt") {
+        terminal = std::make_shared<VirtualTerminal>(options.size);
+        sink = terminal;
+    } else if (options.sink == "devnull") {
+        auto file_sink = std::make_shared<FileSink>("/dev/null");
+        if (!file_sink->is_open())
+            return Result::Error("error opening /dev/null");
+        sink = file_sink;
+    } else
+        sink = std::make_shared<NullSink>();
+    const auto input = std::make_shared<ScriptedInput>();
+
+    if (auto result = Initialize(state, {.sink = sink, .input = input, .size = options.size}); !result)
+        return result;
+    // Never sleep between the frames
+    SetTargetFPS(state, 1e9);
+    SetEventCoalescing(state, false);
+    if (scenario.setup)
+        scenario.setup(state);
+
+    const auto verify = [&](const size_t frame) {
+        Position mismatch;
+        if (!terminal || terminal->matches(state, &mismatch))
+            return Result::Ok;
+        return Result::Error(std::format("frame {} differs from the virtual terminal at ({}, {})", frame, mismatch.col, mismatch.row));
+    };
+
+    for (size_t frame = 0; frame < options.warmup; frame++) {
+        scenario.frame(state, *input, frame);
+        if (auto result = verify(frame); !result) {
+            Cleanup();
+            return result;
+        }
+    }
+    if (terminal)
+        terminal->reset_stats();
+
+    std::vector<double> frame_ns;
+    frame_ns.reserve(options.frames);
+    size_t bytes = 0, syscalls = 0, cells_emitted = 0, events = 0;
+    size_t event_allocations = 0, draw_allocations = 0, present_allocations = 0;
+
+    const size_t allocations_before = GetAllocationCount();
+    for (size_t frame = options.warmup; frame < options.warmup + options.frames; frame++) {
+        const auto start = std::chrono::steady_clock::now();
+        scenario.frame(state, *input, frame);
+        frame_ns.push_back(std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count());
+
+        const FrameStats stats = GetFrameStats(state);
+        bytes += stats.bytes_written;
+        syscalls += stats.write_calls;
+        cells_emitted += stats.cells_emitted;
+        events += stats.events_processed;
+        event_allocations += stats.event_allocations;
+        draw_allocations += stats.draw_allocations;
+        present_allocations += stats.present_allocations;
+        if (auto result = verify(frame); !result) {
+            Cleanup();
+            return result;
+        }
+    }
+    allocations = GetAllocationCount() - allocations_before;
+    if (auto result = Cleanup(); !result)
+        return result;
+
+    double total_ns = 0;
+    for (const double ns : frame_ns)
+        total_ns += ns;
+    std::sort(frame_ns.begin(), frame_ns.end());
+    const auto percentile = [&](double p) { return frame_ns[std::min(frame_ns.size() - 1, static_cast<size_t>(p / 100 * frame_ns.size()))]; };
+
+    const double frames = static_cast<double>(options.frames);
+    std::string extra = std::format(
+            ",\"event_allocs_per_frame\":{:.2f},\"draw_allocs_per_frame\":{:.2f},\"present_allocs_per_frame\":{:.2f}", event_allocations / frames,
+            draw_allocations / frames, present_allocations / frames
+    );
+    if (terminal)
+        extra += std::format(",\"sequences_per_frame\":{:.1f}", terminal->get_stats().sequences / frames);
+    std::cout << std::format(
+            "{{\"scenario\":\"{}\",\"build\":\"{}\",\"sink\":\"{}\",\"width\":{},\"height\":{},\"frames\":{},"
+            "\"ns_per_frame\":{:.0f},\"p50_ns\":{:.0f},\"p99_ns\":{:.0f},\"bytes_per_frame\":{:.1f},\"syscalls_per_frame\":{:.2f},"
+            "\"allocs_per_frame\":{:.2f},\"cells_emitted_per_frame\":{:.1f},\"events_per_frame\":{:.1f}{}}}",
+            scenario.name, NITE_BENCH_BUILD_TYPE, options.sink, options.size.width, options.size.height, options.frames, total_ns / frames,
+            percentile(50), percentile(99), bytes / frames, syscalls / frames, allocations / frames, cells_emitted / frames, events / frames, extra
+    ) << std::endl;
+    return Result::Ok;
+}
+
+static bool parse_options(int argc, char **argv, Options &options) {
+    for (int i = 1; i < argc; i++) {
+        const std::string_view arg = argv[i];
+        if (arg == "--check-zero-alloc") {
+            options.check_zero_alloc = true;
+            continue;
+        }
+        if (i + 1 >= argc)
+            return false;
+        const char *value = argv[++i];
+
+        if (arg == "--frames")
+            options.frames = std::max<size_t>(std::strtoull(value, nullptr, 10), 1);
+        else if (arg == "--warmup")
+            options.warmup = std::strtoull(value, nullptr, 10);
+        else if (arg == "--size") {
+            if (std::sscanf(value, "%zux%zu", &options.size.width, &options.size.height) != 2)
+                return false;
+        } else if (arg == "--sink") {
+            options.sink = value;
+            if (options.sink != "null" && options.sink != "devnull" && options.sink != "vt")
+                return false;
+        } else if (arg == "--filter")
+            options.filter = value;
+        else
+            return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        std::cerr << "usage: nite_bench [--frames N] [--warmup N] [--size WxH] [--sink null|devnull|vt] [--filter NAME] [--check-zero-alloc]" << std::endl;
+        return 2;
+    }
+
+    bool allocated = false;
+    for (const Scenario &scenario : make_scenarios()) {
+        if (!options.filter.empty() && scenario.name.find(options.filter) == std::string_view::npos)
+            continue;
+        size_t allocations = 0;
+        if (const auto result = run_scenario(scenario, options, allocations); !result) {
+            std::cerr << scenario.name << ": " << result.what() << std::endl;
+            return 1;
+        }
+        if (options.check_zero_alloc && scenario.zero_alloc && allocations != 0) {
+            std::cerr << scenario.name << ": " << allocations << " allocations after the warmup" << std::endl;
+            allocated = true;
+        }
+    }
+    return allocated ? 1 : 0;
+}
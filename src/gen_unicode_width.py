@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+# Generates unicode_width.hpp, the display width table of nite
+#
+# The widths follow the Unicode Character Database of the running Python:
+#   0 for the combining marks, the format characters and the Hangul medial vowels and final consonants
+#   2 for the wide and fullwidth characters of East Asian Width, including the unassigned CJK ideographs
+#   1 for everything else
+#
+# Usage: python3 src/gen_unicode_width.py > src/unicode_width.hpp
+
+import unicodedata
+
+MAX_CODE_POINT = 0x10FFFF
+BLOCK_SIZE = 256
+
+# Format characters which are visible
+VISIBLE_FORMAT = {0x00AD, 0x0600, 0x0601, 0x0602, 0x0603, 0x0604, 0x0605, 0x06DD, 0x070F, 0x0890, 0x0891, 0x08E2, 0x110BD, 0x110CD}
+
+# Ranges which are wide even if unassigned, see EastAsianWidth.txt
+WIDE_RANGES = [(0x3400, 0x4DBF), (0x4E00, 0x9FFF), (0xF900, 0xFAFF), (0x20000, 0x2FFFD), (0x30000, 0x3FFFD)]
+
+
+def width(cp):
+    category = unicodedata.category(chr(cp))
+    if category in ('Mn', 'Me') or (category == 'Cf' and cp not in VISIBLE_FORMAT):
+        return 0
+    if 0x1160 <= cp <= 0x11FF or 0xD7B0 <= cp <= 0xD7FF:
+        return 0
+    if unicodedata.east_asian_width(chr(cp)) in ('W', 'F'):
+        return 2
+    if any(first <= cp <= last for first, last in WIDE_RANGES):
+        return 2
+    return 1
+
+
+def main():
+    # Every block packs the widths of 256 code points in 2 bits each
+    blocks = []
+    block_index = {}
+    stage1 = []
+    for start in range(0, MAX_CODE_POINT + 1, BLOCK_SIZE):
+        packed = [0] * (BLOCK_SIZE // 4)
+        for cp in range(start, start + BLOCK_SIZE):
+            packed[(cp - start) // 4] |= width(cp) << ((cp % 4) * 2)
+        packed = tuple(packed)
+        if packed not in block_index:
+            block_index[packed] = len(blocks)
+            blocks.append(packed)
+        stage1.append(block_index[packed])
+    assert len(blocks) <= 256
+
+    print('// Generated by gen_unicode_width.py from the Unicode Character Database {}, do not edit'.format(unicodedata.unidata_version))
+    print('#pragma once')
+    print()
+    print('#include <cstddef>')
+    print('#include <cstdint>')
+    print()
+    print('namespace nite::internal::unicode')
+    print('{')
+    print('    // Index of the width block of every 256 code points')
+    print('    inline constexpr uint8_t WIDTH_STAGE1[{}] = {{'.format(len(stage1)))
+    for i in range(0, len(stage1), 32):
+        print('        ' + ', '.join(str(index) for index in stage1[i:i + 32]) + ',')
+    print('    };')
+    print()
+    print('    // Widths of the code points of a block, 2 bits each')
+    print('    inline constexpr uint8_t WIDTH_STAGE2[{}][{}] = {{'.format(len(blocks), BLOCK_SIZE // 4))
+    for block in blocks:
+        print('        {' + ', '.join('0x{:02x}'.format(byte) for byte in block) + '},')
+    print('    };')
+    print()
+    print('    /// Returns the number of columns the code point takes on the terminal, 0 for the ones joining the character before')
+    print('    constexpr size_t char_width(const char32_t cp) {')
+    print('        // Nothing below the combining diacritical marks is zero width or wide')
+    print('        if (cp < 0x300)')
+    print('            return 1;')
+    print('        if (cp > 0x{:X})'.format(MAX_CODE_POINT))
+    print('            return 1;')
+    print('        return (WIDTH_STAGE2[WIDTH_STAGE1[cp >> 8]][(cp & 0xFF) >> 2] >> ((cp & 3) * 2)) & 3;')
+    print('    }')
+    print('}    // namespace nite::internal::unicode')
+
+
+if __name__ == '__main__':
+    main()
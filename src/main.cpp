@@ -252,7 +252,6 @@ void grid_test(State &state) {
 }
 
 void event_test(State &state) {
-    static Position scroll_pivot;
     static std::vector<std::string> lines;
 
     Event event;
@@ -262,6 +261,8 @@ void event_test(State &state) {
                 if (ev.key_down) {
                     if (ev.key_code == KeyCode::K_C && ev.modifiers == 0)
                         lines.clear();
+                    if (ev.key_code == KeyCode::K_M && ev.modifiers == 0)
+                        SetEventCoalescing(state, !IsEventCoalescing(state));
                     if (ev.key_code == KeyCode::ESCAPE && ev.modifiers == 0)
                         CloseWindow(state);
                 }
@@ -303,21 +304,24 @@ void event_test(State &state) {
                     lines.push_back(std::format("MouseEvent ({}, {}) -> mouse moved", ev.pos.col, ev.pos.row));
                     break;
                 case MouseEventKind::SCROLL_DOWN:
-                    lines.push_back(std::format("MouseEvent ({}, {}) -> mouse scrolled down", ev.pos.col, ev.pos.row));
+                    lines.push_back(std::format("MouseEvent ({}, {}) -> mouse scrolled down x{}", ev.pos.col, ev.pos.row, ev.count));
                     break;
                 case MouseEventKind::SCROLL_UP:
-                    lines.push_back(std::format("MouseEvent ({}, {}) -> mouse scrolled up", ev.pos.col, ev.pos.row));
+                    lines.push_back(std::format("MouseEvent ({}, {}) -> mouse scrolled up x{}", ev.pos.col, ev.pos.row, ev.count));
                     break;
                 case MouseEventKind::SCROLL_LEFT:
-                    lines.push_back(std::format("MouseEvent ({}, {}) -> mouse scrolled left", ev.pos.col, ev.pos.row));
+                    lines.push_back(std::format("MouseEvent ({}, {}) -> mouse scrolled left x{}", ev.pos.col, ev.pos.row, ev.count));
                     break;
                 case MouseEventKind::SCROLL_RIGHT:
-                    lines.push_back(std::format("MouseEvent ({}, {}) -> mouse scrolled right", ev.pos.col, ev.pos.row));
+                    lines.push_back(std::format("MouseEvent ({}, {}) -> mouse scrolled right x{}", ev.pos.col, ev.pos.row, ev.count));
                     break;
                 }
             },
             [&](const DebugEvent &ev) {
                 lines.push_back(quoted_str(ev.text));
+            },
+            [&](const PasteEvent &ev) {
+                lines.push_back(std::format("PasteEvent -> {} bytes pasted", ev.text.size()));
             }
         );
     }
@@ -328,7 +332,7 @@ void event_test(State &state) {
 
     const auto size = GetBufferSize(state);
     
-    BeginScrollPane(state, scroll_pivot, {
+    BeginScrollPane(state, GetID(state, "events"), {
         .pos = {.col = 0,.row = 1},
         .min_size = {.width = size.width, .height = size.height - 1},
         .max_size = size * 2,
@@ -737,6 +741,121 @@ void text_field_test(State &state) {
     EndDrawing(state);
 }
 
+void editor_test(State &state) {
+    static TextEditorState editor_state;
+
+    Event event;
+    while (PollEvent(state, event)) {
+        HandleEvent(event, [&] (const KeyEvent &ev) {
+            if (!ev.key_down) return;
+            if (ev.modifiers == 0 && ev.key_code == KeyCode::F4)
+                CloseWindow(state);
+        });
+    }
+
+    BeginDrawing(state);
+
+    TextEditor(state, editor_state, {
+        .pos = {.col = 0, .row = 0},
+        .size = GetPaneSize(state) - Size{.width = 0, .height = 1},
+    });
+    Text(state, {
+        .text = std::format("Ln {}, Lines {}, Undo {}, Redo {}",
+            editor_state.get_line_of(editor_state.get_cursor()) + 1, editor_state.get_line_count(),
+            editor_state.can_undo(), editor_state.can_redo()),
+        .pos = {.col = 0, .row = GetPaneSize(state).height - 1},
+    });
+
+    EndDrawing(state);
+}
+
+void data_grid_test(State &state) {
+    static GridColumns data {"Id", "Name", "Email", "Score"};
+    static DataGridState grid_state;
+
+    Event event;
+    while (PollEvent(state, event)) {
+        HandleEvent(event, [&] (const KeyEvent &ev) {
+            if (!ev.key_down) return;
+            if (ev.modifiers == 0 && ev.key_code == KeyCode::F4)
+                CloseWindow(state);
+        });
+    }
+
+    // Stream some rows every frame
+    for (size_t i = 0; i < 1000 && data.num_rows() < 200000; i++) {
+        const size_t id = data.num_rows();
+        data.append_row({
+            std::to_string(id),
+            std::format("user{}", id),
+            std::format("user{}@example.com", id),
+            std::to_string(id * 7919 % 1000),
+        });
+    }
+
+    BeginDrawing(state);
+
+    DataGrid(state, grid_state, data, {
+        .pos = {.col = 0, .row = 0},
+        .size = GetPaneSize(state) - Size{.width = 0, .height = 1},
+        .header_style = Style{.bg = COLOR_TEAL, .fg = COLOR_WHITE, .mode = STYLE_BOLD},
+        .table_style = Style{.bg = COLOR_NAVY, .fg = COLOR_SILVER},
+        .focus = true,
+    });
+    Text(state, {
+        .text = std::format("Rows: {}, first visible: {}", data.num_rows(), grid_state.get_row_offset()),
+        .pos = {.col = 0, .row = GetPaneSize(state).height - 1},
+    });
+
+    EndDrawing(state);
+}
+
+void data_view_test(State &state) {
+    static DataView view;
+    static DataGridState grid_state;
+    static size_t sort_col = 0;
+    static SortOrder order = SortOrder::NONE;
+
+    if (!view.get_source() && !view.is_busy()) {
+        auto data = std::make_shared<GridColumns>(std::initializer_list<std::string>{"Id", "Name", "Score"});
+        data->reserve(1000000);
+        for (size_t id = 0; id < 1000000; id++)
+            data->append_row({std::to_string(id), std::format("user{}", id * 7919 % 1000003), std::to_string(id * 31 % 1000)});
+        view.set_source(data);
+    }
+
+    Event event;
+    while (PollEvent(state, event)) {
+        HandleEvent(event, [&] (const KeyEvent &ev) {
+            if (!ev.key_down) return;
+            if (ev.modifiers == 0 && ev.key_code == KeyCode::F4)
+                CloseWindow(state);
+            // F2 cycles the sort column, F3 cycles the sort order
+            if (ev.modifiers == 0 && (ev.key_code == KeyCode::F2 || ev.key_code == KeyCode::F3)) {
+                if (ev.key_code == KeyCode::F2)
+                    sort_col = (sort_col + 1) % 3;
+                else
+                    order = static_cast<SortOrder>((static_cast<int>(order) + 1) % 3);
+                view.submit({.sort_col = sort_col, .order = order});
+            }
+        });
+    }
+
+    BeginDrawing(state);
+
+    DataGrid(state, grid_state, view, {
+        .pos = {.col = 0, .row = 0},
+        .size = GetPaneSize(state) - Size{.width = 0, .height = 1},
+        .focus = true,
+    });
+    Text(state, {
+        .text = std::format("Sort column: {}, order: {}", sort_col, static_cast<int>(order)),
+        .pos = {.col = 0, .row = GetPaneSize(state).height - 1},
+    });
+
+    EndDrawing(state);
+}
+
 int main() {
     auto &state = GetState();
     Initialize(state);
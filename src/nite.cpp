@@ -1,25 +1,41 @@
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <bitset>
+#include <charconv>
 #include <cassert>
 #include <chrono>
+#include <climits>
+#include <clocale>
 #include <cmath>
+#include <condition_variable>
 #include <cstddef>
 #include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <ctime>
 #include <cwchar>
 #include <format>
+#include <fstream>
+#include <iterator>
 #include <limits>
 #include <memory>
+#include <mutex>
+#include <new>
 #include <optional>
 #include <queue>
+#include <span>
 #include <string>
 #include <thread>
+#include <type_traits>
+#include <typeinfo>
 #include <unordered_map>
 #include <utility>
 #include <vector>
-#include <cwchar>
 
 #include "nite.hpp"
+#include "unicode_width.hpp"
 
 #if defined(_WIN32) || defined(_WIN64) || defined(__WIN32__) || defined(__TOS_WIN__) || defined(__WINDOWS__)
 #    define OS_WINDOWS
@@ -31,8 +47,6 @@
 
 #ifdef OS_LINUX
 #    include <cerrno>
-#    include <charconv>
-#    include <clocale>
 #    include <concepts>
 #    include <csignal>
 #    include <cstring>
@@ -43,134 +57,296 @@
 
 #define NITE_DEFAULT_LOCALE "en_US.UTF-8"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#    define NITE_HAS_SSE2
+#    include <emmintrin.h>
+#endif
+
+#ifdef NITE_TRACK_ALLOCATIONS
+// Replacements of the global allocation functions that count the allocations of the process
+static std::atomic<size_t> allocation_count = 0;
+
+void *operator new(std::size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    if (void *ptr = std::malloc(size == 0 ? 1 : size))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &tag) noexcept {
+    return operator new(size, tag);
+}
+
+void operator delete(void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t &) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept {
+    std::free(ptr);
+}
+#endif
+
 #define $(expr)                                                                                                                                      \
     if (const auto result = (expr); !result)                                                                                                         \
     return result
 
-namespace nite
+namespace nite::internal::utf8
 {
-    std::string wc_to_str(const wchar_t wc) {
-        // Create conversion state
-        mbstate_t state = {};
-        // Create buffer
-        std::vector<char> buf(MB_CUR_MAX);
+    // Largest number of bytes in the encoding of a character
+    static constexpr size_t MAX_SIZE = 4;
+    // Character that replaces the invalid sequences and the characters that cannot be encoded
+    static constexpr char32_t REPLACEMENT = 0xFFFD;
 
-#ifdef OS_WINDOWS
-        // Convert
-        size_t len;
-        wcrtomb_s(&len, &buf[0], sizeof(buf), wc, &state);
-        if (len == static_cast<size_t>(-1))
-            return "";
-        return std::string(&buf[0], len);
+    static constexpr bool is_valid(const char32_t cp) {
+        return cp <= 0x10FFFF && (cp < 0xD800 || cp > 0xDFFF);
+    }
+
+    // Encodes cp into out, which has room for MAX_SIZE bytes.
+    // Returns the number of bytes written
+    static size_t encode(char *out, char32_t cp) {
+        if (cp < 0x80) {
+            out[0] = static_cast<char>(cp);
+            return 1;
+        }
+        if (!is_valid(cp))
+            cp = REPLACEMENT;
+        if (cp < 0x800) {
+            out[0] = static_cast<char>(0xC0 | (cp >> 6));
+            out[1] = static_cast<char>(0x80 | (cp & 0x3F));
+            return 2;
+        }
+        if (cp < 0x10000) {
+            out[0] = static_cast<char>(0xE0 | (cp >> 12));
+            out[1] = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out[2] = static_cast<char>(0x80 | (cp & 0x3F));
+            return 3;
+        }
+        out[0] = static_cast<char>(0xF0 | (cp >> 18));
+        out[1] = static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        out[2] = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out[3] = static_cast<char>(0x80 | (cp & 0x3F));
+        return 4;
+    }
+
+    // Appends the encoding of wc to out, a lone surrogate is encoded as REPLACEMENT
+    static void append(std::string &out, const wchar_t wc) {
+        const char32_t cp = static_cast<char32_t>(wc);
+        if (cp < 0x80) {
+            out.push_back(static_cast<char>(cp));
+            return;
+        }
+        char buf[MAX_SIZE];
+        out.append(buf, encode(buf, cp));
+    }
+
+    // Decodes the character of text at index into cp, returns the number of bytes consumed.
+    // An invalid, overlong or truncated sequence is decoded as REPLACEMENT and consumes 1 byte
+    static size_t decode(const std::string_view text, const size_t index, char32_t &cp) {
+        const auto byte_at = [&](const size_t i) { return static_cast<unsigned char>(text[index + i]); };
+        const unsigned char first = byte_at(0);
+        if (first < 0x80) {
+            cp = first;
+            return 1;
+        }
+
+        size_t size;
+        char32_t min;
+        if ((first & 0xE0) == 0xC0) {
+            size = 2;
+            min = 0x80;
+            cp = first & 0x1F;
+        } else if ((first & 0xF0) == 0xE0) {
+            size = 3;
+            min = 0x800;
+            cp = first & 0x0F;
+        } else if ((first & 0xF8) == 0xF0) {
+            size = 4;
+            min = 0x10000;
+            cp = first & 0x07;
+        } else {
+            cp = REPLACEMENT;
+            return 1;
+        }
+        if (text.size() - index < size) {
+            cp = REPLACEMENT;
+            return 1;
+        }
+        for (size_t i = 1; i < size; i++) {
+            if ((byte_at(i) & 0xC0) != 0x80) {
+                cp = REPLACEMENT;
+                return 1;
+            }
+            cp = (cp << 6) | (byte_at(i) & 0x3F);
+        }
+        if (cp < min || !is_valid(cp)) {
+            cp = REPLACEMENT;
+            return 1;
+        }
+        return size;
+    }
+
+    // Converts cp to a single wide character, which cannot hold the characters
+    // outside of the basic multilingual plane where wchar_t is 16 bits wide
+    static wchar_t to_wchar(const char32_t cp) {
+        if constexpr (sizeof(wchar_t) < sizeof(char32_t))
+            if (cp > 0xFFFF)
+                return static_cast<wchar_t>(REPLACEMENT);
+        return static_cast<wchar_t>(cp);
+    }
+
+    // Returns the number of ASCII bytes at the start of text
+    static size_t ascii_run(const std::string_view text) {
+        const char *data = text.data();
+        const size_t size = text.size();
+        size_t i = 0;
+#ifdef NITE_HAS_SSE2
+        for (; i + 16 <= size; i += 16) {
+            // The high bit of every byte is set for the non ASCII bytes only
+            const unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i))));
+            if (mask != 0)
+                return i + std::countr_zero(mask);
+        }
 #else
-        // Convert
-        const size_t len = wcrtomb(&buf[0], wc, &state);
-        if (len == static_cast<size_t>(-1))
-            return "";
-        return std::string(&buf[0], len);
+        for (; i + 8 <= size; i += 8) {
+            uint64_t word;
+            std::memcpy(&word, data + i, sizeof(word));
+            if (word & 0x8080808080808080ULL)
+                break;
+        }
 #endif
+        while (i < size && static_cast<unsigned char>(data[i]) < 0x80)
+            i++;
+        return i;
+    }
+}    // namespace nite::internal::utf8
+
+namespace nite::internal::unicode
+{
+    static constexpr wchar_t ZERO_WIDTH_JOINER = 0x200D;
+
+    static size_t char_width(const wchar_t wc) {
+        return char_width(static_cast<char32_t>(wc));
+    }
+
+    // Checks whether value joins the grapheme cluster ending with last instead of starting a glyph.
+    // The zero width characters join any cluster, the wide ones join a cluster ending with a zero width joiner
+    static bool joins_cluster(const wchar_t last, const wchar_t value) {
+        const size_t width = char_width(value);
+        return width == 0 || (width == 2 && last == ZERO_WIDTH_JOINER);
     }
+}    // namespace nite::internal::unicode
 
-    // Convert a multibyte (narrow) string to a single wide character.
+namespace nite::internal
+{
+    // Switches LC_CTYPE to UTF-8 for the wide character functions of the application.
+    // The library converts the text itself, so a host without a UTF-8 locale is not an error
+    static void set_utf8_locale(std::string &old_locale) {
+        const char *locale = std::setlocale(LC_CTYPE, NULL);
+        old_locale = locale ? locale : "";
+        if (std::setlocale(LC_CTYPE, NITE_DEFAULT_LOCALE) == NULL)
+            std::setlocale(LC_CTYPE, "C.UTF-8");
+    }
+
+    static void restore_locale(const std::string &old_locale) {
+        if (!old_locale.empty())
+            std::setlocale(LC_CTYPE, old_locale.c_str());
+    }
+}    // namespace nite::internal
+
+namespace nite
+{
+    std::string wc_to_str(const wchar_t wc) {
+        // The result fits in the small string buffer so nothing is allocated
+        char buf[internal::utf8::MAX_SIZE];
+        return std::string(buf, internal::utf8::encode(buf, static_cast<char32_t>(wc)));
+    }
+
+    // Convert a UTF-8 string to a single wide character.
     // Returns L'\0' on empty input or on conversion error.
     wchar_t str_to_wc(const std::string &str) {
         if (str.empty())
             return L'\0';
-
-        mbstate_t state = {};
-        wchar_t wc;
-        // mbrtowc converts the multibyte sequence to a wide char.
-        // Provide str.size() + 1 so the terminating null can be considered.
-        const size_t ret = mbrtowc(&wc, str.c_str(), str.size() + 1, &state);
-        if (ret == static_cast<size_t>(-1) || ret == static_cast<size_t>(-2))
+        char32_t cp;
+        // A valid U+FFFD takes 3 bytes, the replacement of an invalid sequence takes 1
+        if (internal::utf8::decode(str, 0, cp) == 1 && cp == internal::utf8::REPLACEMENT)
             return L'\0';
-        return wc;
+        return internal::utf8::to_wchar(cp);
     }
 
-    // Convert a single narrow char to a wide char using str_to_wc helper.
+    // Convert a single narrow char to a wide char, only ASCII is a character by itself
     wchar_t c_to_wc(const char c) {
-        return str_to_wc(std::string(1, c));
+        return static_cast<unsigned char>(c) < 0x80 ? static_cast<wchar_t>(c) : L'\0';
     }
 
-    // Convert a multibyte std::string to a std::wstring.
-    // Uses the "secure" variants on Windows (mbsrtowcs_s) and the standard
-    // mbsrtowcs on POSIX. Returns empty string on failure.
+    // Convert a UTF-8 std::string to a std::wstring.
+    // Invalid sequences are converted to U+FFFD, where wchar_t is 16 bits wide
+    // the characters outside of the basic multilingual plane become surrogate pairs.
     std::wstring str_to_wstr(const std::string &str) {
-        if (str.empty())
-            return L"";
-        mbstate_t state = {};
-        const char *src = str.c_str();
+        std::wstring result;
+        result.reserve(str.size());
+        std::string_view text = str;
+        while (!text.empty()) {
+            const size_t run = internal::utf8::ascii_run(text);
+            result.append(text.begin(), text.begin() + run);
+            text.remove_prefix(run);
+            if (text.empty())
+                break;
 
-#ifdef OS_WINDOWS
-        // mbsrtowcs_s reports required number of wide chars (including null).
-        size_t required = 0;
-        const char *p = src;
-        if (mbsrtowcs_s(&required, NULL, 0, &p, 0, &state) != 0 || required == 0)
-            return L"";
-
-        std::vector<wchar_t> buf(required);    // includes space for terminating null
-        p = src;
-        size_t converted = 0;
-        if (mbsrtowcs_s(&converted, buf.data(), buf.size(), &p, buf.size(), &state) != 0)
-            return L"";
-
-        // converted includes terminating null, so subtract one for length
-        const size_t len_without_null = converted > 0 ? converted - 1 : 0;
-        return std::wstring(buf.data(), len_without_null);
-#else
-        // POSIX: first get required length (excluding terminating null)
-        const size_t len = mbsrtowcs(NULL, &src, 0, &state);
-        if (len == static_cast<size_t>(-1))
-            return L"";
-
-        std::vector<wchar_t> buf(len + 1);    // +1 for terminating null
-        src = str.c_str();
-        const size_t ret = mbsrtowcs(buf.data(), &src, buf.size(), &state);
-        if (ret == static_cast<size_t>(-1))
-            return L"";
-
-        return std::wstring(buf.data(), ret);
-#endif
+            char32_t cp;
+            text.remove_prefix(internal::utf8::decode(text, 0, cp));
+            if (sizeof(wchar_t) < sizeof(char32_t) && cp > 0xFFFF) {
+                cp -= 0x10000;
+                result.push_back(static_cast<wchar_t>(0xD800 + (cp >> 10)));
+                result.push_back(static_cast<wchar_t>(0xDC00 + (cp & 0x3FF)));
+            } else
+                result.push_back(static_cast<wchar_t>(cp));
+        }
+        return result;
     }
 
-    // Convert a std::wstring to a multibyte std::string.
-    // Uses wcsrtombs_s on Windows and wcsrtombs on POSIX. Returns empty string on failure.
+    // Convert a std::wstring to a UTF-8 std::string.
+    // Surrogate pairs are joined, lone surrogates are converted to U+FFFD.
     std::string wstr_to_str(const std::wstring &str) {
-        if (str.empty())
-            return "";
-        mbstate_t state = {};
-        const wchar_t *src = str.c_str();
-
-#ifdef OS_WINDOWS
-        // wcsrtombs_s reports required number of bytes (including null).
-        size_t required = 0;
-        const wchar_t *p = src;
-        if (wcsrtombs_s(&required, NULL, 0, &p, 0, &state) != 0 || required == 0)
-            return "";
-
-        std::vector<char> buf(required);    // includes space for terminating null
-        p = src;
-        size_t converted = 0;
-        if (wcsrtombs_s(&converted, buf.data(), buf.size(), &p, buf.size(), &state) != 0)
-            return "";
-
-        // converted includes terminating null, so subtract one for length
-        const size_t len_without_null = converted > 0 ? converted - 1 : 0;
-        return std::string(buf.data(), len_without_null);
-#else
-        // POSIX: first get required length (excluding terminating null)
-        const size_t len = wcsrtombs(NULL, &src, 0, &state);
-        if (len == static_cast<size_t>(-1))
-            return "";
-
-        std::vector<char> buf(len + 1);    // +1 for terminating null
-        src = str.c_str();
-        const size_t ret = wcsrtombs(buf.data(), &src, buf.size(), &state);
-        if (ret == static_cast<size_t>(-1))
-            return "";
-
-        return std::string(buf.data(), ret);
-#endif
+        std::string result;
+        result.reserve(str.size());
+        for (size_t i = 0; i < str.size(); i++) {
+            char32_t cp = static_cast<char32_t>(str[i]);
+            if (0xD800 <= cp && cp <= 0xDBFF && i + 1 < str.size()) {
+                const char32_t low = static_cast<char32_t>(str[i + 1]);
+                if (0xDC00 <= low && low <= 0xDFFF) {
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    i++;
+                }
+            }
+            char buf[internal::utf8::MAX_SIZE];
+            result.append(buf, internal::utf8::encode(buf, cp));
+        }
+        return result;
     }
 }    // namespace nite
 
@@ -339,8 +515,23 @@ namespace nite
             virtual bool contains(const size_t col, const size_t row) const = 0;
             virtual bool contains(const Position pos) const = 0;
             virtual bool transform(size_t &col, size_t &row) const = 0;
+            // Clips the rectangle to the visible part of the box and moves it to screen coordinates
+            virtual bool transform_rect(Position &pos, Size &size) const = 0;
         };
 
+        // Clips the rectangle at pos with size to the rectangle at clip_pos with clip_size
+        static bool clip_rect(Position &pos, Size &size, const Position clip_pos, const Size clip_size) {
+            const size_t col_start = std::max(pos.col, clip_pos.col);
+            const size_t row_start = std::max(pos.row, clip_pos.row);
+            const size_t col_end = std::min(saturated_add(pos.col, size.width), saturated_add(clip_pos.col, clip_size.width));
+            const size_t row_end = std::min(saturated_add(pos.row, size.height), saturated_add(clip_pos.row, clip_size.height));
+            if (col_start >= col_end || row_start >= row_end)
+                return false;
+            pos = {.col = col_start, .row = row_start};
+            size = {.width = col_end - col_start, .height = row_end - row_start};
+            return true;
+        }
+
         class NoBox : public Box {
           public:
             NoBox() = default;
@@ -369,6 +560,10 @@ namespace nite
             bool transform(size_t &, size_t &) const {
                 return false;
             }
+
+            bool transform_rect(Position &, Size &) const {
+                return false;
+            }
         };
 
         class StaticBox : public Box {
@@ -413,6 +608,13 @@ namespace nite
                 }
                 return false;
             }
+
+            bool transform_rect(Position &rect_pos, Size &rect_size) const override {
+                if (!clip_rect(rect_pos, rect_size, Position{}, size))
+                    return false;
+                rect_pos += pos;
+                return true;
+            }
         };
 
         class ScrollBox : public Box {
@@ -502,6 +704,13 @@ namespace nite
                 }
                 return false;
             }
+
+            bool transform_rect(Position &rect_pos, Size &rect_size) const override {
+                if (!clip_rect(rect_pos, rect_size, *pivot, min_size))
+                    return false;
+                rect_pos = rect_pos + pos - *pivot;
+                return true;
+            }
         };
 
         class GridBox : public Box {
@@ -523,10 +732,10 @@ namespace nite
             GridBox() = default;
             ~GridBox() = default;
 
-            std::unique_ptr<internal::Box> get_grid_cell(size_t col, size_t row) {
+            std::optional<StaticBox> get_grid_cell(size_t col, size_t row) const {
                 if (col >= num_cols || row >= num_rows)
-                    return std::make_unique<internal::NoBox>();
-                return std::make_unique<internal::StaticBox>(grid[row * num_cols + col]);
+                    return std::nullopt;
+                return grid[row * num_cols + col];
             }
 
             void set_pos(const Position &p) override {
@@ -561,6 +770,261 @@ namespace nite
                 }
                 return false;
             }
+
+            bool transform_rect(Position &rect_pos, Size &rect_size) const override {
+                if (!clip_rect(rect_pos, rect_size, Position{}, size))
+                    return false;
+                rect_pos += pos;
+                return true;
+            }
+        };
+
+        // Bump allocator for the temporaries of a frame, released all at once by reset().
+        // Allocations that do not fit the block get blocks of their own until the next reset(),
+        // which replaces the block with one large enough for the whole frame. A frame that is
+        // not larger than the previous ones therefore only bumps an offset.
+        class FrameArena : public std::pmr::memory_resource {
+            std::unique_ptr<std::byte[]> block;
+            size_t capacity = 0;
+            size_t used = 0;
+            std::vector<std::unique_ptr<std::byte[]>> extra_blocks;
+            size_t extra_size = 0;
+
+          public:
+            size_t get_used() const {
+                return used + extra_size;
+            }
+
+            void reset() {
+                if (!extra_blocks.empty()) {
+                    capacity = std::max(capacity * 2, used + extra_size);
+                    block.reset(new std::byte[capacity]);
+                    extra_blocks.clear();
+                    extra_size = 0;
+                }
+                used = 0;
+            }
+
+          protected:
+            void *do_allocate(const size_t bytes, const size_t alignment) override {
+                void *ptr = block.get() + used;
+                size_t space = capacity - used;
+                if (block && std::align(alignment, bytes, ptr, space)) {
+                    used = capacity - space + bytes;
+                    return ptr;
+                }
+                // Over-allocated so that the start can be aligned
+                const size_t size = bytes + alignment;
+                extra_blocks.emplace_back(new std::byte[size]);
+                extra_size += size;
+                ptr = extra_blocks.back().get();
+                space = size;
+                return std::align(alignment, bytes, ptr, space);
+            }
+
+            void do_deallocate(void *, size_t, size_t) override {}
+
+            bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+                return this == &other;
+            }
+        };
+
+        // Open addressing table of the widget states keyed by widget ID.
+        // Every lookup stamps the entry with the current frame and the entries
+        // that were not looked up in a frame are destroyed when it ends.
+        class WidgetStore {
+            struct Slot {
+                WidgetID id = 0;    // 0 if the slot is empty
+                uint64_t frame = 0;
+                const void *type = nullptr;
+                void *data = nullptr;
+                void (*destroy)(void *) = nullptr;
+            };
+
+            std::vector<Slot> slots;
+            std::vector<Slot> spare;    // Empty table of the same size, the entries are moved into it on rehash
+            size_t count = 0;
+            uint64_t frame = 0;
+
+            // Returns the slot of id or the empty slot where it should be inserted
+            static Slot &probe(std::vector<Slot> &table, const WidgetID id) {
+                const size_t mask = table.size() - 1;
+                for (size_t i = id & mask;; i = (i + 1) & mask)
+                    if (table[i].id == id || table[i].id == 0)
+                        return table[i];
+            }
+
+            // Moves the entries into the spare table, which does not allocate
+            void rehash() {
+                for (Slot &slot: slots)
+                    if (slot.id != 0) {
+                        probe(spare, slot.id) = slot;
+                        slot = Slot{};
+                    }
+                std::swap(slots, spare);
+            }
+
+          public:
+            WidgetStore() = default;
+            WidgetStore(const WidgetStore &) = delete;
+            WidgetStore &operator=(const WidgetStore &) = delete;
+
+            ~WidgetStore() {
+                for (Slot &slot: slots)
+                    if (slot.id != 0)
+                        slot.destroy(slot.data);
+            }
+
+            void *find(const WidgetID id, const void *type, void *(*create)(), void (*destroy)(void *)) {
+                // Keep the load factor at most 1/2
+                if ((count + 1) * 2 > slots.size()) {
+                    const size_t capacity = std::max<size_t>(slots.size() * 2, 16);
+                    spare.resize(capacity);
+                    rehash();
+                    spare.resize(capacity);
+                }
+
+                Slot &slot = probe(slots, id);
+                if (slot.id == 0) {
+                    slot = Slot{.id = id, .frame = frame, .type = type, .data = create(), .destroy = destroy};
+                    count++;
+                } else if (slot.type != type) {
+                    slot.destroy(slot.data);
+                    slot.type = type;
+                    slot.data = create();
+                    slot.destroy = destroy;
+                }
+                slot.frame = frame;
+                return slot.data;
+            }
+
+            // Destroys the states that were not looked up in this frame and starts the next frame
+            void collect() {
+                size_t stale = 0;
+                for (Slot &slot: slots)
+                    if (slot.id != 0 && slot.frame != frame) {
+                        slot.destroy(slot.data);
+                        slot = Slot{};
+                        stale++;
+                    }
+                // Removing entries breaks the probe sequences, so the live entries are reinserted
+                if (stale > 0) {
+                    count -= stale;
+                    rehash();
+                }
+                frame++;
+            }
+        };
+
+        // Line of a laid out text, the offsets are bytes of a string or characters of a rich text
+        struct TextLine {
+            size_t start = 0;
+            size_t end = 0;
+            size_t width = 0;    // Number of columns the line takes
+        };
+
+        // Open addressing table of the text layouts keyed by a hash of the text and the layout parameters.
+        // Like the widget states, the layouts that were not looked up in a frame are evicted when it ends.
+        // The emptied slots keep their line vectors, so changing text stops allocating once the table is warm.
+        class TextLayoutCache {
+            struct Slot {
+                uint64_t key = 0;    // 0 if the slot is empty
+                uint64_t frame = 0;
+                std::vector<TextLine> lines;
+            };
+
+            std::vector<Slot> slots;
+            std::vector<Slot> spare;    // Empty table of the same size, the entries are moved into it on rehash
+            size_t count = 0;
+            uint64_t frame = 0;
+
+            // Returns the slot of key or the empty slot where it should be inserted
+            static Slot &probe(std::vector<Slot> &table, const uint64_t key) {
+                const size_t mask = table.size() - 1;
+                for (size_t i = key & mask;; i = (i + 1) & mask)
+                    if (table[i].key == key || table[i].key == 0)
+                        return table[i];
+            }
+
+            // Moves the entries into the spare table by swapping the slots, which does not allocate
+            void rehash() {
+                for (Slot &slot: slots)
+                    if (slot.key != 0)
+                        std::swap(probe(spare, slot.key), slot);
+                std::swap(slots, spare);
+            }
+
+          public:
+            // Returns the lines of key, calling layout to fill them if they are not cached.
+            // The lines are valid until the next lookup
+            template<typename Layout>
+            std::span<const TextLine> find(const uint64_t key, Layout &&layout) {
+                // Keep the load factor at most 1/2
+                if ((count + 1) * 2 > slots.size()) {
+                    const size_t capacity = std::max<size_t>(slots.size() * 2, 16);
+                    spare.resize(capacity);
+                    rehash();
+                    spare.resize(capacity);
+                }
+
+                Slot &slot = probe(slots, key);
+                if (slot.key == 0) {
+                    slot.key = key;
+                    slot.lines.clear();
+                    layout(slot.lines);
+                    count++;
+                }
+                slot.frame = frame;
+                return slot.lines;
+            }
+
+            // Evicts the layouts that were not looked up in this frame and starts the next frame
+            void collect() {
+                size_t stale = 0;
+                for (Slot &slot: slots)
+                    if (slot.key != 0 && slot.frame != frame) {
+                        slot.key = 0;
+                        slot.lines.clear();
+                        stale++;
+                    }
+                // Removing entries breaks the probe sequences, so the live entries are reinserted
+                if (stale > 0) {
+                    count -= stale;
+                    rehash();
+                }
+                frame++;
+            }
+        };
+
+        // Lock-free single producer single consumer queue of fixed capacity
+        template<typename T, size_t Capacity>
+        class SpscRing {
+            static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of 2");
+
+            std::array<T, Capacity> slots{};
+            alignas(64) std::atomic<size_t> head = 0;    // Next slot to pop, written only by the consumer
+            alignas(64) std::atomic<size_t> tail = 0;    // Next slot to push, written only by the producer
+
+          public:
+            // Must only be called by the producer, returns false if the ring is full
+            bool push(T &&value) {
+                const size_t index = tail.load(std::memory_order_relaxed);
+                if (index - head.load(std::memory_order_acquire) == Capacity)
+                    return false;
+                slots[index & (Capacity - 1)] = std::move(value);
+                tail.store(index + 1, std::memory_order_release);
+                return true;
+            }
+
+            // Must only be called by the consumer, returns false if the ring is empty
+            bool pop(T &value) {
+                const size_t index = head.load(std::memory_order_relaxed);
+                if (index == tail.load(std::memory_order_acquire))
+                    return false;
+                value = std::move(slots[index & (Capacity - 1)]);
+                head.store(index + 1, std::memory_order_release);
+                return true;
+            }
         };
     }    // namespace internal
 }    // namespace nite
@@ -569,11 +1033,6 @@ using nite_clock = std::chrono::high_resolution_clock;
 
 namespace nite
 {
-    struct KeyState {
-        bool printable = false;
-        bool down = false;
-    };
-
     struct BtnState {
         size_t click1_count = 0;
         size_t click2_count = 0;
@@ -583,19 +1042,212 @@ namespace nite
         bool closed = false;
 
         // Render mechanism
-        std::queue<internal::CellBuffer> swapchain;
+        // The front buffer holds what is on the console and frames are drawn into the back buffer.
+        // Both persist across frames and only reallocate when the window grows past its largest size.
+        internal::CellBuffer front_buffer{0, 0};
+        internal::CellBuffer back_buffer{0, 0};
+        std::vector<uint32_t> changed_cells;    // Indices of the cells that differ between the buffers
+        std::string output;                     // Encoded changed cells, written at once
         std::vector<std::unique_ptr<internal::Box>> box_stack;
+        std::vector<std::unique_ptr<internal::Box>> box_pool;    // Popped boxes, reused by the later panes
+
+        // Hit testing mechanism
+        // Interactive widgets write their id into the cells they cover. The mouse events
+        // of a frame are resolved once against the ids of the previous frame, so a widget
+        // only looks up the events that hit it instead of testing every event.
+        // The ids are indices in the order of the calls, which changes when a widget is no longer drawn,
+        // so the events are matched by a key of the widget hashed from its scope and its ordinal in the scope.
+        // The scope is the innermost of the enclosing widget and the ID stack, so a widget keeps its key when it
+        // moves or resizes, and a widget drawn conditionally keeps the keys of the others in its own ID scope.
+        struct Hit {
+            WidgetID key;
+            uint32_t event_index;
+        };
+
+        Size hit_size;
+        Size prev_hit_size;
+        std::vector<uint32_t> hit_ids;         // Topmost widget id of each cell, 0 if none
+        std::vector<uint32_t> prev_hit_ids;
+        std::vector<uint32_t> hit_parents;     // Enclosing widget id of each id, 0 if none
+        std::vector<uint32_t> prev_hit_parents;
+        std::vector<uint32_t> hit_children;    // Number of widgets registered in the scope of each id
+        std::vector<WidgetID> hit_keys;        // Key of each id, stable across frames
+        std::vector<WidgetID> prev_hit_keys;
+        std::vector<uint32_t> hit_scopes;      // Enclosing widget id of each box in the box stack
+        std::vector<size_t> hit_scope_depths;  // Size of the ID stack when the enclosing widget of each box was set
+        std::vector<Hit> hits;                 // Sorted by key
+        size_t resolved_events = 0;
+
+      public:
+        // Widget identity mechanism
+        std::vector<WidgetID> id_stack;
+        std::vector<uint32_t> id_hit_counts;    // Number of widgets registered in the root scope and each scope of id_stack
+        internal::WidgetStore widget_store;
+
+        // Frame allocator mechanism
+        // Temporaries of the widgets and the app, released when the next frame begins
+        internal::FrameArena frame_arena;
+
+        // Text layout mechanism
+        // Line breaks of the long texts of the text boxes, kept while the texts are drawn every frame
+        internal::TextLayoutCache layout_cache;
+
+      private:
+
+        void resolve_hits() {
+            if (resolved_events == events.size())
+                return;
+
+            for (; resolved_events < events.size(); resolved_events++) {
+                const MouseEvent *ev = std::get_if<MouseEvent>(&events[resolved_events]);
+                if (ev == nullptr || ev->pos.col >= prev_hit_size.width || ev->pos.row >= prev_hit_size.height)
+                    continue;
+                // Events that hit a widget also hit the widgets enclosing it
+                uint32_t id = prev_hit_ids[ev->pos.row * prev_hit_size.width + ev->pos.col];
+                for (; id != 0; id = prev_hit_parents[id])
+                    hits.push_back({.key = prev_hit_keys[id], .event_index = static_cast<uint32_t>(resolved_events)});
+            }
+            // Ordered by event within a widget too, std::stable_sort would allocate a temporary buffer
+            std::sort(hits.begin(), hits.end(), [](const Hit &a, const Hit &b) {
+                return a.key < b.key || (a.key == b.key && a.event_index < b.event_index);
+            });
+        }
 
       public:
+        // Output mechanism
+        bool headless = false;                           // Whether the console is left untouched
+        std::string old_locale;                          // Locale to restore if headless
+        std::optional<Size> render_size = std::nullopt;    // Size of the frames if not the window size
+
         // Delta time mechanism
         std::chrono::duration<double> delta_time;
         std::chrono::duration<double> target_delta_time;
         std::optional<std::chrono::time_point<nite_clock>> prev_time = std::nullopt;
 
-        // Events mechanism
-        std::list<Event> events;
+        // Frame statistics mechanism
+        FrameStats frame_stats;                     // Statistics of the frame in progress
+        FrameStats last_frame_stats;
+        std::vector<FrameStats> stats_history;      // Ring buffer of the last stats_window frames
+        size_t stats_window = 120;
+        size_t stats_next = 0;
+        std::chrono::time_point<nite_clock> draw_start;
+        size_t frame_allocations = 0;    // Allocation count at the end of the previous frame
+        size_t draw_allocations = 0;     // Allocation count at BeginDrawing
+
+        void record_frame_stats() {
+            last_frame_stats = frame_stats;
+            if (stats_history.size() < stats_window) {
+                // Grown once, so recording does not allocate in the later frames
+                stats_history.reserve(stats_window);
+                stats_history.push_back(frame_stats);
+            }
+            else
+                stats_history[stats_next] = frame_stats;
+            stats_next = (stats_next + 1) % stats_window;
+            frame_stats = FrameStats{};
+            frame_allocations = GetAllocationCount();
+        }
+
+        // HUD mechanism
+        // The HUD is drawn straight into the back buffer over the content of the app,
+        // so it is not clipped by the panes and does not count as cells written.
+        HUDInfo hud;
+
+        void put_hud_text(const Position pos, const size_t width, const std::string_view text, const Style style) {
+            for (size_t i = 0; i < width; i++) {
+                if (!back_buffer.contains(pos.col + i, pos.row))
+                    return;
+                back_buffer.split_glyph(pos.col + i, pos.row);
+                back_buffer.at(pos.col + i, pos.row) = internal::Cell{.value = i < text.size() ? static_cast<wchar_t>(text[i]) : L' ', .style = style};
+            }
+        }
+
+        void draw_hud() {
+            static constexpr wchar_t BARS[] = L"\u2581\u2582\u2583\u2584\u2585\u2586\u2587\u2588";
+            static constexpr Style HUD_STYLE = {.bg = Color::from_hex(0x202020), .fg = Color::from_hex(0xd0d0d0)};
+            static constexpr Color GOOD = Color::from_hex(0x50c050), SLOW = Color::from_hex(0xd0b040), BAD = Color::from_hex(0xe05050);
+
+            const size_t frames = std::min(hud.graph_frames, stats_history.size());
+            const size_t width = std::max<size_t>(hud.graph_frames, 34) + 2;
+            const Size size = back_buffer.size();
+            if (size.width < width)
+                return;
+            const Position pos = {.col = size.width - width, .row = 0};
+            const auto ms = [](double seconds) { return seconds * 1e3; };
+
+            // The oldest of the graphed frames comes first
+            const auto history_at = [&](size_t i) -> const FrameStats & {
+                const size_t count = stats_history.size();
+                return stats_history[(stats_next + count - frames + i) % count];
+            };
+            double max_time = target_delta_time.count();
+            for (size_t i = 0; i < frames; i++)
+                max_time = std::max(max_time, history_at(i).frame_time);
+
+            const FrameStats &last = last_frame_stats;
+            put_hud_text(pos, width, std::format(" frame {:6.2f}ms  max {:6.2f}ms", ms(last.frame_time), ms(max_time)), HUD_STYLE);
+
+            put_hud_text(pos + Position{.col = 0, .row = 1}, width, "", HUD_STYLE);
+            for (size_t i = 0; i < frames; i++) {
+                const double time = history_at(i).frame_time;
+                const size_t level = std::min<size_t>(static_cast<size_t>(time / max_time * 8), 7);
+                Style style = HUD_STYLE;
+                style.fg = time <= target_delta_time.count() * 1.1 ? GOOD : time <= target_delta_time.count() * 2 ? SLOW : BAD;
+                if (back_buffer.contains(pos.col + 1 + i, pos.row + 1)) {
+                    back_buffer.split_glyph(pos.col + 1 + i, pos.row + 1);
+                    back_buffer.at(pos.col + 1 + i, pos.row + 1) = internal::Cell{.value = BARS[level], .style = style};
+                }
+            }
+
+            // Draw time points at the app, diff and encode at nite, write and bytes at the link or the terminal
+            put_hud_text(
+                    pos + Position{.col = 0, .row = 2}, width,
+                    std::format(" app {:5.2f}  diff {:5.2f}  enc {:5.2f}", ms(last.draw_time), ms(last.diff_time), ms(last.encode_time)),
+                    HUD_STYLE
+            );
+            put_hud_text(
+                    pos + Position{.col = 0, .row = 3}, width,
+                    std::format(" write {:5.2f}ms  sleep {:6.2f}ms", ms(last.write_time), ms(last.sleep_time)), HUD_STYLE
+            );
+            put_hud_text(
+                    pos + Position{.col = 0, .row = 4}, width,
+                    std::format(" cells {} emitted / {} set", last.cells_emitted, last.cells_written), HUD_STYLE
+            );
+            put_hud_text(
+                    pos + Position{.col = 0, .row = 5}, width,
+                    std::format(" bytes {}  writes {}  events {}", last.bytes_written, last.write_calls, last.events_processed),
+                    HUD_STYLE
+            );
+        }
+
+        // Profiler mechanism
+        // Panes open a scope when profiling is enabled, the scope is tied to the box of the pane
+        // and records the time and the number of cells set until the box is popped.
+        struct ProfileFrame {
+            std::chrono::time_point<nite_clock> start;
+            FrameStats stats;
+            std::vector<ProfileScope> scopes;
+        };
+
+        bool profiling = false;
+        std::vector<ProfileScope> profile_scopes;    // Scopes of the frame in progress
+        std::vector<size_t> box_profile_scopes;      // Index + 1 of the scope opened by each box in the box stack, 0 if none
+        size_t profile_depth = 0;
+        std::vector<ProfileFrame> profile_frames;    // Ring buffer of the last profile_window frames
+        size_t profile_window = 0;
+        size_t profile_next = 0;
+        size_t profile_last = 0;
 
-        std::unordered_map<KeyCode, KeyState> key_states;
+        // Events mechanism
+        std::vector<Event> events;
+        bool coalesce_events = false;
+        bool input_thread = false;
+        std::optional<Event> held_event;    // Event read ahead while coalescing
+
+        // Key state mechanism, indexed by key code
+        std::bitset<KEY_CODE_COUNT> keys_down;        // Keys held down
+        std::bitset<KEY_CODE_COUNT> keys_pressed;     // Keys that went down in this frame
+        std::bitset<KEY_CODE_COUNT> keys_released;    // Keys that went up in this frame
         Position mouse_pos;
 
       public:
@@ -609,49 +1261,225 @@ namespace nite
             closed = b;
         }
 
-        void push_buffer(const Size size) {
-            swapchain.emplace(GetWindowSize());
+        void begin_buffer(const Size size) {
+            frame_arena.reset();
+            back_buffer.resize(size);
+            back_buffer.fill(internal::Cell{});
+            for (auto &box : box_stack)
+                box_pool.push_back(std::move(box));
             box_stack.clear();
+            hit_scopes.clear();
+            hit_scope_depths.clear();
+            box_profile_scopes.clear();
+            profile_scopes.clear();
+            profile_depth = 0;
             emplace_box<internal::StaticBox>(Position{}, size);
-        }
 
-        size_t get_swapchain_count() const {
-            return swapchain.size();
+            hit_size = size;
+            hit_ids.assign(hit_size.width * hit_size.height, 0);
+            hit_parents.assign(1, 0);
+            hit_children.assign(1, 0);
+            hit_keys.assign(1, 0);
         }
 
-        internal::CellBuffer pop_current_buffer() {
-            assert(!swapchain.empty() && "Swapchain cannot be empty");
-            const internal::CellBuffer buf = swapchain.front();
-            swapchain.pop();
-            return buf;
+        void end_frame() {
+            widget_store.collect();
+            layout_cache.collect();
+            keys_pressed.reset();
+            keys_released.reset();
+            events.clear();
+            hits.clear();
+            resolved_events = 0;
+            std::swap(hit_size, prev_hit_size);
+            std::swap(hit_ids, prev_hit_ids);
+            std::swap(hit_parents, prev_hit_parents);
+            std::swap(hit_keys, prev_hit_keys);
         }
 
-        internal::CellBuffer &get_current_buffer() {
-            assert(!swapchain.empty() && "Swapchain cannot be empty");
-            return swapchain.front();
+        // Renders the cells of the back buffer that differ from the front buffer, then swaps them
+        void present() {
+            // Never drawn by widgets, so a front cell holding it is always repainted
+            static constexpr internal::Cell INVALID_CELL{.value = static_cast<wchar_t>(-1)};
+
+            const Size size = back_buffer.size();
+            if (front_buffer.size() != size) {
+                bool preserved = false;
+                if (!internal::console::resize(front_buffer.size(), size, preserved))
+                    preserved = false;
+                // Only the exposed region needs repainting if the console kept its content
+                front_buffer.resize(size, INVALID_CELL);
+                if (!preserved)
+                    front_buffer.fill(INVALID_CELL);
+            }
+
+            using seconds = std::chrono::duration<double>;
+            const auto diff_start = nite_clock::now();
+            changed_cells.clear();
+            for (size_t row = 0; row < size.height; row++) {
+                for (size_t col = 0; col < size.width; col++) {
+                    const internal::Cell &cell = back_buffer.at(col, row);
+                    if (back_buffer.same_cell(cell, front_buffer, front_buffer.at(col, row)))
+                        continue;
+                    // The continuation of a wide glyph is drawn by drawing the glyph
+                    const auto index = static_cast<uint32_t>(row * size.width + (cell.width == 0 && col > 0 ? col - 1 : col));
+                    if (changed_cells.empty() || changed_cells.back() != index)
+                        changed_cells.push_back(index);
+                }
+            }
+
+            const auto encode_start = nite_clock::now();
+            output.clear();
+            for (const uint32_t index : changed_cells) {
+                const size_t col = index % size.width, row = index / size.width;
+                const auto &cell = back_buffer.at(col, row);
+                internal::console::encode_cell(output, col, row, back_buffer.get_cluster(cell), cell.width, cell.style);
+            }
+
+            // The whole frame goes out in as few writes as possible
+            const auto write_start = nite_clock::now();
+            internal::console::write_all(output, frame_stats.write_calls);
+            const auto write_end = nite_clock::now();
+
+            frame_stats.diff_time = seconds(encode_start - diff_start).count();
+            frame_stats.encode_time = seconds(write_start - encode_start).count();
+            frame_stats.write_time = seconds(write_end - write_start).count();
+            frame_stats.cells_diffed = size.width * size.height;
+            frame_stats.cells_emitted = changed_cells.size();
+            frame_stats.bytes_written = output.size();
+            std::swap(front_buffer, back_buffer);
         }
 
         const internal::CellBuffer &get_current_buffer() const {
-            assert(!swapchain.empty() && "Swapchain cannot be empty");
-            return swapchain.front();
+            return back_buffer;
+        }
+
+        const internal::CellBuffer &get_front_buffer() const {
+            return front_buffer;
+        }
+
+        // Forgets what the console shows, so the next frame is drawn in full
+        void invalidate_front_buffer() {
+            front_buffer.resize(Size{});
         }
 
         template<typename BoxType, typename... BoxArgs>
             requires std::is_constructible_v<BoxType, BoxArgs...>
         void emplace_box(BoxArgs... args) {
-            box_stack.push_back(std::make_unique<BoxType>(std::forward<BoxArgs>(args)...));
-        }
-
-        void push_box(std::unique_ptr<internal::Box> box) {
+            // The same panes are opened in every frame, so a box of the type is usually in the pool
+            std::unique_ptr<internal::Box> box;
+            for (auto &pooled : box_pool) {
+                if (typeid(*pooled) == typeid(BoxType)) {
+                    std::swap(pooled, box_pool.back());
+                    box = std::move(box_pool.back());
+                    box_pool.pop_back();
+                    break;
+                }
+            }
             if (box)
-                box_stack.push_back(std::move(box));
+                *static_cast<BoxType *>(box.get()) = BoxType(std::forward<BoxArgs>(args)...);
             else
-                emplace_box<internal::NoBox>();
+                box = std::make_unique<BoxType>(std::forward<BoxArgs>(args)...);
+
+            box_stack.push_back(std::move(box));
+            hit_scopes.push_back(hit_scopes.empty() ? 0 : hit_scopes.back());
+            hit_scope_depths.push_back(hit_scope_depths.empty() ? 0 : hit_scope_depths.back());
+            box_profile_scopes.push_back(0);
         }
 
         void pop_box() {
             assert(!box_stack.empty() && "Box stack cannot be empty");
+            box_pool.push_back(std::move(box_stack.back()));
             box_stack.pop_back();
+            hit_scopes.pop_back();
+            hit_scope_depths.pop_back();
+            if (const size_t scope = box_profile_scopes.back(); scope != 0)
+                end_profile_scope(scope - 1);
+            box_profile_scopes.pop_back();
+        }
+
+        // Opens a profile scope that ends when the current box is popped
+        void begin_profile_scope(const std::string_view name) {
+            if (!profiling || box_profile_scopes.empty())
+                return;
+            profile_scopes.push_back(ProfileScope{
+                    .name = std::string(name),
+                    .depth = profile_depth++,
+                    .start = std::chrono::duration<double>(nite_clock::now() - draw_start).count(),
+                    .duration = 0,
+                    .cells = frame_stats.cells_written,
+            });
+            box_profile_scopes.back() = profile_scopes.size();
+        }
+
+        void end_profile_scope(const size_t index) {
+            ProfileScope &scope = profile_scopes[index];
+            scope.duration = std::chrono::duration<double>(nite_clock::now() - draw_start).count() - scope.start;
+            scope.cells = frame_stats.cells_written - scope.cells;
+            profile_depth--;
+        }
+
+        void record_profile_frame() {
+            if (!profiling)
+                return;
+            if (profile_frames.size() < profile_window)
+                profile_frames.emplace_back();
+            ProfileFrame &frame = profile_frames[profile_next];
+            frame.start = draw_start;
+            frame.stats = frame_stats;
+            std::swap(frame.scopes, profile_scopes);
+            profile_scopes.clear();
+            profile_last = profile_next;
+            profile_next = (profile_next + 1) % profile_window;
+        }
+
+        // Registers an interactive widget covering the rectangle in the current box, returns the id of the widget
+        uint32_t push_hit_rect(Position pos, Size size) {
+            const uint32_t id = static_cast<uint32_t>(hit_parents.size());
+            const uint32_t parent = hit_scopes.empty() ? 0 : hit_scopes.back();
+            hit_parents.push_back(parent);
+            hit_children.push_back(0);
+
+            // The n-th widget of a scope gets the same key in every frame
+            WidgetID seed;
+            uint32_t ordinal;
+            if (parent == 0 || id_stack.size() > hit_scope_depths.back()) {
+                // An ID pushed inside an enclosing widget is only unique within it
+                seed = id_stack.empty() ? internal::ROOT_ID_SEED : id_stack.back();
+                if (parent != 0)
+                    seed = internal::hash_id(hit_keys[parent], seed);
+                ordinal = id_hit_counts[id_stack.size()]++;
+            } else {
+                seed = hit_keys[parent];
+                ordinal = hit_children[parent]++;
+            }
+            hit_keys.push_back(internal::hash_id(ordinal, seed));
+
+            const bool visible = get_current_box().transform_rect(pos, size);
+
+            if (!visible)
+                return id;
+            if (!internal::clip_rect(pos, size, Position{}, hit_size))
+                return id;
+            for (size_t row = pos.row; row < pos.row + size.height; row++)
+                std::fill_n(hit_ids.begin() + row * hit_size.width + pos.col, size.width, id);
+            return id;
+        }
+
+        // Makes the widget with id enclose the widgets registered in the current box
+        void set_hit_scope(const uint32_t id) {
+            assert(!hit_scopes.empty() && "Box stack cannot be empty");
+            hit_scopes.back() = id;
+            hit_scope_depths.back() = id_stack.size();
+        }
+
+        // Calls fn with every mouse event of this frame that hit the widget with id in the previous frame
+        template<typename Fn>
+        void for_each_hit(const uint32_t id, Fn &&fn) {
+            resolve_hits();
+            const WidgetID key = hit_keys[id];
+            auto it = std::lower_bound(hits.begin(), hits.end(), key, [](const Hit &hit, WidgetID key) { return hit.key < key; });
+            for (; it != hits.end() && it->key == key; ++it)
+                fn(std::get<MouseEvent>(events[it->event_index]));
         }
 
         internal::Box &get_current_box() {
@@ -686,32 +1514,67 @@ namespace nite
         //     return Position{.col = saved_col, .row = saved_row};
         // }
 
-        bool set_cell(size_t col, size_t row, wchar_t value, const Style style) {
-            internal::Box &box = get_current_box();
-            if (!box.transform(col, row))
-                return false;
-
-            // if (const auto pos = allowable(col, row)) {
-            //     col = pos->col;
-            //     row = pos->row;
-            // } else
-            //     return false;
+        // Returns the position in the buffer of the glyph before col, row of the current pane
+        std::optional<Position> get_glyph_before(size_t col, size_t row) {
+            if (col == 0)
+                return std::nullopt;
+            col--;
+            if (!get_current_box().transform(col, row) || !back_buffer.contains(col, row))
+                return std::nullopt;
+            if (back_buffer.at(col, row).width == 0 && col > 0)
+                col--;
+            return Position{.col = col, .row = row};
+        }
 
-            internal::CellBuffer &buffer = swapchain.back();
-            if (!buffer.contains(col, row))
-                return false;
+        // Draws value at col, row of the current pane. A wide value takes the cell after it as well
+        // and is drawn as a blank if that cell is not visible, a zero width value joins the glyph before it.
+        // Returns the number of columns the value takes, whether it is visible or not
+        size_t set_cell(size_t col, size_t row, wchar_t value, const Style style) {
+            internal::CellBuffer &buffer = back_buffer;
+            size_t width = internal::unicode::char_width(value);
+            if (width != 1) {
+                const auto before = get_glyph_before(col, row);
+                const auto cluster = before ? buffer.get_cluster(buffer.at(*before)) : std::span<const wchar_t>();
+                if (internal::unicode::joins_cluster(cluster.empty() ? 0 : cluster.back(), value)) {
+                    if (before)
+                        buffer.append_to_cluster(before->col, before->row, value);
+                    return 0;
+                }
+            }
 
-            internal::Cell &cell = buffer.at(col, row);
+            // A wide value needs the next cell to be visible right after its own
+            internal::Box &box = get_current_box();
+            size_t x = col, y = row;
+            if (!box.transform(x, y) || !buffer.contains(x, y))
+                return width;
+            const size_t columns = width;
+            if (width == 2) {
+                size_t next_x = col + 1, next_y = row;
+                if (!box.transform(next_x, next_y) || next_x != x + 1 || next_y != y || !buffer.contains(next_x, next_y)) {
+                    value = ' ';
+                    width = 1;
+                }
+            }
+
+            buffer.split_glyph(x, y);
+            if (width == 2)
+                buffer.split_glyph(x + 1, y);
+            internal::Cell &cell = buffer.at(x, y);
+            frame_stats.cells_written++;
             cell.value = value;
+            cell.width = static_cast<uint8_t>(width);
+            cell.cluster_size = 0;
             if ((style.mode & STYLE_NO_FG) == 0)
                 cell.style.fg = style.fg;
             if ((style.mode & STYLE_NO_BG) == 0)
                 cell.style.bg = style.bg;
             cell.style.mode = style.mode & ~(STYLE_NO_FG | STYLE_NO_BG);
-            return true;
+            if (width == 2)
+                buffer.at(x + 1, y) = internal::Cell{.value = 0, .style = cell.style, .width = 0};
+            return columns;
         }
 
-        bool set_cell(size_t col, size_t row, const StyledChar st_char) {
+        size_t set_cell(size_t col, size_t row, const StyledChar st_char) {
             return set_cell(col, row, st_char.value, st_char.style);
         }
 
@@ -722,7 +1585,7 @@ namespace nite
             col += selected.get_pos().col;
             row += selected.get_pos().row;
 
-            internal::CellBuffer &buffer = swapchain.back();
+            internal::CellBuffer &buffer = back_buffer;
             if (buffer.contains(col, row) && selected.contains(col, row))
                 return buffer.at(col, row);
             return sentinel;
@@ -764,7 +1627,7 @@ namespace nite
     }
 
     double GetTargetFPS(const State &state) {
-        return state.impl->target_delta_time.count();
+        return 1.0 / state.impl->target_delta_time.count();
     }
 
     void SetTargetFPS(const State &state, double fps) {
@@ -772,91 +1635,277 @@ namespace nite
         state.impl->target_delta_time = std::chrono::duration<double>(1 / fps);
     }
 
+    FrameStats GetFrameStats(const State &state) {
+        return state.impl->last_frame_stats;
+    }
+
+    size_t GetAllocationCount() {
+#ifdef NITE_TRACK_ALLOCATIONS
+        return allocation_count.load(std::memory_order_relaxed);
+#else
+        return 0;
+#endif
+    }
+
+    FrameStats GetFrameStatsPercentile(const State &state, double percentile) {
+        const auto &history = state.impl->stats_history;
+        FrameStats result;
+        if (history.empty())
+            return result;
+
+        // Nearest rank method, see: https://en.wikipedia.org/wiki/Percentile#The_nearest-rank_method
+        percentile = std::clamp(percentile, 0.0, 100.0);
+        const size_t rank = std::max<size_t>(static_cast<size_t>(std::ceil(percentile / 100 * history.size())), 1) - 1;
+        const auto select = [&](auto field) {
+            std::vector<std::remove_cvref_t<decltype(result.*field)>> values;
+            values.reserve(history.size());
+            for (const auto &stats : history)
+                values.push_back(stats.*field);
+            std::nth_element(values.begin(), values.begin() + rank, values.end());
+            result.*field = values[rank];
+        };
+        select(&FrameStats::frame_time);
+        select(&FrameStats::draw_time);
+        select(&FrameStats::diff_time);
+        select(&FrameStats::encode_time);
+        select(&FrameStats::write_time);
+        select(&FrameStats::sleep_time);
+        select(&FrameStats::cells_written);
+        select(&FrameStats::cells_diffed);
+        select(&FrameStats::cells_emitted);
+        select(&FrameStats::bytes_written);
+        select(&FrameStats::write_calls);
+        select(&FrameStats::events_processed);
+        select(&FrameStats::allocations);
+        select(&FrameStats::event_allocations);
+        select(&FrameStats::draw_allocations);
+        select(&FrameStats::present_allocations);
+        select(&FrameStats::arena_bytes);
+        return result;
+    }
+
+    void SetFrameStatsWindow(const State &state, size_t frames) {
+        state.impl->stats_window = std::max<size_t>(frames, 1);
+        state.impl->stats_history.clear();
+        state.impl->stats_next = 0;
+    }
+
+    void SetHUD(const State &state, HUDInfo info) {
+        state.impl->hud = std::move(info);
+    }
+
+    bool IsHUDVisible(const State &state) {
+        return state.impl->hud.visible;
+    }
+
+    void SetProfiling(const State &state, bool enabled, size_t frames) {
+        auto &impl = *state.impl;
+        impl.profiling = enabled;
+        impl.profile_frames.clear();
+        impl.profile_window = std::max<size_t>(frames, 1);
+        impl.profile_next = impl.profile_last = 0;
+    }
+
+    bool IsProfiling(const State &state) {
+        return state.impl->profiling;
+    }
+
+    const std::vector<ProfileScope> &GetProfileScopes(const State &state) {
+        static const std::vector<ProfileScope> empty;
+        const auto &impl = *state.impl;
+        if (impl.profile_frames.empty())
+            return empty;
+        return impl.profile_frames[impl.profile_last].scopes;
+    }
+
+    static void append_json_string(std::string &out, const std::string_view str) {
+        out += '"';
+        for (const char c : str) {
+            switch (c) {
+            case '"':
+                out += "\\\"";
+                break;
+            case '\\':
+                out += "\\\\";
+                break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20)
+                    out += std::format("\\u{:04x}", static_cast<unsigned char>(c));
+                else
+                    out += c;
+                break;
+            }
+        }
+        out += '"';
+    }
+
+    Result ExportProfileTrace(const State &state, const std::string &path) {
+        // Refer to: https://docs.google.com/document/d/1CvAClvFfyA5R-PhYUmn5OOQtYMH4h6I0nSsKchNAySU
+        const auto &impl = *state.impl;
+        const auto &frames = impl.profile_frames;
+        const size_t first = frames.size() < impl.profile_window ? 0 : impl.profile_next;
+
+        std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        bool first_event = true;
+        const auto add_event = [&](const std::string_view name, const char *cat, double ts, double dur, const std::string &args) {
+            if (!first_event)
+                out += ',';
+            first_event = false;
+            out += "{\"name\":";
+            append_json_string(out, name);
+            out += std::format(",\"cat\":\"{}\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":{:.3f},\"dur\":{:.3f},\"args\":{{{}}}}}", cat, ts, dur, args);
+        };
+
+        for (size_t i = 0; i < frames.size(); i++) {
+            const auto &frame = frames[(first + i) % frames.size()];
+            const FrameStats &stats = frame.stats;
+            // Timestamps are in microseconds since the oldest recorded frame
+            const double ts = std::chrono::duration<double, std::micro>(frame.start - frames[first].start).count();
+            const double present = stats.diff_time + stats.encode_time + stats.write_time;
+
+            add_event("Draw", "frame", ts, stats.draw_time * 1e6, std::format("\"cells_written\":{}", stats.cells_written));
+            for (const ProfileScope &scope : frame.scopes)
+                add_event(scope.name, "pane", ts + scope.start * 1e6, scope.duration * 1e6, std::format("\"cells\":{}", scope.cells));
+            add_event("Present", "frame", ts + stats.draw_time * 1e6, present * 1e6,
+                      std::format("\"cells_emitted\":{},\"bytes_written\":{}", stats.cells_emitted, stats.bytes_written));
+            if (stats.sleep_time > 0)
+                add_event("Sleep", "frame", ts + (stats.draw_time + present) * 1e6, stats.sleep_time * 1e6, "");
+        }
+        out += "]}";
+
+        std::ofstream file(path, std::ios::binary);
+        if (!file)
+            return Result::Error("error opening '{}' for writing", path);
+        file.write(out.data(), static_cast<std::streamsize>(out.size()));
+        if (!file)
+            return Result::Error("error writing to '{}'", path);
+        return Result::Ok;
+    }
+
     bool ShouldWindowClose(const State &state) {
         return state.impl->is_closed();
     }
 
     Result Initialize(State &state) {
-        if (!internal::console::is_tty())
+        return Initialize(state, InitInfo{});
+    }
+
+    Result Initialize(State &state, InitInfo info) {
+        const bool is_tty = internal::console::is_tty();
+        if (!is_tty && info.require_tty && !info.sink)
             return Result::Error("cannot initialize in a non-terminal environment");
-        $(internal::console::init());
+        // The frames of a headless state have no window to take their size from
+        if ((info.sink || !is_tty) && !info.size)
+            return Result::Error("the frame size must be set when the output is not a terminal");
+
+        // The console is only set up when the frames are drawn on it,
+        // but the text is always converted as UTF-8
+        state.impl->headless = info.sink || !is_tty;
+        if (!state.impl->headless) {
+            $(internal::console::init());
+        } else {
+            internal::set_utf8_locale(state.impl->old_locale);
+        }
+        $(internal::SetInputSource(std::move(info.input)));
+        internal::console::set_sink(std::move(info.sink));
+        state.impl->render_size = info.size;
+        // The frames of an earlier initialization are not on the new output
+        state.impl->invalidate_front_buffer();
 
         state.impl->set_closed(false);
+        state.impl->frame_allocations = GetAllocationCount();
         SetTargetFPS(state, 60);
         return Result::Ok;
     }
 
     Result Cleanup() {
-        return internal::console::restore();
+        $(internal::SetInputThread(false));
+        auto &impl = *GetState().impl;
+        impl.input_thread = false;
+        internal::console::set_sink(nullptr);
+        $(internal::SetInputSource(nullptr));
+        if (!impl.headless)
+            return internal::console::restore();
+        internal::restore_locale(impl.old_locale);
+        return Result::Ok;
     }
 
     void BeginDrawing(State &state) {
-        state.impl->push_buffer(GetWindowSize());
+        state.impl->draw_allocations = GetAllocationCount();
+        state.impl->begin_buffer(state.impl->render_size ? *state.impl->render_size : GetWindowSize());
+        state.impl->id_stack.clear();
+        state.impl->id_hit_counts.assign(1, 0);
+        state.impl->draw_start = nite_clock::now();
     }
 
-    void EndDrawing(State &state) {
-        state.impl->events.clear();
-        state.impl->pop_box();
+    void PushID(State &state, const std::string_view str) {
+        state.impl->id_stack.push_back(GetID(state, str));
+        state.impl->id_hit_counts.push_back(0);
+    }
 
-        switch (state.impl->get_swapchain_count()) {
-        case 0:
-            break;
-        case 1: {
-            const auto &cur_buf = state.impl->get_current_buffer();
-            const auto cur_size = cur_buf.size();
-
-            for (size_t row = 0; row < cur_size.height; row++) {
-                for (size_t col = 0; col < cur_size.width; col++) {
-                    const auto &cell = cur_buf.at(col, row);
-                    internal::console::set_cell(col, row, cell.value, cell.style);
-                }
-            }
+    void PushID(State &state, const uint64_t id) {
+        state.impl->id_stack.push_back(GetID(state, id));
+        state.impl->id_hit_counts.push_back(0);
+    }
 
-            const auto now_time = nite_clock::now();
-            if (state.impl->prev_time)
-                state.impl->delta_time = now_time - *state.impl->prev_time;
-            state.impl->prev_time = now_time;
-            // Sleep this thread for other processes to work
-            if (state.impl->delta_time < state.impl->target_delta_time)
-                std::this_thread::sleep_for(state.impl->target_delta_time - state.impl->delta_time);
-            break;
-        }
-        default: {
-            const auto prev_buf = state.impl->pop_current_buffer();
-            const auto prev_size = prev_buf.size();
+    void PopID(State &state) {
+        assert(!state.impl->id_stack.empty() && "ID stack cannot be empty");
+        state.impl->id_stack.pop_back();
+        state.impl->id_hit_counts.pop_back();
+    }
 
-            const auto &cur_buf = state.impl->get_current_buffer();
-            const auto cur_size = cur_buf.size();
+    WidgetID GetID(const State &state, const std::string_view str) {
+        const auto &id_stack = state.impl->id_stack;
+        return internal::hash_id(str, id_stack.empty() ? internal::ROOT_ID_SEED : id_stack.back());
+    }
 
-            if (cur_size == prev_size) {
-                for (size_t row = 0; row < cur_size.height; row++) {
-                    for (size_t col = 0; col < cur_size.width; col++) {
-                        const auto &cell = cur_buf.at(col, row);
-                        const auto &prev_cell = prev_buf.at(col, row);
-                        if (cell != prev_cell)
-                            internal::console::set_cell(col, row, cell.value, cell.style);
-                    }
-                }
-            } else {
-                internal::console::clear();
-                for (size_t row = 0; row < cur_size.height; row++) {
-                    for (size_t col = 0; col < cur_size.width; col++) {
-                        const auto &cell = cur_buf.at(col, row);
-                        internal::console::set_cell(col, row, cell.value, cell.style);
-                    }
-                }
-            }
+    WidgetID GetID(const State &state, const uint64_t id) {
+        const auto &id_stack = state.impl->id_stack;
+        return internal::hash_id(id, id_stack.empty() ? internal::ROOT_ID_SEED : id_stack.back());
+    }
 
-            const auto now_time = nite_clock::now();
-            if (state.impl->prev_time)
-                state.impl->delta_time = now_time - *state.impl->prev_time;
-            state.impl->prev_time = now_time;
-            // Sleep this thread for other processes to work
-            if (state.impl->delta_time < state.impl->target_delta_time)
-                std::this_thread::sleep_for(state.impl->target_delta_time - state.impl->delta_time);
-            break;
-        }
-        }
+    void *internal::FindWidgetState(State &state, WidgetID id, const void *type, void *(*create)(), void (*destroy)(void *)) {
+        return state.impl->widget_store.find(id, type, create, destroy);
+    }
+
+    void EndDrawing(State &state) {
+        using seconds = std::chrono::duration<double>;
+        auto &stats = state.impl->frame_stats;
+        stats.draw_time = seconds(nite_clock::now() - state.impl->draw_start).count();
+        stats.draw_allocations = GetAllocationCount() - state.impl->draw_allocations;
+        stats.arena_bytes = state.impl->frame_arena.get_used();
+        stats.events_processed = state.impl->events.size();
+
+        if (state.impl->hud.toggle_key && state.impl->keys_pressed.test(static_cast<size_t>(*state.impl->hud.toggle_key)))
+            state.impl->hud.visible = !state.impl->hud.visible;
+        if (state.impl->hud.visible)
+            state.impl->draw_hud();
+
+        state.impl->end_frame();
+        state.impl->pop_box();
+
+        const size_t present_allocations = GetAllocationCount();
+        state.impl->present();
+        stats.present_allocations = GetAllocationCount() - present_allocations;
+
+        // Sleep this thread for other processes to work, the previous frame ended after its sleep
+        const auto now_time = nite_clock::now();
+        if (state.impl->prev_time && now_time - *state.impl->prev_time < state.impl->target_delta_time)
+            std::this_thread::sleep_for(state.impl->target_delta_time - (now_time - *state.impl->prev_time));
+        const auto end_time = nite_clock::now();
+        if (state.impl->prev_time)
+            state.impl->delta_time = end_time - *state.impl->prev_time;
+        state.impl->prev_time = end_time;
+        stats.frame_time = state.impl->delta_time.count();
+        stats.sleep_time = seconds(end_time - now_time).count();
+        stats.allocations = GetAllocationCount() - state.impl->frame_allocations;
+
+        state.impl->record_profile_frame();
+        state.impl->record_frame_stats();
+    }
+
+    std::pmr::memory_resource *GetFrameAllocator(State &state) {
+        return &state.impl->frame_arena;
     }
 
     void CloseWindow(State &state) {
@@ -992,13 +2041,14 @@ namespace nite
             }
     }
 
-    void BeginPane(State &state, const Position top_left, const Size size) {
+    void BeginPane(State &state, const Position top_left, const Size size, const std::string_view name) {
         if (const auto no_box = dynamic_cast<internal::NoBox *>(&state.impl->get_current_box()); no_box) {
             state.impl->emplace_box<internal::NoBox>(*no_box);
             return;
         }
 
         state.impl->emplace_box<internal::StaticBox>(GetPanePosition(state) + top_left, size);
+        state.impl->begin_profile_scope(name);
     }
 
     static void scroll_vertical(Position &pivot, ScrollPaneInfo &info, int64_t value) {
@@ -1050,10 +2100,14 @@ namespace nite
             return;
         }
 
+        const uint32_t hit_id = state.impl->push_hit_rect(info.pos, info.min_size);
         state.impl->emplace_box<internal::ScrollBox>(
                 info.show_scroll_home, info.show_hscroll_bar, info.show_vscroll_bar, info.scroll_bar, GetPanePosition(state) + info.pos, &pivot,
                 info.min_size, info.max_size
         );
+        // The widgets inside the pane are enclosed by it, so the pane scrolls over them too
+        state.impl->set_hit_scope(hit_id);
+        state.impl->begin_profile_scope(info.name);
 
         const bool is_hscroll_visible = info.show_hscroll_bar && info.max_size.width > info.min_size.width;
         const bool is_vscroll_visible = info.show_vscroll_bar && info.max_size.height > info.min_size.height;
@@ -1068,48 +2122,43 @@ namespace nite
         int64_t vscroll_count = 0;
         int64_t hscroll_count = 0;
 
-        for (const Event &event: state.impl->events) {
-            HandleEvent(event, [&](const MouseEvent &ev) {
-                if (!internal::StaticBox(GetPanePosition(state), info.min_size).contains(ev.pos))
-                    return;    // Do not take out of range events
-
-                switch (ev.kind) {
-                case MouseEventKind::CLICK:
-                case MouseEventKind::DOUBLE_CLICK:
-                    if (ev.button != MouseButton::LEFT)
-                        break;
-                    if (is_hscroll_visible && ev.pos - GetPanePosition(state) == left_scroll_btn + info.pos)
-                        hscroll_count--;
-                    if (is_hscroll_visible && ev.pos - GetPanePosition(state) == right_scroll_btn + info.pos)
-                        hscroll_count++;
-                    if (is_vscroll_visible && ev.pos - GetPanePosition(state) == top_scroll_btn + info.pos)
-                        vscroll_count--;
-                    if (is_vscroll_visible && ev.pos - GetPanePosition(state) == bottom_scroll_btn + info.pos)
-                        vscroll_count++;
-                    if (is_home_visible && ev.pos - GetPanePosition(state) == home_cell_btn + info.pos)
-                        pivot = {};
-                    break;
-                case MouseEventKind::SCROLL_DOWN:
-                    if (is_vscroll_visible)
-                        vscroll_count++;
-                    break;
-                case MouseEventKind::SCROLL_UP:
-                    if (is_vscroll_visible)
-                        vscroll_count--;
-                    break;
-                case MouseEventKind::SCROLL_LEFT:
-                    if (is_hscroll_visible)
-                        hscroll_count--;
-                    break;
-                case MouseEventKind::SCROLL_RIGHT:
-                    if (is_hscroll_visible)
-                        hscroll_count++;
-                    break;
-                default:
+        state.impl->for_each_hit(hit_id, [&](const MouseEvent &ev) {
+            switch (ev.kind) {
+            case MouseEventKind::CLICK:
+            case MouseEventKind::DOUBLE_CLICK:
+                if (ev.button != MouseButton::LEFT)
                     break;
-                }
-            });
-        }
+                if (is_hscroll_visible && ev.pos - GetPanePosition(state) == left_scroll_btn + info.pos)
+                    hscroll_count--;
+                if (is_hscroll_visible && ev.pos - GetPanePosition(state) == right_scroll_btn + info.pos)
+                    hscroll_count++;
+                if (is_vscroll_visible && ev.pos - GetPanePosition(state) == top_scroll_btn + info.pos)
+                    vscroll_count--;
+                if (is_vscroll_visible && ev.pos - GetPanePosition(state) == bottom_scroll_btn + info.pos)
+                    vscroll_count++;
+                if (is_home_visible && ev.pos - GetPanePosition(state) == home_cell_btn + info.pos)
+                    pivot = {};
+                break;
+            case MouseEventKind::SCROLL_DOWN:
+                if (is_vscroll_visible)
+                    vscroll_count += ev.count;
+                break;
+            case MouseEventKind::SCROLL_UP:
+                if (is_vscroll_visible)
+                    vscroll_count -= ev.count;
+                break;
+            case MouseEventKind::SCROLL_LEFT:
+                if (is_hscroll_visible)
+                    hscroll_count -= ev.count;
+                break;
+            case MouseEventKind::SCROLL_RIGHT:
+                if (is_hscroll_visible)
+                    hscroll_count += ev.count;
+                break;
+            default:
+                break;
+            }
+        });
 
         if (is_hscroll_visible)
             scroll_horizontal(pivot, info, hscroll_count);
@@ -1117,6 +2166,10 @@ namespace nite
             scroll_vertical(pivot, info, vscroll_count);
     }
 
+    void BeginScrollPane(State &state, WidgetID id, ScrollPaneInfo info) {
+        BeginScrollPane(state, GetWidgetState<Position>(state, id), std::move(info));
+    }
+
     void BeginGridPane(State &state, GridPaneInfo info) {
         if (const auto no_box = dynamic_cast<internal::NoBox *>(&state.impl->get_current_box()); no_box) {
             state.impl->emplace_box<internal::NoBox>(*no_box);
@@ -1151,16 +2204,21 @@ namespace nite
         }
 
         state.impl->emplace_box<internal::GridBox>(GetPanePosition(state) + info.pos, info.size, num_cols, num_rows, grid);
+        state.impl->begin_profile_scope(info.name);
     }
 
-    void BeginGridCell(State &state, size_t col, size_t row) {
+    void BeginGridCell(State &state, size_t col, size_t row, const std::string_view name) {
         if (const auto no_box = dynamic_cast<internal::NoBox *>(&state.impl->get_current_box()); no_box) {
             state.impl->emplace_box<internal::NoBox>(*no_box);
             return;
         }
-        if (const auto grid_box = dynamic_cast<internal::GridBox *>(&state.impl->get_current_box()); grid_box)
-            state.impl->push_box(grid_box->get_grid_cell(col, row));
-        else
+        if (const auto grid_box = dynamic_cast<internal::GridBox *>(&state.impl->get_current_box()); grid_box) {
+            if (const auto cell = grid_box->get_grid_cell(col, row))
+                state.impl->emplace_box<internal::StaticBox>(*cell);
+            else
+                state.impl->emplace_box<internal::NoBox>();
+            state.impl->begin_profile_scope(name);
+        } else
             state.impl->emplace_box<internal::NoBox>();
     }
 
@@ -1333,538 +2391,480 @@ namespace nite
         DrawLine(state, {.col = col, .row = 0}, {.col = col, .row = state.impl->get_current_box().get_size().height}, value, style);
     }
 
-    size_t Text(State &state, TextInfo info) {
-        for (const auto &event: state.impl->events)
-            HandleEvent(event, [&](const MouseEvent &ev) {
-                switch (ev.kind) {
-                case MouseEventKind::CLICK:
-                case MouseEventKind::DOUBLE_CLICK:
-                    if (!internal::StaticBox(info.pos, Size{.width = info.text.size(), .height = 1}).contains(ev.pos - GetPanePosition(state)))
-                        break;
-                    switch (ev.button) {
-                    case MouseButton::LEFT:
-                        if (ev.kind == MouseEventKind::DOUBLE_CLICK) {
-                            if (info.on_click2)
-                                info.on_click2(std::ref(info));
-                            else if (info.on_click)
-                                info.on_click(std::ref(info));
-                        }
-                        break;
-                    case MouseButton::RIGHT:
-                        if (info.on_menu)
-                            info.on_menu(std::ref(info));
-                        break;
-                    default:
-                        break;
+    // Decodes one UTF-8 character of text starting at index into wc.
+    // Returns the number of bytes consumed, invalid bytes are decoded as U+FFFD.
+    static size_t decode_char(const std::string_view text, const size_t index, wchar_t &wc) {
+        char32_t cp;
+        const size_t len = internal::utf8::decode(text, index, cp);
+        wc = cp == 0 ? L' ' : internal::utf8::to_wchar(cp);
+        return len;
+    }
+
+    static size_t text_width(const std::string_view text) {
+        size_t width = 0;
+        wchar_t last = 0;
+        for (size_t i = 0; i < text.size();) {
+            // Every ASCII byte is a glyph of its own
+            const size_t run = internal::utf8::ascii_run(text.substr(i));
+            if (run > 0) {
+                width += run;
+                i += run;
+                last = text[i - 1];
+                continue;
+            }
+
+            wchar_t wc;
+            i += decode_char(text, i, wc);
+            if (!internal::unicode::joins_cluster(last, wc))
+                width += internal::unicode::char_width(wc);
+            last = wc;
+        }
+        return width;
+    }
+
+    static size_t text_width(const std::span<const StyledChar> text) {
+        size_t width = 0;
+        wchar_t last = 0;
+        for (const StyledChar &st_char: text) {
+            if (!internal::unicode::joins_cluster(last, st_char.value))
+                width += internal::unicode::char_width(st_char.value);
+            last = st_char.value;
+        }
+        return width;
+    }
+
+    size_t GetCharWidth(const wchar_t value) {
+        return internal::unicode::char_width(value);
+    }
+
+    size_t GetTextWidth(const std::string_view text) {
+        return text_width(text);
+    }
+
+    // Draws a Text or a TextView
+    template<typename Info>
+    static size_t draw_text(State &state, Info &info) {
+        const uint32_t hit_id = state.impl->push_hit_rect(info.pos, Size{.width = text_width(info.text), .height = 1});
+        state.impl->for_each_hit(hit_id, [&](const MouseEvent &ev) {
+            switch (ev.kind) {
+            case MouseEventKind::CLICK:
+            case MouseEventKind::DOUBLE_CLICK:
+                switch (ev.button) {
+                case MouseButton::LEFT:
+                    if (ev.kind == MouseEventKind::DOUBLE_CLICK) {
+                        if (info.on_click2)
+                            info.on_click2(std::ref(info));
+                        else if (info.on_click)
+                            info.on_click(std::ref(info));
                     }
                     break;
-                case MouseEventKind::MOVED:
-                    if (internal::StaticBox(info.pos, Size{.width = info.text.size(), .height = 1}).contains(ev.pos - GetPanePosition(state)))
-                        if (info.on_hover)
-                            info.on_hover(std::ref(info));
+                case MouseButton::RIGHT:
+                    if (info.on_menu)
+                        info.on_menu(std::ref(info));
                     break;
                 default:
                     break;
                 }
-            });
+                break;
+            case MouseEventKind::MOVED:
+                if (info.on_hover)
+                    info.on_hover(std::ref(info));
+                break;
+            default:
+                break;
+            }
+        });
 
-        size_t i = 0;
-        for (wchar_t wc: str_to_wstr(info.text)) {
-            state.impl->set_cell(info.pos.col + i, info.pos.row, wc, info.style);
-            i++;
+        // Decoded in place, converting the whole text to a wide string would allocate in every frame
+        const std::string_view text = info.text;
+        size_t col = 0;
+        for (size_t index = 0; index < text.size();) {
+            // The runs of ASCII bytes are copied without decoding
+            const size_t run = internal::utf8::ascii_run(text.substr(index));
+            for (size_t j = 0; j < run; j++)
+                state.impl->set_cell(info.pos.col + col + j, info.pos.row, text[index + j] == '\0' ? L' ' : static_cast<wchar_t>(text[index + j]), info.style);
+            col += run;
+            index += run;
+            if (index == text.size())
+                break;
+
+            wchar_t wc;
+            index += decode_char(text, index, wc);
+            col += state.impl->set_cell(info.pos.col + col, info.pos.row, wc, info.style);
         }
-        return i;
+        return col;
     }
 
-    size_t RichText(State &state, RichTextInfo info) {
-        for (const auto &event: state.impl->events)
-            HandleEvent(event, [&](const MouseEvent &ev) {
-                switch (ev.kind) {
-                case MouseEventKind::CLICK:
-                case MouseEventKind::DOUBLE_CLICK:
-                    if (!internal::StaticBox(info.pos, Size{.width = info.text.size(), .height = 1}).contains(ev.pos - GetPanePosition(state)))
-                        break;
-                    switch (ev.button) {
-                    case MouseButton::LEFT:
-                        if (ev.kind == MouseEventKind::DOUBLE_CLICK) {
-                            if (info.on_click2)
-                                info.on_click2(std::ref(info));
-                            else if (info.on_click)
-                                info.on_click(std::ref(info));
-                        }
-                        break;
-                    case MouseButton::RIGHT:
-                        if (info.on_menu)
-                            info.on_menu(std::ref(info));
-                        break;
-                    default:
-                        break;
+    size_t Text(State &state, TextInfo info) {
+        return draw_text(state, info);
+    }
+
+    size_t TextView(State &state, TextViewInfo info) {
+        return draw_text(state, info);
+    }
+
+    // Draws a RichText or a RichTextView
+    template<typename Info>
+    static size_t draw_rich_text(State &state, Info &info) {
+        const uint32_t hit_id = state.impl->push_hit_rect(info.pos, Size{.width = text_width(std::span<const StyledChar>(info.text)), .height = 1});
+        state.impl->for_each_hit(hit_id, [&](const MouseEvent &ev) {
+            switch (ev.kind) {
+            case MouseEventKind::CLICK:
+            case MouseEventKind::DOUBLE_CLICK:
+                switch (ev.button) {
+                case MouseButton::LEFT:
+                    if (ev.kind == MouseEventKind::DOUBLE_CLICK) {
+                        if (info.on_click2)
+                            info.on_click2(std::ref(info));
+                        else if (info.on_click)
+                            info.on_click(std::ref(info));
                     }
                     break;
-                case MouseEventKind::MOVED:
-                    if (internal::StaticBox(info.pos, Size{.width = info.text.size(), .height = 1}).contains(ev.pos - GetPanePosition(state)))
-                        if (info.on_hover)
-                            info.on_hover(std::ref(info));
+                case MouseButton::RIGHT:
+                    if (info.on_menu)
+                        info.on_menu(std::ref(info));
                     break;
                 default:
                     break;
                 }
-            });
+                break;
+            case MouseEventKind::MOVED:
+                if (info.on_hover)
+                    info.on_hover(std::ref(info));
+                break;
+            default:
+                break;
+            }
+        });
 
-        size_t i = 0;
-        for (StyledChar st_char: info.text) {
-            state.impl->set_cell(info.pos.col + i, info.pos.row, st_char.value, st_char.style);
-            i++;
-        }
-        return i;
+        size_t col = 0;
+        for (const StyledChar &st_char: info.text)
+            col += state.impl->set_cell(info.pos.col + col, info.pos.row, st_char.value, st_char.style);
+        return col;
     }
 
-    void TextBox(State &state, TextBoxInfo info) {
-        for (const auto &event: state.impl->events)
-            HandleEvent(event, [&](const MouseEvent &ev) {
-                switch (ev.kind) {
-                case MouseEventKind::CLICK:
-                case MouseEventKind::DOUBLE_CLICK:
-                    if (!internal::StaticBox(info.pos, info.size).contains(ev.pos - GetPanePosition(state)))
-                        break;
-                    switch (ev.button) {
-                    case MouseButton::LEFT:
-                        if (ev.kind == MouseEventKind::DOUBLE_CLICK) {
-                            if (info.on_click2)
-                                info.on_click2(std::ref(info));
-                            else if (info.on_click)
-                                info.on_click(std::ref(info));
-                        }
-                        break;
-                    case MouseButton::RIGHT:
-                        if (info.on_menu)
-                            info.on_menu(std::ref(info));
-                        break;
-                    default:
-                        break;
+    size_t RichText(State &state, RichTextInfo info) {
+        return draw_rich_text(state, info);
+    }
+
+    size_t RichTextView(State &state, RichTextViewInfo info) {
+        return draw_rich_text(state, info);
+    }
+
+    // Runs the handlers of a text box for the mouse events that hit it
+    template<typename Info>
+    static void handle_text_box_hits(State &state, Info &info) {
+        const uint32_t hit_id = state.impl->push_hit_rect(info.pos, info.size);
+        state.impl->for_each_hit(hit_id, [&](const MouseEvent &ev) {
+            switch (ev.kind) {
+            case MouseEventKind::CLICK:
+            case MouseEventKind::DOUBLE_CLICK:
+                switch (ev.button) {
+                case MouseButton::LEFT:
+                    if (ev.kind == MouseEventKind::DOUBLE_CLICK) {
+                        if (info.on_click2)
+                            info.on_click2(std::ref(info));
+                        else if (info.on_click)
+                            info.on_click(std::ref(info));
                     }
                     break;
-                case MouseEventKind::MOVED:
-                    if (internal::StaticBox(info.pos, info.size).contains(ev.pos - GetPanePosition(state)))
-                        if (info.on_hover)
-                            info.on_hover(std::ref(info));
+                case MouseButton::RIGHT:
+                    if (info.on_menu)
+                        info.on_menu(std::ref(info));
                     break;
                 default:
                     break;
                 }
-            });
+                break;
+            case MouseEventKind::MOVED:
+                if (info.on_hover)
+                    info.on_hover(std::ref(info));
+                break;
+            default:
+                break;
+            }
+        });
+    }
 
-        std::vector<std::string> lines;
-        // Split lines
-        for (size_t start = 0, i = 0; i <= info.text.size(); i++) {
-            if (i == info.text.size() || info.text[i] == '\n') {
-                auto line = info.text.substr(start, i - start);
-                if (info.wrap)
-                    for (size_t i = 0; i < line.size(); i += info.size.width)
-                        lines.push_back(line.substr(i, info.size.width));
-                else
-                    lines.push_back(std::move(line));
-                start = i + 1;
+    // Texts shorter than this are laid out every frame in the frame arena, as hashing them costs about as much
+    static constexpr size_t LAYOUT_CACHE_MIN_SIZE = 256;
+
+    // Breaks a text of size units into lines of at most width columns if wrap is set, decode reads the character at an offset.
+    // With word_wrap the lines break at the spaces between words, which are dropped, and a word longer than a line
+    // breaks anywhere. A final newline ends the last line instead of starting an empty one
+    template<typename Lines, typename Decode>
+    static void layout_text(Lines &lines, const size_t size, Decode &&decode, const size_t width, bool wrap, const bool word_wrap) {
+        wrap = wrap && width > 0;
+        size_t start = 0, col = 0;                    // Current line
+        size_t word_end = 0, word_end_col = 0;        // Start of the last run of spaces of the line
+        size_t word_start = 0, word_start_col = 0;    // Word after that run
+        bool in_spaces = false, can_break = false, skip_spaces = false;
+        wchar_t last = 0;
+        for (size_t pos = 0; pos < size;) {
+            wchar_t wc;
+            const size_t len = decode(pos, wc);
+            if (wc == L'\n') {
+                lines.push_back({.start = start, .end = pos, .width = col});
+                pos += len;
+                start = pos;
+                col = 0;
+                in_spaces = can_break = skip_spaces = false;
+                last = 0;
+                continue;
+            }
+
+            const size_t w = internal::unicode::joins_cluster(last, wc) ? 0 : internal::unicode::char_width(wc);
+            last = wc;
+            if (word_wrap && wc == L' ') {
+                // The spaces after a line break are dropped
+                if (skip_spaces) {
+                    pos += len;
+                    start = pos;
+                    continue;
+                }
+                if (!in_spaces) {
+                    in_spaces = true;
+                    word_end = pos;
+                    word_end_col = col;
+                }
+                if (wrap && col + w > width && col > 0) {
+                    if (word_end_col > 0) {
+                        lines.push_back({.start = start, .end = word_end, .width = word_end_col});
+                        pos += len;
+                        start = pos;
+                        col = 0;
+                        in_spaces = can_break = false;
+                        skip_spaces = true;
+                        continue;
+                    }
+                    // Indentation wider than the line
+                    lines.push_back({.start = start, .end = pos, .width = col});
+                    start = word_end = pos;
+                    col = 0;
+                }
+            } else {
+                if (in_spaces) {
+                    in_spaces = false;
+                    can_break = word_end_col > 0;
+                    word_start = pos;
+                    word_start_col = col;
+                }
+                skip_spaces = false;
+                if (wrap && w > 0 && col + w > width && col > 0) {
+                    // Move the current word to the next line, then break it if it is too long on its own
+                    if (can_break) {
+                        lines.push_back({.start = start, .end = word_end, .width = word_end_col});
+                        start = word_start;
+                        col -= word_start_col;
+                        can_break = false;
+                    }
+                    if (col + w > width && col > 0) {
+                        lines.push_back({.start = start, .end = pos, .width = col});
+                        start = pos;
+                        col = 0;
+                    }
+                }
             }
+            col += w;
+            pos += len;
         }
+        if (start < size)
+            lines.push_back({.start = start, .end = size, .width = col});
+    }
 
-        BeginPane(state, info.pos, info.size);
+    // Mixes value into hash with the finalizer of splitmix64
+    static uint64_t mix_hash(uint64_t hash, const uint64_t value) {
+        hash ^= value + 0x9E3779B97F4A7C15ull;
+        hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ull;
+        hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBull;
+        return hash ^ (hash >> 31);
+    }
 
-        switch (info.align) {
-        case Align::TOP_LEFT:
-            for (size_t row = 0; row < info.size.height; row++)
-                if (row < lines.size()) {
-                    const auto &line = lines[row];
-                    for (size_t col = 0; col < info.size.width; col++)
-                        if (col < line.size())
-                            state.impl->set_cell(col, row, line[col], info.style);
-                        else
-                            state.impl->set_cell(col, row, ' ', info.style);
-                } else
-                    for (size_t col = 0; col < info.size.width; col++)
-                        state.impl->set_cell(col, row, ' ', info.style);
-            break;
-        case Align::TOP:
-            for (size_t row = 0; row < info.size.height; row++)
-                if (row < lines.size()) {
-                    const auto &line = lines[row];
-                    const auto col_start = (info.size.width - line.size()) / 2;
-                    const auto col_end = col_start + line.size();
-                    for (size_t col = 0; col < info.size.width; col++)
-                        if (col_start <= col && col < col_end)
-                            state.impl->set_cell(col, row, line[col - col_start], info.style);
-                        else
-                            state.impl->set_cell(col, row, ' ', info.style);
-                } else
-                    for (size_t col = 0; col < info.size.width; col++)
-                        state.impl->set_cell(col, row, ' ', info.style);
-            break;
-        case Align::TOP_RIGHT:
-            for (size_t row = 0; row < info.size.height; row++)
-                if (row < lines.size()) {
-                    const auto &line = lines[row];
-                    const auto col_start = info.size.width - line.size();
-                    const auto col_end = info.size.width;
-                    for (size_t col = 0; col < info.size.width; col++)
-                        if (col_start <= col && col < col_end)
-                            state.impl->set_cell(col, row, line[col - col_start], info.style);
-                        else
-                            state.impl->set_cell(col, row, ' ', info.style);
-                } else
-                    for (size_t col = 0; col < info.size.width; col++)
-                        state.impl->set_cell(col, row, ' ', info.style);
-            break;
-        case Align::LEFT:
-            for (size_t row = 0; row < info.size.height; row++) {
-                const auto row_start = (info.size.height - lines.size()) / 2;
-                const auto row_end = row_start + lines.size();
-                if (row_start <= row && row < row_end) {
-                    const auto &line = lines[row - row_start];
-                    for (size_t col = 0; col < info.size.width; col++)
-                        if (col < line.size())
-                            state.impl->set_cell(col, row, line[col], info.style);
-                        else
-                            state.impl->set_cell(col, row, ' ', info.style);
-                } else
-                    for (size_t col = 0; col < info.size.width; col++)
-                        state.impl->set_cell(col, row, ' ', info.style);
+    // Returns the lines of text laid out for a text box of width columns.
+    // A long text is looked up in the layout cache, a short one is laid out into buffer
+    template<typename Text, typename Decode>
+    static std::span<const internal::TextLine> layout_text_box(State &state, const Text text, const uint64_t kind, Decode &&decode, const size_t width,
+                                                               const bool wrap, const bool word_wrap, std::pmr::vector<internal::TextLine> &buffer) {
+        // A line of ASCII text which fits needs no layout, like most labels and table cells
+        if constexpr (std::is_same_v<Text, std::string_view>) {
+            if ((!wrap || text.size() <= width) && internal::utf8::ascii_run(text) == text.size() && text.find('\n') == std::string_view::npos) {
+                if (!text.empty())
+                    buffer.push_back({.start = 0, .end = text.size(), .width = text.size()});
+                return buffer;
             }
-            break;
+        }
+        if (text.size() < LAYOUT_CACHE_MIN_SIZE) {
+            layout_text(buffer, text.size(), decode, width, wrap, word_wrap);
+            return buffer;
+        }
+
+        uint64_t hash;
+        if constexpr (std::is_same_v<Text, std::string_view>)
+            hash = std::hash<std::string_view>{}(text);
+        else {
+            // FNV-1a over the characters, the styles do not change the layout
+            hash = 0xCBF29CE484222325ull;
+            for (const StyledChar &st_char: text)
+                hash = (hash ^ static_cast<uint32_t>(st_char.value)) * 0x100000001B3ull;
+        }
+        // The width only matters for wrapped text, so resizing a box of unwrapped text keeps its layout
+        uint64_t key = mix_hash(hash, text.size());
+        key = mix_hash(key, kind << 2 | wrap << 1 | word_wrap);
+        key = mix_hash(key, wrap ? width : 0);
+        if (key == 0)
+            key = 1;
+        return state.impl->layout_cache.find(key, [&](std::vector<internal::TextLine> &lines) {
+            layout_text(lines, text.size(), decode, width, wrap, word_wrap);
+        });
+    }
+
+    // Draws the lines of a text box aligned in the current pane and fills the rest with blanks of style.
+    // draw_line draws the characters of a line from a column and returns the column after them
+    template<typename DrawLine>
+    static void draw_text_lines(State &state, const std::span<const internal::TextLine> lines, const Size size, const Align align,
+                                const Style style, DrawLine &&draw_line) {
+        const size_t free_rows = saturated_sub(size.height, lines.size());
+        size_t row_offset = 0;
+        switch (align) {
+        case Align::LEFT:
         case Align::CENTER:
-            for (size_t row = 0; row < info.size.height; row++) {
-                const auto row_start = (info.size.height - lines.size()) / 2;
-                const auto row_end = row_start + lines.size();
-                if (row_start <= row && row < row_end) {
-                    const auto &line = lines[row - row_start];
-                    const auto col_start = (info.size.width - line.size()) / 2;
-                    const auto col_end = col_start + line.size();
-                    for (size_t col = 0; col < info.size.width; col++)
-                        if (col_start <= col && col < col_end)
-                            state.impl->set_cell(col, row, line[col - col_start], info.style);
-                        else
-                            state.impl->set_cell(col, row, ' ', info.style);
-                } else
-                    for (size_t col = 0; col < info.size.width; col++)
-                        state.impl->set_cell(col, row, ' ', info.style);
-            }
-            break;
         case Align::RIGHT:
-            for (size_t row = 0; row < info.size.height; row++) {
-                const auto row_start = (info.size.height - lines.size()) / 2;
-                const auto row_end = row_start + lines.size();
-                if (row_start <= row && row < row_end) {
-                    const auto &line = lines[row - row_start];
-                    const auto col_start = info.size.width - line.size();
-                    const auto col_end = info.size.width;
-                    for (size_t col = 0; col < info.size.width; col++)
-                        if (col_start <= col && col < col_end)
-                            state.impl->set_cell(col, row, line[col - col_start], info.style);
-                        else
-                            state.impl->set_cell(col, row, ' ', info.style);
-                } else
-                    for (size_t col = 0; col < info.size.width; col++)
-                        state.impl->set_cell(col, row, ' ', info.style);
-            }
+            row_offset = free_rows / 2;
             break;
         case Align::BOTTOM_LEFT:
-            for (size_t row = 0; row < info.size.height; row++) {
-                const auto row_start = info.size.height - lines.size();
-                const auto row_end = info.size.height;
-                if (row_start <= row && row < row_end) {
-                    const auto &line = lines[row - row_start];
-                    for (size_t col = 0; col < info.size.width; col++)
-                        if (col < line.size())
-                            state.impl->set_cell(col, row, line[col], info.style);
-                        else
-                            state.impl->set_cell(col, row, ' ', info.style);
-                } else
-                    for (size_t col = 0; col < info.size.width; col++)
-                        state.impl->set_cell(col, row, ' ', info.style);
-            }
-            break;
         case Align::BOTTOM:
-            for (size_t row = 0; row < info.size.height; row++) {
-                const auto row_start = info.size.height - lines.size();
-                const auto row_end = info.size.height;
-                if (row_start <= row && row < row_end) {
-                    const auto &line = lines[row - row_start];
-                    const auto col_start = (info.size.width - line.size()) / 2;
-                    const auto col_end = col_start + line.size();
-                    for (size_t col = 0; col < info.size.width; col++)
-                        if (col_start <= col && col < col_end)
-                            state.impl->set_cell(col, row, line[col - col_start], info.style);
-                        else
-                            state.impl->set_cell(col, row, ' ', info.style);
-                } else
-                    for (size_t col = 0; col < info.size.width; col++)
-                        state.impl->set_cell(col, row, ' ', info.style);
-            }
-            break;
         case Align::BOTTOM_RIGHT:
-            for (size_t row = 0; row < info.size.height; row++) {
-                const auto row_start = info.size.height - lines.size();
-                const auto row_end = info.size.height;
-                if (row_start <= row && row < row_end) {
-                    const auto &line = lines[row - row_start];
-                    const auto col_start = info.size.width - line.size();
-                    const auto col_end = info.size.width;
-                    for (size_t col = 0; col < info.size.width; col++)
-                        if (col_start <= col && col < col_end)
-                            state.impl->set_cell(col, row, line[col - col_start], info.style);
-                        else
-                            state.impl->set_cell(col, row, ' ', info.style);
-                } else
-                    for (size_t col = 0; col < info.size.width; col++)
-                        state.impl->set_cell(col, row, ' ', info.style);
-            }
+            row_offset = free_rows;
+            break;
+        default:
             break;
         }
 
-        EndPane(state);
-    }
-
-    void RichTextBox(State &state, RichTextBoxInfo info) {
-        for (const auto &event: state.impl->events)
-            HandleEvent(event, [&](const MouseEvent &ev) {
-                switch (ev.kind) {
-                case MouseEventKind::CLICK:
-                case MouseEventKind::DOUBLE_CLICK:
-                    if (!internal::StaticBox(info.pos, info.size).contains(ev.pos - GetPanePosition(state)))
-                        break;
-                    switch (ev.button) {
-                    case MouseButton::LEFT:
-                        if (ev.kind == MouseEventKind::DOUBLE_CLICK) {
-                            if (info.on_click2)
-                                info.on_click2(std::ref(info));
-                            else if (info.on_click)
-                                info.on_click(std::ref(info));
-                        }
-                        break;
-                    case MouseButton::RIGHT:
-                        if (info.on_menu)
-                            info.on_menu(std::ref(info));
-                        break;
-                    default:
-                        break;
-                    }
+        for (size_t row = 0; row < size.height; row++) {
+            size_t col = 0;
+            if (row_offset <= row && row - row_offset < lines.size()) {
+                const internal::TextLine &line = lines[row - row_offset];
+                const size_t free_cols = saturated_sub(size.width, line.width);
+                size_t col_offset = 0;
+                switch (align) {
+                case Align::TOP:
+                case Align::CENTER:
+                case Align::BOTTOM:
+                    col_offset = free_cols / 2;
                     break;
-                case MouseEventKind::MOVED:
-                    if (internal::StaticBox(info.pos, info.size).contains(ev.pos - GetPanePosition(state)))
-                        if (info.on_hover)
-                            info.on_hover(std::ref(info));
+                case Align::TOP_RIGHT:
+                case Align::RIGHT:
+                case Align::BOTTOM_RIGHT:
+                    col_offset = free_cols;
                     break;
                 default:
                     break;
                 }
-            });
-
-        std::vector<std::vector<StyledChar>> lines;
-        for (size_t start = 0, i = 0; i <= info.text.size(); i++) {
-            if (i == info.text.size() || info.text[i].value == '\n') {
-                if (start == i) {
-                    if (i != info.text.size())
-                        lines.emplace_back();
-                } else {
-                    std::vector<StyledChar> line(info.text.begin() + start, info.text.begin() + i);
-                    if (info.wrap) {
-                        for (size_t i = 0; i < line.size(); i += info.size.width)
-                            lines.emplace_back(line.begin() + i, line.begin() + std::min(line.size(), i + info.size.width));
-                    } else
-                        lines.push_back(std::move(line));
-                }
-                start = i + 1;
+                for (; col < col_offset; col++)
+                    state.impl->set_cell(col, row, ' ', style);
+                col = draw_line(line, col, row);
             }
+            for (; col < size.width; col++)
+                state.impl->set_cell(col, row, ' ', style);
         }
+    }
 
-        BeginPane(state, info.pos, info.size);
+    // Draws a TextBox or a TextBoxView
+    template<typename Info>
+    static void draw_text_box(State &state, Info &info) {
+        handle_text_box_hits(state, info);
 
-        switch (info.align) {
-        case Align::TOP_LEFT:
-            for (size_t row = 0; row < info.size.height; row++)
-                if (row < lines.size()) {
-                    const auto &line = lines[row];
-                    for (size_t col = 0; col < info.size.width; col++)
-                        if (col < line.size())
-                            state.impl->set_cell(col, row, line[col]);
-                        else
-                            state.impl->set_cell(col, row, ' ', info.style);
-                } else
-                    for (size_t col = 0; col < info.size.width; col++)
-                        state.impl->set_cell(col, row, ' ', info.style);
-            break;
-        case Align::TOP:
-            for (size_t row = 0; row < info.size.height; row++)
-                if (row < lines.size()) {
-                    const auto &line = lines[row];
-                    const auto col_start = (info.size.width - line.size()) / 2;
-                    const auto col_end = col_start + line.size();
-                    for (size_t col = 0; col < info.size.width; col++)
-                        if (col_start <= col && col < col_end)
-                            state.impl->set_cell(col, row, line[col - col_start]);
-                        else
-                            state.impl->set_cell(col, row, ' ', info.style);
-                } else
-                    for (size_t col = 0; col < info.size.width; col++)
-                        state.impl->set_cell(col, row, ' ', info.style);
-            break;
-        case Align::TOP_RIGHT:
-            for (size_t row = 0; row < info.size.height; row++)
-                if (row < lines.size()) {
-                    const auto &line = lines[row];
-                    const auto col_start = info.size.width - line.size();
-                    const auto col_end = info.size.width;
-                    for (size_t col = 0; col < info.size.width; col++)
-                        if (col_start <= col && col < col_end)
-                            state.impl->set_cell(col, row, line[col - col_start]);
-                        else
-                            state.impl->set_cell(col, row, ' ', info.style);
-                } else
-                    for (size_t col = 0; col < info.size.width; col++)
-                        state.impl->set_cell(col, row, ' ', info.style);
-            break;
-        case Align::LEFT:
-            for (size_t row = 0; row < info.size.height; row++) {
-                const auto row_start = (info.size.height - lines.size()) / 2;
-                const auto row_end = row_start + lines.size();
-                if (row_start <= row && row < row_end) {
-                    const auto &line = lines[row - row_start];
-                    for (size_t col = 0; col < info.size.width; col++)
-                        if (col < line.size())
-                            state.impl->set_cell(col, row, line[col]);
-                        else
-                            state.impl->set_cell(col, row, ' ', info.style);
-                } else
-                    for (size_t col = 0; col < info.size.width; col++)
-                        state.impl->set_cell(col, row, ' ', info.style);
-            }
-            break;
-        case Align::CENTER:
-            for (size_t row = 0; row < info.size.height; row++) {
-                const auto row_start = (info.size.height - lines.size()) / 2;
-                const auto row_end = row_start + lines.size();
-                if (row_start <= row && row < row_end) {
-                    const auto &line = lines[row - row_start];
-                    const auto col_start = (info.size.width - line.size()) / 2;
-                    const auto col_end = col_start + line.size();
-                    for (size_t col = 0; col < info.size.width; col++)
-                        if (col_start <= col && col < col_end)
-                            state.impl->set_cell(col, row, line[col - col_start]);
-                        else
-                            state.impl->set_cell(col, row, ' ', info.style);
-                } else
-                    for (size_t col = 0; col < info.size.width; col++)
-                        state.impl->set_cell(col, row, ' ', info.style);
-            }
-            break;
-        case Align::RIGHT:
-            for (size_t row = 0; row < info.size.height; row++) {
-                const auto row_start = (info.size.height - lines.size()) / 2;
-                const auto row_end = row_start + lines.size();
-                if (row_start <= row && row < row_end) {
-                    const auto &line = lines[row - row_start];
-                    const auto col_start = info.size.width - line.size();
-                    const auto col_end = info.size.width;
-                    for (size_t col = 0; col < info.size.width; col++)
-                        if (col_start <= col && col < col_end)
-                            state.impl->set_cell(col, row, line[col - col_start]);
-                        else
-                            state.impl->set_cell(col, row, ' ', info.style);
-                } else
-                    for (size_t col = 0; col < info.size.width; col++)
-                        state.impl->set_cell(col, row, ' ', info.style);
-            }
-            break;
-        case Align::BOTTOM_LEFT:
-            for (size_t row = 0; row < info.size.height; row++) {
-                const auto row_start = info.size.height - lines.size();
-                const auto row_end = info.size.height;
-                if (row_start <= row && row < row_end) {
-                    const auto &line = lines[row - row_start];
-                    for (size_t col = 0; col < info.size.width; col++)
-                        if (col < line.size())
-                            state.impl->set_cell(col, row, line[col]);
-                        else
-                            state.impl->set_cell(col, row, ' ', info.style);
-                } else
-                    for (size_t col = 0; col < info.size.width; col++)
-                        state.impl->set_cell(col, row, ' ', info.style);
-            }
-            break;
-        case Align::BOTTOM:
-            for (size_t row = 0; row < info.size.height; row++) {
-                const auto row_start = info.size.height - lines.size();
-                const auto row_end = info.size.height;
-                if (row_start <= row && row < row_end) {
-                    const auto &line = lines[row - row_start];
-                    const auto col_start = (info.size.width - line.size()) / 2;
-                    const auto col_end = col_start + line.size();
-                    for (size_t col = 0; col < info.size.width; col++)
-                        if (col_start <= col && col < col_end)
-                            state.impl->set_cell(col, row, line[col - col_start]);
-                        else
-                            state.impl->set_cell(col, row, ' ', info.style);
-                } else
-                    for (size_t col = 0; col < info.size.width; col++)
-                        state.impl->set_cell(col, row, ' ', info.style);
-            }
-            break;
-        case Align::BOTTOM_RIGHT:
-            for (size_t row = 0; row < info.size.height; row++) {
-                const auto row_start = info.size.height - lines.size();
-                const auto row_end = info.size.height;
-                if (row_start <= row && row < row_end) {
-                    const auto &line = lines[row - row_start];
-                    const auto col_start = info.size.width - line.size();
-                    const auto col_end = info.size.width;
-                    for (size_t col = 0; col < info.size.width; col++)
-                        if (col_start <= col && col < col_end)
-                            state.impl->set_cell(col, row, line[col - col_start]);
-                        else
-                            state.impl->set_cell(col, row, ' ', info.style);
-                } else
-                    for (size_t col = 0; col < info.size.width; col++)
-                        state.impl->set_cell(col, row, ' ', info.style);
+        const std::string_view text = info.text;
+        const auto decode = [&](const size_t pos, wchar_t &wc) { return decode_char(text, pos, wc); };
+        std::pmr::vector<internal::TextLine> buffer(GetFrameAllocator(state));
+        const auto lines = layout_text_box(state, text, 0, decode, info.size.width, info.wrap, info.word_wrap, buffer);
+
+        BeginPane(state, info.pos, info.size);
+        draw_text_lines(state, lines, info.size, info.align, info.style, [&](const internal::TextLine &line, size_t col, const size_t row) {
+            for (size_t i = line.start; i < line.end && col < info.size.width;) {
+                const unsigned char byte = text[i];
+                if (byte != 0 && byte < 0x80) {
+                    col += state.impl->set_cell(col, row, byte, info.style);
+                    i++;
+                    continue;
+                }
+                wchar_t wc;
+                i += decode_char(text, i, wc);
+                col += state.impl->set_cell(col, row, wc, info.style);
             }
-            break;
-        }
+            return col;
+        });
+        EndPane(state);
+    }
 
+    void TextBox(State &state, TextBoxInfo info) {
+        draw_text_box(state, info);
+    }
+
+    void TextBoxView(State &state, TextBoxViewInfo info) {
+        draw_text_box(state, info);
+    }
+
+    // Draws text as the content of a RichTextBox or a RichTextBoxView, the text is not necessarily the one of the info
+    template<typename Info>
+    static void draw_rich_text_box(State &state, const std::span<const StyledChar> text, const Info &info) {
+        const auto decode = [&](const size_t pos, wchar_t &wc) {
+            wc = text[pos].value;
+            return size_t(1);
+        };
+        std::pmr::vector<internal::TextLine> buffer(GetFrameAllocator(state));
+        const auto lines = layout_text_box(state, text, 1, decode, info.size.width, info.wrap, info.word_wrap, buffer);
+
+        BeginPane(state, info.pos, info.size);
+        draw_text_lines(state, lines, info.size, info.align, info.style, [&](const internal::TextLine &line, size_t col, const size_t row) {
+            for (size_t i = line.start; i < line.end && col < info.size.width; i++)
+                col += state.impl->set_cell(col, row, text[i]);
+            return col;
+        });
         EndPane(state);
     }
 
+    void RichTextBox(State &state, RichTextBoxInfo info) {
+        handle_text_box_hits(state, info);
+        draw_rich_text_box(state, info.text, info);
+    }
+
+    void RichTextBoxView(State &state, RichTextBoxViewInfo info) {
+        handle_text_box_hits(state, info);
+        draw_rich_text_box(state, info.text, info);
+    }
+
     void ProgressBar(State &state, ProgressBarInfo info) {
-        for (const auto &event: state.impl->events)
-            HandleEvent(event, [&](const MouseEvent &ev) {
-                switch (ev.kind) {
-                case MouseEventKind::CLICK:
-                case MouseEventKind::DOUBLE_CLICK:
-                    if (!internal::StaticBox(info.pos, Size{.width = info.length, .height = 1}).contains(ev.pos - GetPanePosition(state)))
-                        break;
-                    switch (ev.button) {
-                    case MouseButton::LEFT:
-                        if (ev.kind == MouseEventKind::DOUBLE_CLICK) {
-                            if (info.on_click2)
-                                info.on_click2(std::ref(info));
-                            else if (info.on_click)
-                                info.on_click(std::ref(info));
-                        }
-                        break;
-                    case MouseButton::RIGHT:
-                        if (info.on_menu)
-                            info.on_menu(std::ref(info));
-                        break;
-                    default:
-                        break;
+        const uint32_t hit_id = state.impl->push_hit_rect(info.pos, Size{.width = info.length, .height = 1});
+        state.impl->for_each_hit(hit_id, [&](const MouseEvent &ev) {
+            switch (ev.kind) {
+            case MouseEventKind::CLICK:
+            case MouseEventKind::DOUBLE_CLICK:
+                switch (ev.button) {
+                case MouseButton::LEFT:
+                    if (ev.kind == MouseEventKind::DOUBLE_CLICK) {
+                        if (info.on_click2)
+                            info.on_click2(std::ref(info));
+                        else if (info.on_click)
+                            info.on_click(std::ref(info));
                     }
                     break;
-                case MouseEventKind::MOVED:
-                    if (internal::StaticBox(info.pos, Size{.width = info.length, .height = 1}).contains(ev.pos - GetPanePosition(state)))
-                        if (info.on_hover)
-                            info.on_hover(std::ref(info));
+                case MouseButton::RIGHT:
+                    if (info.on_menu)
+                        info.on_menu(std::ref(info));
                     break;
                 default:
                     break;
                 }
-            });
+                break;
+            case MouseEventKind::MOVED:
+                if (info.on_hover)
+                    info.on_hover(std::ref(info));
+                break;
+            default:
+                break;
+            }
+        });
 
         double value = info.value;
         if (value < 0)
@@ -1890,7 +2890,9 @@ namespace nite
             state.impl->set_cell(info.pos.col + col, info.pos.row, ' ', info.style);
     }
 
-    Size SimpleTable(State &state, SimpleTableInfo info) {
+    // Draws a SimpleTable or a SimpleTableView, the cells are drawn as views into the data
+    template<typename Info>
+    static Size draw_simple_table(State &state, const Info &info) {
         Style header_style1 = info.header_style;
         Style header_style2;
         header_style2.bg = Color::from_hex(saturated_add(header_style1.bg.get_hex(), 0x151515u));
@@ -1904,11 +2906,11 @@ namespace nite
         table_style2.mode = table_style1.mode;
 
         size_t total_width = 0;
-        std::vector<size_t> max_col_widths(info.num_cols);
+        std::pmr::vector<size_t> max_col_widths(info.num_cols, GetFrameAllocator(state));
         for (size_t col = 0; col < info.num_cols; col++) {
             size_t max = 0;
             for (size_t row = 0; row < info.num_rows; row++) {
-                const auto &cell_text = (row * info.num_cols + col) >= info.data.size() ? "" : info.data[row * info.num_cols + col];
+                const std::string_view cell_text = (row * info.num_cols + col) >= info.data.size() ? std::string_view() : info.data[row * info.num_cols + col];
                 if (cell_text.size() + 1 >= max)
                     max = cell_text.size() + 1;
             }
@@ -1983,7 +2985,7 @@ namespace nite
                 state.impl->set_cell(0, y, info.border.vertical.value, info.border.vertical.style);
                 size_t x = 1;
                 for (size_t col = 0; col < info.num_cols; col++) {
-                    const auto &cell_text = (row * info.num_cols + col) >= info.data.size() ? "" : info.data[row * info.num_cols + col];
+                    const std::string_view cell_text = (row * info.num_cols + col) >= info.data.size() ? std::string_view() : info.data[row * info.num_cols + col];
                     Style style;
                     if (info.include_header_row) {
                         if (row == 0)
@@ -1993,7 +2995,7 @@ namespace nite
                     } else
                         style = (row + col) % 2 == 0 ? table_style2 : table_style1;
                     // clang-format off
-                    TextBox(state, {
+                    TextBoxView(state, {
                         .text = cell_text,
                         .pos = {.x = x, .y = y},
                         .size = {.width = max_col_widths[col], .height = 1},
@@ -2020,7 +3022,7 @@ namespace nite
             for (size_t row = 0; row < info.num_rows; row++) {
                 size_t x = 0;
                 for (size_t col = 0; col < info.num_cols; col++) {
-                    const auto &cell_text = (row * info.num_cols + col) >= info.data.size() ? "" : info.data[row * info.num_cols + col];
+                    const std::string_view cell_text = (row * info.num_cols + col) >= info.data.size() ? std::string_view() : info.data[row * info.num_cols + col];
                     Style style;
                     if (info.include_header_row) {
                         if (row == 0)
@@ -2030,7 +3032,7 @@ namespace nite
                     } else
                         style = (row + col) % 2 == 0 ? table_style2 : table_style1;
                     // clang-format off
-                    TextBox(state, {
+                    TextBoxView(state, {
                         .text = cell_text,
                         .pos = {.x = x, .y = y},
                         .size = {.width = max_col_widths[col], .height = 1},
@@ -2046,606 +3048,2604 @@ namespace nite
         }
     }
 
-    static void format_styled_text(std::vector<StyledChar> &list, const char c, const Style style) {
-        std::string str;
-        switch (c) {
-        case '\x00':
-            str = "<NUL>";
-            break;
-        case '\x01':
-            str = "<SOH>";
-            break;
-        case '\x02':
-            str = "<STX>";
-            break;
-        case '\x03':
-            str = "<ETX>";
-            break;
-        case '\x04':
-            str = "<EOT>";
-            break;
-        case '\x05':
-            str = "<ENQ>";
-            break;
-        case '\x06':
-            str = "<ACK>";
-            break;
-        case '\x07':
-            str = "<BEL>";
-            break;
-        case '\x08':
-            str = "<BS>";
-            break;
-        case '\x09':    // horizontal tab
-            str = "    ";
-            break;
-        case '\x0B':
-            str = "<VT>";
-            break;
-        case '\x0C':
-            str = "<FF>";
-            break;
-        case '\x0D':
-            str = "<CR>";
-            break;
-        case '\x0E':
-            str = "<SO>";
-            break;
-        case '\x0F':
-            str = "<SI>";
-            break;
-        case '\x10':
-            str = "<DLE>";
-            break;
-        case '\x11':
-            str = "<DC1>";
-            break;
-        case '\x12':
-            str = "<DC2>";
-            break;
-        case '\x13':
-            str = "<DC3>";
-            break;
-        case '\x14':
-            str = "<DC4>";
-            break;
-        case '\x15':
-            str = "<NAK>";
-            break;
-        case '\x16':
-            str = "<SYN>";
-            break;
-        case '\x17':
-            str = "<ETB>";
-            break;
-        case '\x18':
-            str = "<CAN>";
-            break;
-        case '\x19':
-            str = "<EM>";
-            break;
-        case '\x1A':
-            str = "<SUB>";
-            break;
-        case '\x1B':
-            str = "<ESC>";
-            break;
-        case '\x1C':
-            str = "<FS>";
-            break;
-        case '\x1D':
-            str = "<GS>";
-            break;
-        case '\x1E':
-            str = "<RS>";
-            break;
-        case '\x1F':
-            str = "<US>";
-            break;
-        case '\x7F':
-            str = "<DEL>";
-            break;
-        default:
-            str = c;
-            break;
-        }
-        for (char c: str)
-            list.push_back(StyledChar{.value = c_to_wc(c), .style = style});
+    Size SimpleTable(State &state, SimpleTableInfo info) {
+        return draw_simple_table(state, info);
     }
 
-    std::vector<StyledChar> TextInputState::process(
-            const Style text_style, const Style selection_style, const Style cursor_style, const Style cursor_style_ins, const Style cursor_style_sel
-    ) {
-        std::vector<StyledChar> result;
+    Size SimpleTableView(State &state, SimpleTableViewInfo info) {
+        return draw_simple_table(state, info);
+    }
 
-        const auto [selection_start, selection_end] = get_selection_range();
-        const Style cur_style = selection_mode ? cursor_style_sel : insert_mode ? cursor_style_ins : cursor_style;
+    // Draws text in a single row of the current pane clipped and padded to width
+    static void draw_grid_cell(State &state, const size_t col, const size_t row, const size_t width, const std::string_view text, const Style style) {
+        size_t x = 0;
+        wchar_t wc;
+        for (size_t i = 0; i < text.size() && x < width;) {
+            i += decode_char(text, i, wc);
+            if (wc == L'\n' || wc == L'\t' || wc == L'\r')
+                wc = L' ';
+            // A wide glyph that does not fit would spill into the next column
+            if (x + internal::unicode::char_width(wc) > width)
+                break;
+            x += state.impl->set_cell(col + x, row, wc, style);
+        }
+        for (; x < width; x++)
+            state.impl->set_cell(col + x, row, ' ', style);
+    }
 
-        for (size_t i = 0; i <= data.size(); i++) {
-            if (i == cursor) {
-                if (i == data.size() || data[i] == '\n')
-                    result.push_back(StyledChar{.value = ' ', .style = cur_style});
-                if (i < data.size())
-                    format_styled_text(result, data[i], cur_style);
-            } else if (i < data.size()) {
-                if (selection_mode && selection_start <= i && i < selection_end)
-                    format_styled_text(result, data[i], selection_style);
-                else
-                    format_styled_text(result, data[i], text_style);
-            }
+    void DataGridState::measure(const GridDataSource &source) {
+        const size_t num_cols = source.num_cols();
+        const size_t num_rows = source.num_rows();
+
+        // Measure everything again only if the existing data may have changed
+        if (measured_source != &source || measured_revision != source.revision() || col_widths.size() != num_cols || measured_rows > num_rows) {
+            measured_source = &source;
+            measured_revision = source.revision();
+            measured_rows = 0;
+            col_widths.assign(num_cols, 0);
+            for (size_t col = 0; col < num_cols; col++)
+                col_widths[col] = text_width(source.header(col)) + 1;
         }
 
-        return result;
+        // Then measure only the rows appended since the last call
+        for (size_t col = 0; col < num_cols; col++) {
+            size_t max = col_widths[col];
+            for (size_t row = measured_rows; row < num_rows; row++)
+                max = std::max(max, text_width(source.cell(col, row)) + 1);
+            col_widths[col] = max;
+        }
+        measured_rows = num_rows;
     }
 
-    void TextInput(State &state, TextInputState &text_state, TextInputInfo info) {
-        if (text_state.has_focus())
+    // Draws the grid assuming the column widths are already measured.
+    // The status text is drawn at the top right corner if it is not empty
+    static void draw_data_grid(
+            State &state, DataGridState &grid_state, const GridDataSource &source, const DataGridInfo &info, const std::string_view status
+    ) {
+        const size_t num_cols = source.num_cols();
+        const size_t num_rows = source.num_rows();
+        const size_t header_rows = info.show_header ? 1 : 0;
+        const size_t visible_rows = saturated_sub(info.size.height, header_rows);
+
+        int64_t row_delta = 0;
+        int64_t col_delta = 0;
+        const uint32_t hit_id = state.impl->push_hit_rect(info.pos, info.size);
+        state.impl->for_each_hit(hit_id, [&](const MouseEvent &ev) {
+            switch (ev.kind) {
+            case MouseEventKind::SCROLL_DOWN:
+                row_delta += info.scroll_factor * ev.count;
+                break;
+            case MouseEventKind::SCROLL_UP:
+                row_delta -= info.scroll_factor * ev.count;
+                break;
+            case MouseEventKind::SCROLL_LEFT:
+                col_delta -= ev.count;
+                break;
+            case MouseEventKind::SCROLL_RIGHT:
+                col_delta += ev.count;
+                break;
+            default:
+                break;
+            }
+        });
+        if (info.focus)
             for (const Event &event: state.impl->events) {
                 HandleEvent(event, [&](const KeyEvent &ev) {
-                    if (!ev.key_down)
+                    if (!ev.key_down || ev.modifiers != 0)
                         return;
+
                     switch (ev.key_code) {
-                    case KeyCode::ESCAPE:
-                        text_state.end_selection();
-                        break;
-                    case KeyCode::BACKSPACE:
-                        if (ev.modifiers == 0) {
-                            if (text_state.is_selected()) {
-                                text_state.erase_selection();
-                                text_state.end_selection();
-                            } else
-                                text_state.on_key_backspace();
-                        }
+                    case KeyCode::UP:
+                        row_delta--;
                         break;
-                    case KeyCode::DELETE:
-                        if (ev.modifiers == 0) {
-                            if (text_state.is_selected()) {
-                                text_state.erase_selection();
-                                text_state.end_selection();
-                            } else
-                                text_state.on_key_delete();
-                        }
+                    case KeyCode::DOWN:
+                        row_delta++;
                         break;
                     case KeyCode::LEFT:
-                        if (ev.modifiers == 0) {
-                            if (text_state.is_selected()) {
-                                const auto selection_start = text_state.get_selection_range().first;
-                                text_state.end_selection();
-                                text_state.set_cursor(selection_start);
-                            } else
-                                text_state.move_left();
-                        }
-                        if (ev.modifiers & KEY_SHIFT) {
-                            text_state.start_selection();
-                            text_state.move_left();
-                        }
+                        col_delta--;
                         break;
                     case KeyCode::RIGHT:
-                        if (ev.modifiers == 0) {
-                            if (text_state.is_selected()) {
-                                const auto selection_end = text_state.get_selection_range().second;
-                                text_state.end_selection();
-                                text_state.set_cursor(selection_end);
-                            } else
-                                text_state.move_right();
-                        }
-                        if (ev.modifiers & KEY_SHIFT) {
-                            text_state.start_selection();
-                            text_state.move_right();
-                        }
+                        col_delta++;
                         break;
-                    case KeyCode::HOME:
-                        if (ev.modifiers == 0) {
-                            if (text_state.is_selected())
-                                text_state.end_selection();
-                            text_state.go_home();
-                        }
-                        if (ev.modifiers & KEY_SHIFT) {
-                            text_state.start_selection();
-                            text_state.go_home();
-                        }
+                    case KeyCode::PAGE_UP:
+                        row_delta -= static_cast<int64_t>(std::max<size_t>(visible_rows, 1));
                         break;
-                    case KeyCode::END:
-                        if (ev.modifiers == 0) {
-                            if (text_state.is_selected())
-                                text_state.end_selection();
-                            text_state.go_end();
-                        }
-                        if (ev.modifiers & KEY_SHIFT) {
-                            text_state.start_selection();
-                            text_state.go_end();
-                        }
+                    case KeyCode::PAGE_DOWN:
+                        row_delta += static_cast<int64_t>(std::max<size_t>(visible_rows, 1));
                         break;
-                    case KeyCode::INSERT:
-                        if (ev.modifiers == 0)
-                            text_state.toggle_insert_mode();
+                    case KeyCode::HOME:
+                        row_delta = std::numeric_limits<int32_t>::min();
                         break;
-                    case KeyCode::ENTER:
-                        if (info.handle_enter_as_event) {
-                            if (info.on_enter)
-                                info.on_enter(std::ref(info));
-                        } else if (ev.modifiers == 0) {
-                            if (text_state.is_selected()) {
-                                text_state.erase_selection();
-                                text_state.end_selection();
-                            }
-                            text_state.insert_char('\n');
-                        }
+                    case KeyCode::END:
+                        row_delta = std::numeric_limits<int32_t>::max();
                         break;
                     default:
-                        if ((ev.modifiers == 0 || ev.modifiers & KEY_SHIFT) && std::isprint(ev.key_char)) {
-                            if (text_state.is_selected()) {
-                                text_state.erase_selection();
-                                text_state.end_selection();
-                            }
-                            text_state.insert_char(ev.key_char);
-                        }
                         break;
                     }
                 });
             }
 
-        // clang-format off
-        RichTextBox(state, {
-            .text = text_state.process(info.text_style, info.selection_style, info.cursor_style, info.cursor_style_ins, info.cursor_style_sel),
-            .pos = info.pos,
-            .size = info.size,
-            .style = info.text_style,
-            .wrap = info.wrap,
-            .align = info.align,
-        });
-        // clang-format on
-    }
+        // Apply the scroll and keep the last page filled
+        size_t row_offset = grid_state.get_row_offset();
+        if (row_delta > 0)
+            row_offset = saturated_add(row_offset, static_cast<size_t>(row_delta));
+        else if (row_delta < 0)
+            row_offset = saturated_sub(row_offset, static_cast<size_t>(-row_delta));
+        row_offset = std::min(row_offset, saturated_sub(num_rows, visible_rows));
+        grid_state.set_row_offset(row_offset);
+
+        size_t col_offset = grid_state.get_col_offset();
+        if (col_delta > 0)
+            col_offset = saturated_add(col_offset, static_cast<size_t>(col_delta));
+        else if (col_delta < 0)
+            col_offset = saturated_sub(col_offset, static_cast<size_t>(-col_delta));
+        col_offset = std::min(col_offset, saturated_sub(num_cols, static_cast<size_t>(1)));
+        grid_state.set_col_offset(col_offset);
 
-    void TextField(State &state, TextInputState &text_state, TextFieldInfo info) {
-        if (text_state.has_focus())
-            for (const Event &event: state.impl->events) {
-                HandleEvent(event, [&](const KeyEvent &ev) {
-                    if (!ev.key_down)
-                        return;
-                    switch (ev.key_code) {
-                    case KeyCode::ESCAPE:
-                        text_state.end_selection();
-                        break;
-                    case KeyCode::BACKSPACE:
-                        if (ev.modifiers == 0) {
-                            if (text_state.is_selected()) {
-                                text_state.erase_selection();
-                                text_state.end_selection();
-                            } else
-                                text_state.on_key_backspace();
-                        }
-                        break;
-                    case KeyCode::DELETE:
-                        if (ev.modifiers == 0) {
-                            if (text_state.is_selected()) {
-                                text_state.erase_selection();
-                                text_state.end_selection();
-                            } else
-                                text_state.on_key_delete();
-                        }
-                        break;
-                    case KeyCode::LEFT:
-                        if (ev.modifiers == 0) {
-                            if (text_state.is_selected()) {
-                                const auto selection_start = text_state.get_selection_range().first;
-                                text_state.end_selection();
-                                text_state.set_cursor(selection_start);
-                            } else
-                                text_state.move_left();
-                        }
-                        if (ev.modifiers & KEY_SHIFT) {
-                            text_state.start_selection();
-                            text_state.move_left();
-                        }
-                        break;
-                    case KeyCode::RIGHT:
-                        if (ev.modifiers == 0) {
-                            if (text_state.is_selected()) {
-                                const auto selection_end = text_state.get_selection_range().second;
-                                text_state.end_selection();
-                                text_state.set_cursor(selection_end);
-                            } else
-                                text_state.move_right();
-                        }
-                        if (ev.modifiers & KEY_SHIFT) {
-                            text_state.start_selection();
-                            text_state.move_right();
-                        }
-                        break;
-                    case KeyCode::HOME:
-                        if (ev.modifiers == 0) {
-                            if (text_state.is_selected())
-                                text_state.end_selection();
-                            text_state.go_home();
-                        }
-                        if (ev.modifiers & KEY_SHIFT) {
-                            text_state.start_selection();
-                            text_state.go_home();
-                        }
-                        break;
-                    case KeyCode::END:
-                        if (ev.modifiers == 0) {
-                            if (text_state.is_selected())
-                                text_state.end_selection();
-                            text_state.go_end();
-                        }
-                        if (ev.modifiers & KEY_SHIFT) {
-                            text_state.start_selection();
-                            text_state.go_end();
-                        }
-                        break;
-                    case KeyCode::INSERT:
-                        if (ev.modifiers == 0)
-                            text_state.toggle_insert_mode();
-                        break;
-                    case KeyCode::ENTER:
-                        if (text_state.is_selected())
-                            text_state.end_selection();
-                        if (info.on_enter)
-                            info.on_enter(std::ref(info));
-                        break;
-                    default:
-                        if ((ev.modifiers == 0 || ev.modifiers & KEY_SHIFT) && std::isprint(ev.key_char)) {
-                            if (text_state.is_selected()) {
-                                text_state.erase_selection();
-                                text_state.end_selection();
-                            }
-                            text_state.insert_char(ev.key_char);
-                        }
-                        break;
-                    }
-                });
+        Style header_style1 = info.header_style;
+        Style header_style2 = header_style1;
+        header_style2.bg = Color::from_hex(saturated_add(header_style1.bg.get_hex(), 0x151515u));
+
+        Style table_style1 = info.table_style;
+        Style table_style2 = table_style1;
+        table_style2.bg = Color::from_hex(saturated_add(table_style1.bg.get_hex(), 0x151515u));
+
+        BeginPane(state, info.pos, info.size);
+        {
+            // Draw column by column as the data is stored column wise,
+            // and touch only the visible cells
+            size_t x = 0;
+            for (size_t col = col_offset; col < num_cols && x < info.size.width; col++) {
+                const size_t width = std::min(grid_state.get_col_width(col), info.size.width - x);
+                if (info.show_header)
+                    draw_grid_cell(state, x, 0, width, source.header(col), col % 2 == 0 ? header_style2 : header_style1);
+                for (size_t i = 0; i < visible_rows; i++) {
+                    const size_t row = row_offset + i;
+                    if (row < num_rows)
+                        draw_grid_cell(state, x, header_rows + i, width, source.cell(col, row), (row + col) % 2 == 0 ? table_style2 : table_style1);
+                    else
+                        draw_grid_cell(state, x, header_rows + i, width, {}, table_style1);
+                }
+                x += width;
             }
 
-        // clang-format off
-        RichTextBox(state, {
-            .text = text_state.process(info.text_style, info.selection_style, info.cursor_style, info.cursor_style_ins, info.cursor_style_sel),
-            .pos = info.pos,
-            .size = {.width = info.width, .height = 1},
-            .style = info.text_style,
-            .align = info.align,
-        });
-        // clang-format on
-    }
+            // Clear the space right of the last column
+            if (x < info.size.width)
+                for (size_t y = 0; y < info.size.height; y++)
+                    draw_grid_cell(state, x, y, info.size.width - x, {}, y < header_rows ? header_style1 : table_style1);
 
-    std::vector<StyledChar> compute_check_box(CheckBoxValue &value, const CheckBoxInfo &info) {
-        std::vector<StyledChar> result;
-        switch (value) {
-        case CheckBoxValue::UNCHECKED:
-            result.push_back(info.check_box.unchecked);
-            result.push_back({' ', info.check_box.unchecked.style});
-            // result.push_back({' ', info.check_box.unchecked.style});
-            break;
-        case CheckBoxValue::CHECKED:
-            result.push_back(info.check_box.checked);
-            result.push_back({' ', info.check_box.checked.style});
-            // result.push_back({' ', info.check_box.checked.style});
-            break;
-        case CheckBoxValue::INDETERMINATE:
-            result.push_back(info.check_box.indeterm);
-            result.push_back({' ', info.check_box.indeterm.style});
-            // result.push_back({' ', info.check_box.indeterm.style});
-            break;
+            if (!status.empty() && info.size.height > 0) {
+                const size_t width = std::min(text_width(status), info.size.width);
+                Style status_style = info.show_header ? header_style1 : table_style1;
+                std::swap(status_style.bg, status_style.fg);
+                draw_grid_cell(state, info.size.width - width, 0, width, status, status_style);
+            }
         }
-        for (char c: info.text)
-            result.push_back(StyledChar{c_to_wc(c), info.style});
-        return result;
+        EndPane(state);
     }
 
-    void CheckBox(State &state, CheckBoxValue &value, CheckBoxInfo info) {
-        if (!info.allow_indeterm && value == CheckBoxValue::INDETERMINATE)
-            value = CheckBoxValue::UNCHECKED;
+    void DataGrid(State &state, DataGridState &grid_state, const GridDataSource &source, DataGridInfo info) {
+        grid_state.measure(source);
+        draw_data_grid(state, grid_state, source, info, {});
+    }
 
-        const auto click_action = [&]() {
-            switch (value) {
-            case CheckBoxValue::UNCHECKED:
-                value = CheckBoxValue::CHECKED;
-                break;
-            case CheckBoxValue::CHECKED:
-                value = info.allow_indeterm ? CheckBoxValue::INDETERMINATE : CheckBoxValue::UNCHECKED;
-                break;
-            case CheckBoxValue::INDETERMINATE:
-                value = CheckBoxValue::UNCHECKED;
-                break;
-            }
+    void DataGrid(State &state, DataGridState &grid_state, DataView &view, DataGridInfo info) {
+        view.update();
+        // Measure the snapshot rather than the view, so that sorting or
+        // filtering the view does not measure all the rows again
+        if (const auto source = view.get_source(); source)
+            grid_state.measure(*source);
+
+        if (view.is_busy()) {
+            const auto status = std::format(" {}% ", static_cast<int>(view.get_progress() * 100));
+            draw_data_grid(state, grid_state, view, info, status);
+        } else
+            draw_data_grid(state, grid_state, view, info, {});
+    }
+
+    namespace internal
+    {
+        // Immutable result of a data view query
+        struct DataViewIndex {
+            std::shared_ptr<const GridDataSource> source;
+            std::vector<size_t> rows;
+            bool identity = true;
+            uint64_t revision = 0;
         };
+    }    // namespace internal
 
-        if (info.focus)
-            for (const auto &event: state.impl->events)
-                HandleEvent(event, [&](const KeyEvent &ev) {
-                    if (ev.key_down && ev.modifiers == 0 && ev.key_code == KeyCode::ENTER) {
-                        click_action();
-                        if (info.on_click)
-                            info.on_click(std::ref(info));
+    class DataView::DataViewImpl {
+        // Worker pool which helps the job thread
+        std::vector<std::thread> workers;
+        std::mutex task_mutex;
+        std::condition_variable task_cv;
+        std::queue<std::function<void()>> tasks;
+        bool stop_workers = false;
+
+        // The job thread runs one query at a time
+        std::thread job_thread;
+        std::mutex job_mutex;
+        std::condition_variable job_cv;
+        bool stop_job = false;
+        bool job_pending = false;
+        std::shared_ptr<const GridDataSource> pending_source;
+        DataViewQuery pending_query;
+
+        // Progress of a job. Every scheduled job gets its own, so a superseded job
+        // which is still winding down cannot count into the progress of the next one
+        struct JobProgress {
+            std::atomic<size_t> work_done = 0;
+            std::atomic<size_t> work_total = 1;
+        };
+
+        std::atomic<uint64_t> generation = 0;
+        std::shared_ptr<JobProgress> progress = std::make_shared<JobProgress>();    // Of the latest job, guarded by job_mutex
+
+        std::mutex publish_mutex;
+        std::shared_ptr<const internal::DataViewIndex> published;
+        uint64_t published_revision = 0;
+
+      public:
+        std::atomic<bool> busy = false;
+
+        // These are only accessed by the drawing thread
+        std::shared_ptr<const GridDataSource> source;
+        DataViewQuery query;
+        std::shared_ptr<const internal::DataViewIndex> current;
+
+        DataViewImpl(size_t num_threads) {
+            if (num_threads == 0)
+                num_threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+            // The job thread works too, so spawn one helper less
+            for (size_t i = 1; i < num_threads; i++)
+                workers.emplace_back([this] { worker_loop(); });
+            job_thread = std::thread([this] { job_loop(); });
+        }
+
+        ~DataViewImpl() {
+            {
+                std::lock_guard lock(job_mutex);
+                stop_job = true;
+                generation++;
+            }
+            job_cv.notify_all();
+            job_thread.join();
+
+            {
+                std::lock_guard lock(task_mutex);
+                stop_workers = true;
+            }
+            task_cv.notify_all();
+            for (auto &worker: workers)
+                worker.join();
+        }
+
+        void schedule() {
+            {
+                std::lock_guard lock(job_mutex);
+                pending_source = source;
+                pending_query = query;
+                job_pending = true;
+                generation++;
+                progress = std::make_shared<JobProgress>();
+                busy = true;
+            }
+            job_cv.notify_one();
+        }
+
+        std::shared_ptr<const internal::DataViewIndex> get_published() {
+            std::lock_guard lock(publish_mutex);
+            return published;
+        }
+
+        float get_progress() {
+            std::lock_guard lock(job_mutex);
+            return std::min(static_cast<float>(progress->work_done) / static_cast<float>(std::max<size_t>(progress->work_total, 1)), 1.0f);
+        }
+
+      private:
+        void worker_loop() {
+            while (true) {
+                std::function<void()> task;
+                {
+                    std::unique_lock lock(task_mutex);
+                    task_cv.wait(lock, [this] { return stop_workers || !tasks.empty(); });
+                    if (tasks.empty())
+                        return;
+                    task = std::move(tasks.front());
+                    tasks.pop();
+                }
+                task();
+            }
+        }
+
+        void job_loop() {
+            while (true) {
+                std::shared_ptr<const GridDataSource> job_source;
+                DataViewQuery job_query;
+                uint64_t job_generation;
+                std::shared_ptr<JobProgress> job_progress;
+                {
+                    std::unique_lock lock(job_mutex);
+                    job_cv.wait(lock, [this] { return stop_job || job_pending; });
+                    if (stop_job)
+                        return;
+                    job_source = std::move(pending_source);
+                    job_query = std::move(pending_query);
+                    job_generation = generation;
+                    job_progress = progress;
+                    job_pending = false;
+                }
+
+                run_job(job_generation, *job_progress, job_source, job_query);
+
+                std::lock_guard lock(job_mutex);
+                if (!job_pending)
+                    busy = false;
+            }
+        }
+
+        bool is_cancelled(const uint64_t job_generation) const {
+            return job_generation != generation;
+        }
+
+        // Runs fn for each index in [0, count) on the calling thread and the worker pool.
+        // The remaining indices are skipped once the job is cancelled.
+        // Returns false if the job was cancelled
+        bool parallel_for(const uint64_t job_generation, const size_t count, const std::function<void(size_t)> &fn) {
+            struct Batch {
+                std::atomic<size_t> next = 0;
+                std::atomic<size_t> done = 0;
+                std::mutex mutex;
+                std::condition_variable cv;
+            };
+
+            const auto batch = std::make_shared<Batch>();
+            // Helpers which start after the batch is over do not touch fn
+            const auto run = [this, batch, count, job_generation, &fn] {
+                for (size_t i; (i = batch->next++) < count;) {
+                    if (!is_cancelled(job_generation))
+                        fn(i);
+                    if (++batch->done == count) {
+                        std::lock_guard lock(batch->mutex);
+                        batch->cv.notify_all();
                     }
-                });
+                }
+            };
 
-        // clang-format off
-        RichText(state, {
-            .text = compute_check_box(value, info),
-            .pos = info.pos,
-            .on_hover =
-                [&](RichTextInfo &text_info) {
-                    if (info.on_hover)
-                        info.on_hover(std::ref(info));
-                    text_info.text = compute_check_box(value, info);
-                },
-            .on_click =
-                [&](RichTextInfo &text_info) {
-                    click_action();
-                    if (info.on_click)
-                        info.on_click(std::ref(info));
-                    text_info.text = compute_check_box(value, info);
-                },
-            .on_click2 =
-                [&](RichTextInfo &text_info) {
-                    click_action();
-                    if (info.on_click2)
-                        info.on_click2(std::ref(info));
-                    text_info.text = compute_check_box(value, info);
-                },
-            .on_menu =
-                [&](RichTextInfo &text_info) {
-                    if (info.on_menu)
-                        info.on_menu(std::ref(info));
-                    text_info.text = compute_check_box(value, info);
-                }    
+            const size_t num_helpers = std::min(workers.size(), saturated_sub(count, static_cast<size_t>(1)));
+            if (num_helpers > 0) {
+                {
+                    std::lock_guard lock(task_mutex);
+                    for (size_t i = 0; i < num_helpers; i++)
+                        tasks.emplace(run);
+                }
+                task_cv.notify_all();
+            }
+            run();
+
+            std::unique_lock lock(batch->mutex);
+            batch->cv.wait(lock, [&] { return batch->done == count; });
+            return !is_cancelled(job_generation);
+        }
+
+        void publish(const uint64_t job_generation, std::shared_ptr<const GridDataSource> job_source, std::vector<size_t> rows, const bool identity) {
+            auto index = std::make_shared<internal::DataViewIndex>();
+            index->source = std::move(job_source);
+            index->rows = std::move(rows);
+            index->identity = identity;
+
+            std::lock_guard lock(publish_mutex);
+            if (is_cancelled(job_generation))
+                return;
+            index->revision = ++published_revision;
+            published = std::move(index);
+        }
+
+        void run_job(
+                const uint64_t job_generation, JobProgress &job_progress, const std::shared_ptr<const GridDataSource> &job_source,
+                const DataViewQuery &job_query
+        ) {
+            if (!job_source || (!job_query.filter && job_query.order == SortOrder::NONE)) {
+                publish(job_generation, job_source, {}, true);
+                return;
+            }
+
+            const GridDataSource &data = *job_source;
+            const size_t count = data.num_rows();
+            // Small enough chunks so that cancellation and progress are responsive
+            const size_t chunk_size = std::max<size_t>(4096, count / (8 * (workers.size() + 1)) + 1);
+            const size_t num_chunks = (count + chunk_size - 1) / chunk_size;
+
+            const auto num_merges = [&](const size_t num_runs) {
+                size_t result = 0;
+                for (size_t runs = num_runs; runs > 1; runs = (runs + 1) / 2)
+                    result += runs / 2;
+                return result;
+            };
+            const bool sort = job_query.order != SortOrder::NONE;
+            job_progress.work_total = num_chunks + (sort ? num_chunks + num_merges(num_chunks) : 0);
+
+            // Filter each chunk separately, then join them in order
+            std::vector<std::vector<size_t>> parts(num_chunks);
+            const bool ok = parallel_for(job_generation, num_chunks, [&](const size_t chunk) {
+                const size_t end = std::min(count, (chunk + 1) * chunk_size);
+                for (size_t row = chunk * chunk_size; row < end; row++)
+                    if (!job_query.filter || job_query.filter(data, row))
+                        parts[chunk].push_back(row);
+                job_progress.work_done++;
+            });
+            if (!ok)
+                return;
+
+            std::vector<size_t> rows;
+            size_t num_rows = 0;
+            for (const auto &part: parts)
+                num_rows += part.size();
+            rows.reserve(num_rows);
+            for (const auto &part: parts)
+                rows.insert(rows.end(), part.begin(), part.end());
+            parts = {};
+
+            if (!sort) {
+                publish(job_generation, job_source, std::move(rows), false);
+                return;
+            }
+
+            // Sort the runs in parallel and then merge them pairwise
+            const size_t col = job_query.sort_col;
+            const bool descending = job_query.order == SortOrder::DESCENDING;
+            const auto compare = [&](const std::string_view lhs, const std::string_view rhs) {
+                return job_query.compare ? job_query.compare(lhs, rhs) : lhs < rhs;
+            };
+            const auto less = [&](const size_t a, const size_t b) {
+                const auto lhs = data.cell(col, a);
+                const auto rhs = data.cell(col, b);
+                if (descending ? compare(rhs, lhs) : compare(lhs, rhs))
+                    return true;
+                if (descending ? compare(lhs, rhs) : compare(rhs, lhs))
+                    return false;
+                return a < b;    // Keep the order of the source for equal cells
+            };
+
+            const size_t num_runs = (rows.size() + chunk_size - 1) / chunk_size;
+            job_progress.work_total = num_chunks + num_runs + num_merges(num_runs);
+            const bool sorted = parallel_for(job_generation, num_runs, [&](const size_t run) {
+                const auto begin = rows.begin() + static_cast<ptrdiff_t>(run * chunk_size);
+                const auto end = rows.begin() + static_cast<ptrdiff_t>(std::min(rows.size(), (run + 1) * chunk_size));
+                std::sort(begin, end, less);
+                job_progress.work_done++;
+            });
+            if (!sorted)
+                return;
+
+            std::vector<size_t> buffer(rows.size());
+            for (size_t width = chunk_size; width < rows.size(); width *= 2) {
+                const size_t num_pairs = (rows.size() + 2 * width - 1) / (2 * width);
+                const bool merged = parallel_for(job_generation, num_pairs, [&](const size_t pair) {
+                    const size_t lo = pair * 2 * width;
+                    const size_t mid = std::min(rows.size(), lo + width);
+                    const size_t hi = std::min(rows.size(), lo + 2 * width);
+                    std::merge(rows.begin() + lo, rows.begin() + mid, rows.begin() + mid, rows.begin() + hi, buffer.begin() + lo, less);
+                    if (mid < hi)
+                        job_progress.work_done++;
+                });
+                if (!merged)
+                    return;
+                rows.swap(buffer);
+            }
+
+            publish(job_generation, job_source, std::move(rows), false);
+        }
+    };
+
+    DataView::DataView(size_t num_threads) : impl(std::make_unique<DataViewImpl>(num_threads)) {}
+
+    DataView::~DataView() = default;
+
+    void DataView::set_source(std::shared_ptr<const GridDataSource> source) {
+        impl->source = std::move(source);
+        impl->schedule();
+    }
+
+    void DataView::submit(DataViewQuery query) {
+        impl->query = std::move(query);
+        impl->schedule();
+    }
+
+    bool DataView::update() {
+        auto latest = impl->get_published();
+        if (latest == impl->current)
+            return false;
+        impl->current = std::move(latest);
+        return true;
+    }
+
+    bool DataView::is_busy() const {
+        return impl->busy;
+    }
+
+    float DataView::get_progress() const {
+        return impl->get_progress();
+    }
+
+    const GridDataSource *DataView::get_source() const {
+        return impl->current ? impl->current->source.get() : nullptr;
+    }
+
+    size_t DataView::get_source_row(size_t row) const {
+        const auto &current = impl->current;
+        if (!current || current->identity)
+            return row;
+        return row < current->rows.size() ? current->rows[row] : row;
+    }
+
+    size_t DataView::num_cols() const {
+        const auto source = get_source();
+        return source ? source->num_cols() : 0;
+    }
+
+    size_t DataView::num_rows() const {
+        const auto &current = impl->current;
+        if (!current || !current->source)
+            return 0;
+        return current->identity ? current->source->num_rows() : current->rows.size();
+    }
+
+    std::string_view DataView::header(size_t col) const {
+        const auto source = get_source();
+        return source ? source->header(col) : std::string_view();
+    }
+
+    std::string_view DataView::cell(size_t col, size_t row) const {
+        const auto source = get_source();
+        return source ? source->cell(col, get_source_row(row)) : std::string_view();
+    }
+
+    uint64_t DataView::revision() const {
+        return impl->current ? impl->current->revision : 0;
+    }
+
+    namespace internal
+    {
+        size_t TextBuffer::break_pos(size_t index) const {
+            return index < breaks.gap() ? breaks[index] : text.size() - breaks[index];
+        }
+
+        size_t TextBuffer::count_breaks_before(size_t pos) const {
+            size_t lo = 0;
+            size_t hi = breaks.size();
+            while (lo < hi) {
+                const size_t mid = lo + (hi - lo) / 2;
+                if (break_pos(mid) < pos)
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+            return lo;
+        }
+
+        void TextBuffer::move_breaks_gap(size_t index) {
+            const size_t gap = breaks.gap();
+            breaks.move_gap(index);
+            // The breaks which crossed the gap switch between absolute and relative positions
+            for (size_t i = std::min(gap, index); i < std::max(gap, index); i++)
+                breaks[i] = text.size() - breaks[i];
+        }
+
+        void TextBuffer::insert(size_t pos, std::string_view str) {
+            pos = std::min(pos, text.size());
+            if (str.empty())
+                return;
+
+            size_t index = count_breaks_before(pos);
+            move_breaks_gap(index);
+            text.insert(pos, str.data(), str.size());
+            for (size_t i = 0; i < str.size(); i++)
+                if (str[i] == '\n')
+                    breaks.insert(index++, pos + i);
+        }
+
+        void TextBuffer::erase(size_t pos, size_t count) {
+            pos = std::min(pos, text.size());
+            count = std::min(count, text.size() - pos);
+            if (count == 0)
+                return;
+
+            const size_t index = count_breaks_before(pos);
+            move_breaks_gap(index);
+            size_t removed = 0;
+            while (index + removed < breaks.size() && break_pos(index + removed) < pos + count)
+                removed++;
+            breaks.erase(index, removed);
+            text.erase(pos, count);
+        }
+
+        void TextBuffer::clear() {
+            text.clear();
+            breaks.clear();
+        }
+
+        size_t TextBuffer::line_start(size_t line) const {
+            if (line == 0)
+                return 0;
+            return break_pos(std::min(line, breaks.size()) - 1) + 1;
+        }
+
+        size_t TextBuffer::line_end(size_t line) const {
+            return line < breaks.size() ? break_pos(line) : text.size();
+        }
+
+        std::string TextBuffer::substr(size_t pos, size_t count) const {
+            pos = std::min(pos, text.size());
+            count = std::min(count, text.size() - pos);
+            std::string result;
+            result.reserve(count);
+            text.copy(pos, count, std::back_inserter(result));
+            return result;
+        }
+    }    // namespace internal
+
+    // Decodes the character of the text at pos, returns its size in bytes
+    static size_t decode_text_char(const TextInputState &text, const size_t pos, const size_t end, wchar_t &wc) {
+        const char first = text.get_char(pos);
+        if (static_cast<unsigned char>(first) < 0x80) {
+            wc = static_cast<wchar_t>(first);
+            return 1;
+        }
+        char buffer[internal::utf8::MAX_SIZE];
+        size_t count = 0;
+        for (; count < sizeof(buffer) && pos + count < end; count++)
+            buffer[count] = text.get_char(pos + count);
+        return decode_char(std::string_view(buffer, count), 0, wc);
+    }
+
+    // Returns the text a control character is shown as, or null if the character is shown as it is
+    static const char *control_text(const wchar_t c) {
+        switch (c) {
+        case '\x00':
+            return "<NUL>";
+        case '\x01':
+            return "<SOH>";
+        case '\x02':
+            return "<STX>";
+        case '\x03':
+            return "<ETX>";
+        case '\x04':
+            return "<EOT>";
+        case '\x05':
+            return "<ENQ>";
+        case '\x06':
+            return "<ACK>";
+        case '\x07':
+            return "<BEL>";
+        case '\x08':
+            return "<BS>";
+        case '\x09':    // horizontal tab
+            return "    ";
+        case '\x0B':
+            return "<VT>";
+        case '\x0C':
+            return "<FF>";
+        case '\x0D':
+            return "<CR>";
+        case '\x0E':
+            return "<SO>";
+        case '\x0F':
+            return "<SI>";
+        case '\x10':
+            return "<DLE>";
+        case '\x11':
+            return "<DC1>";
+        case '\x12':
+            return "<DC2>";
+        case '\x13':
+            return "<DC3>";
+        case '\x14':
+            return "<DC4>";
+        case '\x15':
+            return "<NAK>";
+        case '\x16':
+            return "<SYN>";
+        case '\x17':
+            return "<ETB>";
+        case '\x18':
+            return "<CAN>";
+        case '\x19':
+            return "<EM>";
+        case '\x1A':
+            return "<SUB>";
+        case '\x1B':
+            return "<ESC>";
+        case '\x1C':
+            return "<FS>";
+        case '\x1D':
+            return "<GS>";
+        case '\x1E':
+            return "<RS>";
+        case '\x1F':
+            return "<US>";
+        case '\x7F':
+            return "<DEL>";
+        default:
+            return nullptr;
+        }
+    }
+
+    // Walks the cells the characters of [start, end) of the text are shown in, calling fn(pos, len, value, width)
+    // for each cell with the position and size of its glyph, so that the characters joining a glyph go with it.
+    // A control character takes a cell for each character of its text. Stops and returns false when fn does
+    template<typename Fn>
+    static bool for_each_text_cell(const TextInputState &text, const size_t start, const size_t end, Fn &&fn) {
+        for (size_t pos = start; pos < end;) {
+            wchar_t wc;
+            size_t len = decode_text_char(text, pos, end, wc);
+            if (const char *str = control_text(wc)) {
+                for (; *str != '\0'; str++)
+                    if (!fn(pos, len, static_cast<wchar_t>(*str), size_t(1)))
+                        return false;
+                pos += len;
+                continue;
+            }
+            for (wchar_t last = wc, next; pos + len < end; last = next) {
+                const size_t next_len = decode_text_char(text, pos + len, end, next);
+                if (control_text(next) || !internal::unicode::joins_cluster(last, next))
+                    break;
+                len += next_len;
+            }
+            for (size_t i = pos; i < pos + len;) {
+                const size_t char_len = decode_text_char(text, i, end, wc);
+                if (!fn(pos, len, wc, i == pos ? internal::unicode::char_width(wc) : 0))
+                    return false;
+                i += char_len;
+            }
+            pos += len;
+        }
+        return true;
+    }
+
+    // Walks the cells of a line like for_each_text_cell, with the extra cell of a cursor at the end of the line.
+    // Calls fn(pos, len, value, width, row, col) with the row and column of each cell, where the line is wrapped
+    // at width columns like a text box wraps the characters, or not wrapped if width is 0
+    template<typename Fn>
+    static void for_each_line_cell(const TextInputState &text, const size_t start, const size_t end, const bool cursor_cell, const size_t width, Fn &&fn) {
+        size_t row = 0, col = 0;
+        const auto place = [&](const size_t pos, const size_t len, const wchar_t value, const size_t w) {
+            if (width > 0 && w > 0 && col + w > width && col > 0) {
+                row++;
+                col = 0;
+            }
+            const bool more = fn(pos, len, value, w, row, col);
+            col += w;
+            return more;
+        };
+        if (for_each_text_cell(text, start, end, place) && cursor_cell)
+            place(end, 0, L' ', 1);
+    }
+
+    template<typename Container>
+    void TextInputState::format_line(
+            Container &result, const size_t start, const size_t end, const bool is_line_end, const Style text_style, const Style selection_style,
+            const Style cur_style
+    ) const {
+        const auto [selection_start, selection_end] = get_selection_range();
+        // The cursor may be on the line break or at the end of text
+        for_each_line_cell(*this, start, end, is_line_end && cursor == end, 0, [&](const size_t pos, const size_t len, const wchar_t value, size_t, size_t, size_t) {
+            if (pos == cursor || (pos < cursor && cursor < pos + len))
+                result.push_back(StyledChar{.value = value, .style = cur_style});
+            else if (selection_mode && selection_start <= pos && pos < selection_end)
+                result.push_back(StyledChar{.value = value, .style = selection_style});
+            else
+                result.push_back(StyledChar{.value = value, .style = text_style});
+            return true;
         });
-        // clang-format on
     }
 
-    bool PollEvent(State &state, Event &event) {
-        if (internal::PollRawEvent(event)) {
-            state.impl->events.push_back(event);
-            // clang-format off
-            HandleEvent(
-                event,
-                [&](const KeyEvent &ev) {
-                    state.impl->key_states[ev.key_code] = KeyState{.printable = is_print(ev.key_char), .down = ev.key_down};
-                },
-                [&](const MouseEvent &ev) {
-                    switch (ev.kind) {
-                    case MouseEventKind::MOVED:
-                        state.impl->mouse_pos = ev.pos;
-                        break;
-                    default:
-                        break;
+    std::vector<StyledChar> TextInputState::process(
+            const Style text_style, const Style selection_style, const Style cursor_style, const Style cursor_style_ins, const Style cursor_style_sel
+    ) {
+        std::vector<StyledChar> result;
+        result.reserve(data.size() + 1);
+
+        const Style cur_style = selection_mode ? cursor_style_sel : insert_mode ? cursor_style_ins : cursor_style;
+        for (size_t line = 0; line < data.line_count(); line++) {
+            if (line > 0)
+                result.push_back(StyledChar{.value = '\n', .style = text_style});
+            format_line(result, data.line_start(line), data.line_end(line), true, text_style, selection_style, cur_style);
+        }
+        return result;
+    }
+
+    template<typename Container>
+    void TextInputState::format_window(
+            Container &result, const Style text_style, const Style selection_style, const Style cursor_style, const Style cursor_style_ins,
+            const Style cursor_style_sel, const Size window, const bool wrap
+    ) {
+        result.clear();
+        if (window.width == 0 || window.height == 0)
+            return;
+
+        const Style cur_style = selection_mode ? cursor_style_sel : insert_mode ? cursor_style_ins : cursor_style;
+        const auto [selection_start, selection_end] = get_selection_range();
+        const auto is_cursor = [&](const size_t pos, const size_t len) {
+            return pos == cursor || (pos < cursor && cursor < pos + len);
+        };
+        const auto push_cell = [&](const size_t pos, const size_t len, const wchar_t value) {
+            if (is_cursor(pos, len))
+                result.push_back(StyledChar{.value = value, .style = cur_style});
+            else if (selection_mode && selection_start <= pos && pos < selection_end)
+                result.push_back(StyledChar{.value = value, .style = selection_style});
+            else
+                result.push_back(StyledChar{.value = value, .style = text_style});
+        };
+        // Rows and columns are counted in cells, so that wide and control characters scroll by what they take on screen
+        const size_t width = wrap ? window.width : 0;
+        const auto line_cells = [&](const size_t line, auto &&fn) {
+            const size_t line_end = data.line_end(line);
+            for_each_line_cell(*this, data.line_start(line), line_end, cursor == line_end, width, fn);
+        };
+
+        const size_t cursor_line = data.line_of(cursor);
+        size_t cursor_row = 0, cursor_col = 0, cursor_width = 1;
+        line_cells(cursor_line, [&](const size_t pos, const size_t len, wchar_t, const size_t w, const size_t row, const size_t col) {
+            if (!is_cursor(pos, len))
+                return true;
+            cursor_row = row;
+            cursor_col = col;
+            cursor_width = std::max<size_t>(w, 1);
+            return false;
+        });
+        scroll_line = std::min(scroll_line, data.line_count() - 1);
+
+        if (wrap) {
+            const auto line_rows = [&](const size_t line) {
+                size_t rows = 1;
+                line_cells(line, [&](size_t, size_t, wchar_t, size_t, const size_t row, size_t) {
+                    rows = row + 1;
+                    return true;
+                });
+                return rows;
+            };
+
+            scroll_row = std::min(scroll_row, line_rows(scroll_line) - 1);
+            if (cursor_line < scroll_line || (cursor_line == scroll_line && cursor_row < scroll_row)) {
+                scroll_line = cursor_line;
+                scroll_row = cursor_row;
+            } else {
+                // Walk up from the cursor, if the top is not reached within the window then scroll down
+                size_t line = cursor_line;
+                size_t row = cursor_row;
+                for (size_t remaining = window.height - 1; remaining > 0 && !(line == scroll_line && row == scroll_row); remaining--) {
+                    if (row > 0)
+                        row--;
+                    else if (line > 0)
+                        row = line_rows(--line) - 1;
+                }
+                scroll_line = line;
+                scroll_row = row;
+            }
+
+            // The wrapped rows are separated by line breaks, so that the text box shows the rows counted here
+            size_t rows_left = window.height;
+            for (size_t line = scroll_line; line < data.line_count() && rows_left > 0; line++) {
+                if (line > scroll_line)
+                    result.push_back(StyledChar{.value = '\n', .style = text_style});
+                const size_t first_row = line == scroll_line ? scroll_row : 0;
+                size_t rows = 1;
+                line_cells(line, [&](const size_t pos, const size_t len, const wchar_t value, size_t, const size_t row, size_t) {
+                    if (row < first_row)
+                        return true;
+                    if (row - first_row >= rows_left)
+                        return false;
+                    for (; rows < row - first_row + 1; rows++)
+                        result.push_back(StyledChar{.value = '\n', .style = text_style});
+                    push_cell(pos, len, value);
+                    return true;
+                });
+                rows_left = saturated_sub(rows_left, rows);
+            }
+        } else {
+            if (cursor_line < scroll_line)
+                scroll_line = cursor_line;
+            else if (cursor_line >= scroll_line + window.height)
+                scroll_line = cursor_line - window.height + 1;
+            if (cursor_col < scroll_col || cursor_width > window.width)
+                scroll_col = cursor_col;
+            else if (cursor_col + cursor_width > scroll_col + window.width)
+                scroll_col = cursor_col + cursor_width - window.width;
+
+            const size_t window_end = scroll_col + window.width;
+            for (size_t line = scroll_line; line < data.line_count() && line < scroll_line + window.height; line++) {
+                if (line > scroll_line)
+                    result.push_back(StyledChar{.value = '\n', .style = text_style});
+                line_cells(line, [&](const size_t pos, const size_t len, const wchar_t value, const size_t w, size_t, const size_t col) {
+                    // A zero width character belongs to the glyph before it
+                    if (col > window_end || (col == window_end && w > 0))
+                        return false;
+                    if (w > 0 ? col + w <= scroll_col : col < scroll_col || (col == scroll_col && col > 0))
+                        return true;
+                    // The visible columns of a wide character cut by the edge of the window are left blank
+                    if (col < scroll_col || col + w > window_end) {
+                        for (size_t i = std::max(col, scroll_col); i < std::min(col + w, window_end); i++)
+                            push_cell(pos, len, L' ');
+                        return col + w <= window_end;
+                    }
+                    push_cell(pos, len, value);
+                    return true;
+                });
+            }
+        }
+    }
+
+    std::vector<StyledChar> TextInputState::process(
+            const Style text_style, const Style selection_style, const Style cursor_style, const Style cursor_style_ins, const Style cursor_style_sel,
+            const Size window, const bool wrap
+    ) {
+        std::vector<StyledChar> result;
+        format_window(result, text_style, selection_style, cursor_style, cursor_style_ins, cursor_style_sel, window, wrap);
+        return result;
+    }
+
+    void TextInputState::process(
+            std::pmr::vector<StyledChar> &result, const Style text_style, const Style selection_style, const Style cursor_style,
+            const Style cursor_style_ins, const Style cursor_style_sel, const Size window, const bool wrap
+    ) {
+        format_window(result, text_style, selection_style, cursor_style, cursor_style_ins, cursor_style_sel, window, wrap);
+    }
+
+    void TextInput(State &state, TextInputState &text_state, TextInputInfo info) {
+        if (text_state.has_focus())
+            for (const Event &event: state.impl->events) {
+                HandleEvent(event, [&](const KeyEvent &ev) {
+                    if (!ev.key_down)
+                        return;
+                    switch (ev.key_code) {
+                    case KeyCode::ESCAPE:
+                        text_state.end_selection();
+                        break;
+                    case KeyCode::BACKSPACE:
+                        if (ev.modifiers == 0) {
+                            if (text_state.is_selected()) {
+                                text_state.erase_selection();
+                                text_state.end_selection();
+                            } else
+                                text_state.on_key_backspace();
+                        }
+                        break;
+                    case KeyCode::DELETE:
+                        if (ev.modifiers == 0) {
+                            if (text_state.is_selected()) {
+                                text_state.erase_selection();
+                                text_state.end_selection();
+                            } else
+                                text_state.on_key_delete();
+                        }
+                        break;
+                    case KeyCode::LEFT:
+                        if (ev.modifiers == 0) {
+                            if (text_state.is_selected()) {
+                                const auto selection_start = text_state.get_selection_range().first;
+                                text_state.end_selection();
+                                text_state.set_cursor(selection_start);
+                            } else
+                                text_state.move_left();
+                        }
+                        if (ev.modifiers & KEY_SHIFT) {
+                            text_state.start_selection();
+                            text_state.move_left();
+                        }
+                        break;
+                    case KeyCode::RIGHT:
+                        if (ev.modifiers == 0) {
+                            if (text_state.is_selected()) {
+                                const auto selection_end = text_state.get_selection_range().second;
+                                text_state.end_selection();
+                                text_state.set_cursor(selection_end);
+                            } else
+                                text_state.move_right();
+                        }
+                        if (ev.modifiers & KEY_SHIFT) {
+                            text_state.start_selection();
+                            text_state.move_right();
+                        }
+                        break;
+                    case KeyCode::HOME:
+                        if (ev.modifiers == 0) {
+                            if (text_state.is_selected())
+                                text_state.end_selection();
+                            text_state.go_home();
+                        }
+                        if (ev.modifiers & KEY_SHIFT) {
+                            text_state.start_selection();
+                            text_state.go_home();
+                        }
+                        break;
+                    case KeyCode::END:
+                        if (ev.modifiers == 0) {
+                            if (text_state.is_selected())
+                                text_state.end_selection();
+                            text_state.go_end();
+                        }
+                        if (ev.modifiers & KEY_SHIFT) {
+                            text_state.start_selection();
+                            text_state.go_end();
+                        }
+                        break;
+                    case KeyCode::INSERT:
+                        if (ev.modifiers == 0)
+                            text_state.toggle_insert_mode();
+                        break;
+                    case KeyCode::ENTER:
+                        if (info.handle_enter_as_event) {
+                            if (info.on_enter)
+                                info.on_enter(std::ref(info));
+                        } else if (ev.modifiers == 0) {
+                            if (text_state.is_selected()) {
+                                text_state.erase_selection();
+                                text_state.end_selection();
+                            }
+                            text_state.insert_char('\n');
+                        }
+                        break;
+                    default:
+                        if ((ev.modifiers == 0 || ev.modifiers & KEY_SHIFT) && std::isprint(ev.key_char)) {
+                            if (text_state.is_selected()) {
+                                text_state.erase_selection();
+                                text_state.end_selection();
+                            }
+                            text_state.insert_char(ev.key_char);
+                        }
+                        break;
+                    }
+                });
+                // Insert the pasted text as a single edit
+                HandleEvent(event, [&](const PasteEvent &ev) {
+                    if (text_state.is_selected()) {
+                        text_state.erase_selection();
+                        text_state.end_selection();
+                    }
+                    text_state.insert_text(ev.text);
+                });
+            }
+
+        // The formatted text lives in the frame allocator and is drawn without a copy into the info
+        std::pmr::vector<StyledChar> text(GetFrameAllocator(state));
+        text_state.process(text, info.text_style, info.selection_style, info.cursor_style, info.cursor_style_ins, info.cursor_style_sel, info.size, info.wrap);
+        // clang-format off
+        RichTextBoxInfo box_info = {
+            .pos = info.pos,
+            .size = info.size,
+            .style = info.text_style,
+            .wrap = info.wrap,
+            .word_wrap = false,    // The cursor movement wraps the lines anywhere
+            .align = info.align,
+        };
+        // clang-format on
+        handle_text_box_hits(state, box_info);
+        draw_rich_text_box(state, text, box_info);
+    }
+
+    void TextField(State &state, TextInputState &text_state, TextFieldInfo info) {
+        if (text_state.has_focus())
+            for (const Event &event: state.impl->events) {
+                HandleEvent(event, [&](const KeyEvent &ev) {
+                    if (!ev.key_down)
+                        return;
+                    switch (ev.key_code) {
+                    case KeyCode::ESCAPE:
+                        text_state.end_selection();
+                        break;
+                    case KeyCode::BACKSPACE:
+                        if (ev.modifiers == 0) {
+                            if (text_state.is_selected()) {
+                                text_state.erase_selection();
+                                text_state.end_selection();
+                            } else
+                                text_state.on_key_backspace();
+                        }
+                        break;
+                    case KeyCode::DELETE:
+                        if (ev.modifiers == 0) {
+                            if (text_state.is_selected()) {
+                                text_state.erase_selection();
+                                text_state.end_selection();
+                            } else
+                                text_state.on_key_delete();
+                        }
+                        break;
+                    case KeyCode::LEFT:
+                        if (ev.modifiers == 0) {
+                            if (text_state.is_selected()) {
+                                const auto selection_start = text_state.get_selection_range().first;
+                                text_state.end_selection();
+                                text_state.set_cursor(selection_start);
+                            } else
+                                text_state.move_left();
+                        }
+                        if (ev.modifiers & KEY_SHIFT) {
+                            text_state.start_selection();
+                            text_state.move_left();
+                        }
+                        break;
+                    case KeyCode::RIGHT:
+                        if (ev.modifiers == 0) {
+                            if (text_state.is_selected()) {
+                                const auto selection_end = text_state.get_selection_range().second;
+                                text_state.end_selection();
+                                text_state.set_cursor(selection_end);
+                            } else
+                                text_state.move_right();
+                        }
+                        if (ev.modifiers & KEY_SHIFT) {
+                            text_state.start_selection();
+                            text_state.move_right();
+                        }
+                        break;
+                    case KeyCode::HOME:
+                        if (ev.modifiers == 0) {
+                            if (text_state.is_selected())
+                                text_state.end_selection();
+                            text_state.go_home();
+                        }
+                        if (ev.modifiers & KEY_SHIFT) {
+                            text_state.start_selection();
+                            text_state.go_home();
+                        }
+                        break;
+                    case KeyCode::END:
+                        if (ev.modifiers == 0) {
+                            if (text_state.is_selected())
+                                text_state.end_selection();
+                            text_state.go_end();
+                        }
+                        if (ev.modifiers & KEY_SHIFT) {
+                            text_state.start_selection();
+                            text_state.go_end();
+                        }
+                        break;
+                    case KeyCode::INSERT:
+                        if (ev.modifiers == 0)
+                            text_state.toggle_insert_mode();
+                        break;
+                    case KeyCode::ENTER:
+                        if (text_state.is_selected())
+                            text_state.end_selection();
+                        if (info.on_enter)
+                            info.on_enter(std::ref(info));
+                        break;
+                    default:
+                        if ((ev.modifiers == 0 || ev.modifiers & KEY_SHIFT) && std::isprint(ev.key_char)) {
+                            if (text_state.is_selected()) {
+                                text_state.erase_selection();
+                                text_state.end_selection();
+                            }
+                            text_state.insert_char(ev.key_char);
+                        }
+                        break;
+                    }
+                });
+                // Insert the pasted text as a single edit, the field has only one line
+                HandleEvent(event, [&](const PasteEvent &ev) {
+                    if (text_state.is_selected()) {
+                        text_state.erase_selection();
+                        text_state.end_selection();
+                    }
+                    std::string text = ev.text;
+                    std::replace(text.begin(), text.end(), '\n', ' ');
+                    text_state.insert_text(text);
+                });
+            }
+
+        std::pmr::vector<StyledChar> text(GetFrameAllocator(state));
+        text_state.process(
+                text, info.text_style, info.selection_style, info.cursor_style, info.cursor_style_ins, info.cursor_style_sel,
+                {.width = info.width, .height = 1}, false
+        );
+        // clang-format off
+        RichTextBoxInfo box_info = {
+            .pos = info.pos,
+            .size = {.width = info.width, .height = 1},
+            .style = info.text_style,
+            .word_wrap = false,
+            .align = info.align,
+        };
+        // clang-format on
+        handle_text_box_hits(state, box_info);
+        draw_rich_text_box(state, text, box_info);
+    }
+
+    static size_t glyph_width(const wchar_t wc, const size_t col, const size_t tab_width) {
+        if (wc == L'\t')
+            return tab_width == 0 ? 1 : tab_width - col % tab_width;
+        return internal::unicode::char_width(wc);
+    }
+
+    void TextEditorState::push_record(EditRecord record, const std::string_view text) {
+        record.text_offset = history_text.size();
+        record.text_size = text.size();
+        record.joined = step_open;
+        history_text.append(text);
+        undo_records.push_back(record);
+        if (!record.joined)
+            undo_steps++;
+        step_open = true;
+        trim_history();
+    }
+
+    void TextEditorState::trim_history() {
+        if (undo_steps <= history_limit)
+            return;
+        // Drop the oldest steps with the records joined to them
+        for (; undo_steps > history_limit; undo_steps--)
+            do
+                undo_records.pop_front();
+            while (!undo_records.empty() && undo_records.front().joined);
+
+        // The text of the dropped records is a prefix of history_text, it is reclaimed once it is half of it
+        size_t dead = undo_records.empty() ? history_text.size() : undo_records.front().text_offset;
+        for (const auto &record: redo_records)
+            dead = std::min(dead, record.text_offset);
+        if (dead == 0 || dead < history_text.size() / 2)
+            return;
+        history_text.erase(0, dead);
+        for (auto &record: undo_records)
+            record.text_offset -= dead;
+        for (auto &record: redo_records)
+            record.text_offset -= dead;
+    }
+
+    std::string TextEditorState::record_text(const EditRecord &record) const {
+        std::string text = history_text.substr(record.text_offset, record.text_size);
+        if (record.reversed)
+            std::reverse(text.begin(), text.end());
+        return text;
+    }
+
+    void TextEditorState::on_insert(const size_t pos, const std::string_view text) {
+        revision++;
+        preferred_col = std::numeric_limits<size_t>::max();
+        redo_records.clear();
+
+        // Merge typing into the last insertion
+        if (!sealed && !undo_records.empty() && text.size() == 1 && text[0] != '\n') {
+            auto &last = undo_records.back();
+            if (!last.erase && last.pos + last.text_size == pos && last.text_offset + last.text_size == history_text.size()) {
+                history_text.append(text);
+                last.text_size++;
+                return;
+            }
+        }
+
+        push_record({.pos = pos, .text_offset = 0, .text_size = 0, .cursor = cursor, .erase = false, .reversed = false, .joined = false}, text);
+        sealed = text.size() != 1 || text[0] == '\n';
+    }
+
+    void TextEditorState::on_erase(const size_t pos, const size_t count) {
+        revision++;
+        preferred_col = std::numeric_limits<size_t>::max();
+        redo_records.clear();
+
+        // Merge consecutive deletes and backspaces into the last erasure
+        if (!sealed && !undo_records.empty() && count == 1) {
+            auto &last = undo_records.back();
+            if (last.erase && last.text_offset + last.text_size == history_text.size()) {
+                if (pos == last.pos && !last.reversed) {
+                    history_text.push_back(data[pos]);
+                    last.text_size++;
+                    return;
+                }
+                if (pos + 1 == last.pos && (last.reversed || last.text_size == 1)) {
+                    history_text.push_back(data[pos]);
+                    last.text_size++;
+                    last.reversed = true;
+                    last.pos = pos;
+                    return;
+                }
+            }
+        }
+
+        push_record(
+                {.pos = pos, .text_offset = 0, .text_size = 0, .cursor = cursor, .erase = true, .reversed = false, .joined = false},
+                data.substr(pos, count)
+        );
+        sealed = count != 1;
+    }
+
+    bool TextEditorState::undo() {
+        if (undo_records.empty())
+            return false;
+
+        EditRecord record;
+        do {
+            record = undo_records.back();
+            undo_records.pop_back();
+            if (record.erase)
+                data.insert(record.pos, record_text(record));
+            else
+                data.erase(record.pos, record.text_size);
+            cursor = std::min(record.cursor, data.size());
+            redo_records.push_back(record);
+        } while (record.joined && !undo_records.empty());
+        undo_steps--;
+
+        revision++;
+        end_selection();
+        seal();
+        return true;
+    }
+
+    bool TextEditorState::redo() {
+        if (redo_records.empty())
+            return false;
+
+        do {
+            const EditRecord record = redo_records.back();
+            redo_records.pop_back();
+            if (record.erase) {
+                data.erase(record.pos, record.text_size);
+                cursor = record.pos;
+            } else {
+                data.insert(record.pos, record_text(record));
+                cursor = record.pos + record.text_size;
+            }
+            undo_records.push_back(record);
+        } while (!redo_records.empty() && redo_records.back().joined);
+        undo_steps++;
+
+        revision++;
+        end_selection();
+        seal();
+        return true;
+    }
+
+    size_t TextEditorState::get_visual_col(size_t pos, const size_t tab_width) const {
+        pos = std::min(pos, data.size());
+        size_t col = 0;
+        wchar_t wc;
+        for (size_t i = data.line_start(data.line_of(pos)); i < pos; i += decode_text_char(*this, i, pos, wc))
+            col += glyph_width(wc, col, tab_width);
+        return col;
+    }
+
+    size_t TextEditorState::get_pos_at(size_t line, const size_t col, const size_t tab_width) const {
+        line = std::min(line, data.line_count() - 1);
+        const size_t end = data.line_end(line);
+        size_t pos = data.line_start(line);
+        size_t current = 0;
+        while (pos < end) {
+            wchar_t wc;
+            const size_t len = decode_text_char(*this, pos, end, wc);
+            const size_t width = glyph_width(wc, current, tab_width);
+            if (current + width > col)
+                break;
+            current += width;
+            pos += len;
+        }
+        return pos;
+    }
+
+    void TextEditorState::move_vertical(const int64_t lines, const size_t tab_width) {
+        if (preferred_col == std::numeric_limits<size_t>::max())
+            preferred_col = get_visual_col(cursor, tab_width);
+
+        const size_t line = data.line_of(cursor);
+        size_t target;
+        if (lines < 0)
+            target = saturated_sub(line, static_cast<size_t>(-lines));
+        else
+            target = std::min(saturated_add(line, static_cast<size_t>(lines)), data.line_count() - 1);
+        cursor = get_pos_at(target, preferred_col, tab_width);
+        sealed = true;
+    }
+
+    void TextEditor(State &state, TextEditorState &editor_state, TextEditorInfo info) {
+        const size_t start_revision = editor_state.get_revision();
+
+        size_t gutter_width = 0;
+        if (info.show_line_numbers) {
+            for (size_t count = editor_state.get_line_count(); count > 0; count /= 10)
+                gutter_width++;
+            gutter_width++;
+        }
+        const size_t text_width = saturated_sub(info.size.width, gutter_width);
+        const size_t page = std::max<size_t>(info.size.height, 2) - 1;
+
+        const auto erase_selection = [&] {
+            if (editor_state.is_selected()) {
+                editor_state.erase_selection();
+                editor_state.end_selection();
+                return true;
+            }
+            return false;
+        };
+
+        // Applies a cursor movement and extends the selection if shift is pressed
+        const auto move = [&](const KeyEvent &ev, const auto &fn) {
+            if (ev.modifiers & KEY_SHIFT)
+                editor_state.start_selection();
+            else
+                editor_state.end_selection();
+            fn();
+        };
+
+        // The wheel scrolls the viewport alone, it follows the cursor again after a key, a click or a cursor movement
+        bool follow_cursor = false;
+        const size_t max_top_line = saturated_sub(editor_state.get_line_count(), info.size.height);
+        const uint32_t hit_id = state.impl->push_hit_rect(info.pos, info.size);
+        if (editor_state.has_focus())
+            state.impl->for_each_hit(hit_id, [&](const MouseEvent &ev) {
+                const auto pos = ev.pos - GetPanePosition(state);
+                const size_t top_line = editor_state.get_top_line();
+                const size_t left_col = editor_state.get_left_col();
+                switch (ev.kind) {
+                case MouseEventKind::SCROLL_UP:
+                    editor_state.set_scroll(saturated_sub(top_line, 3 * ev.count), left_col);
+                    break;
+                case MouseEventKind::SCROLL_DOWN:
+                    editor_state.set_scroll(std::max(std::min(top_line + 3 * ev.count, max_top_line), top_line), left_col);
+                    break;
+                case MouseEventKind::SCROLL_LEFT:
+                    editor_state.set_scroll(top_line, saturated_sub(left_col, ev.count));
+                    break;
+                case MouseEventKind::SCROLL_RIGHT:
+                    editor_state.set_scroll(top_line, left_col + ev.count);
+                    break;
+                case MouseEventKind::CLICK:
+                    if (ev.button != MouseButton::LEFT || pos.col < info.pos.col + gutter_width)
+                        break;
+                    editor_state.end_selection();
+                    editor_state.set_cursor(editor_state.get_pos_at(
+                            editor_state.get_top_line() + (pos.row - info.pos.row),
+                            editor_state.get_left_col() + (pos.col - info.pos.col - gutter_width), info.tab_width
+                    ));
+                    editor_state.seal();
+                    follow_cursor = true;
+                    break;
+                default:
+                    break;
+                }
+            });
+
+        if (editor_state.has_focus())
+            for (const Event &event: state.impl->events) {
+                HandleEvent(
+                        event,
+                        [&](const KeyEvent &ev) {
+                            if (!ev.key_down)
+                                return;
+                            editor_state.begin_step();
+                            follow_cursor = true;
+
+                            if (ev.modifiers & KEY_CTRL) {
+                                if (ev.key_code == KeyCode::K_Z && !(ev.modifiers & KEY_SHIFT))
+                                    editor_state.undo();
+                                else if (ev.key_code == KeyCode::K_Y || ev.key_code == KeyCode::K_Z)
+                                    editor_state.redo();
+                                return;
+                            }
+
+                            switch (ev.key_code) {
+                            case KeyCode::ESCAPE:
+                                editor_state.end_selection();
+                                break;
+                            case KeyCode::BACKSPACE:
+                                if (!erase_selection())
+                                    editor_state.on_key_backspace();
+                                break;
+                            case KeyCode::DELETE:
+                                if (!erase_selection())
+                                    editor_state.on_key_delete();
+                                break;
+                            case KeyCode::LEFT:
+                                if (ev.modifiers == 0 && editor_state.is_selected()) {
+                                    const auto selection_start = editor_state.get_selection_range().first;
+                                    editor_state.end_selection();
+                                    editor_state.set_cursor(selection_start);
+                                } else
+                                    move(ev, [&] { editor_state.move_left(); });
+                                editor_state.seal();
+                                break;
+                            case KeyCode::RIGHT:
+                                if (ev.modifiers == 0 && editor_state.is_selected()) {
+                                    const auto selection_end = editor_state.get_selection_range().second;
+                                    editor_state.end_selection();
+                                    editor_state.set_cursor(selection_end);
+                                } else
+                                    move(ev, [&] { editor_state.move_right(); });
+                                editor_state.seal();
+                                break;
+                            case KeyCode::UP:
+                                move(ev, [&] { editor_state.move_up(1, info.tab_width); });
+                                break;
+                            case KeyCode::DOWN:
+                                move(ev, [&] { editor_state.move_down(1, info.tab_width); });
+                                break;
+                            case KeyCode::PAGE_UP:
+                                move(ev, [&] { editor_state.move_up(page, info.tab_width); });
+                                break;
+                            case KeyCode::PAGE_DOWN:
+                                move(ev, [&] { editor_state.move_down(page, info.tab_width); });
+                                break;
+                            case KeyCode::HOME:
+                                move(ev, [&] { editor_state.go_home(); });
+                                editor_state.seal();
+                                break;
+                            case KeyCode::END:
+                                move(ev, [&] { editor_state.go_end(); });
+                                editor_state.seal();
+                                break;
+                            case KeyCode::INSERT:
+                                if (ev.modifiers == 0)
+                                    editor_state.toggle_insert_mode();
+                                break;
+                            case KeyCode::ENTER:
+                                erase_selection();
+                                editor_state.insert_char('\n');
+                                break;
+                            case KeyCode::TAB:
+                                erase_selection();
+                                if (info.expand_tabs) {
+                                    const size_t col = editor_state.get_visual_col(editor_state.get_cursor(), info.tab_width);
+                                    for (size_t i = glyph_width(L'\t', col, info.tab_width); i > 0; i--)
+                                        editor_state.insert_char(' ');
+                                } else
+                                    editor_state.insert_char('\t');
+                                break;
+                            default:
+                                if ((ev.modifiers == 0 || ev.modifiers & KEY_SHIFT) && std::isprint(ev.key_char)) {
+                                    erase_selection();
+                                    editor_state.insert_char(ev.key_char);
+                                }
+                                break;
+                            }
+                        },
+                        [&](const PasteEvent &ev) {
+                            editor_state.begin_step();
+                            follow_cursor = true;
+                            erase_selection();
+                            editor_state.insert_text(ev.text);
+                        }
+                );
+            }
+
+        if (info.on_change && editor_state.get_revision() != start_revision)
+            info.on_change(std::ref(info));
+
+        // Keep the cursor inside the viewport, unless only the wheel scrolled it
+        const size_t cursor = editor_state.get_cursor();
+        const size_t line_count = editor_state.get_line_count();
+        const size_t cursor_line = editor_state.get_line_of(cursor);
+        const size_t cursor_col = editor_state.get_visual_col(cursor, info.tab_width);
+        size_t top_line = std::min(editor_state.get_top_line(), line_count - 1);
+        size_t left_col = editor_state.get_left_col();
+        if (follow_cursor || editor_state.is_cursor_moved()) {
+            if (cursor_line < top_line)
+                top_line = cursor_line;
+            else if (info.size.height > 0 && cursor_line >= top_line + info.size.height)
+                top_line = cursor_line - info.size.height + 1;
+            if (cursor_col < left_col)
+                left_col = cursor_col;
+            else if (text_width > 0 && cursor_col >= left_col + text_width)
+                left_col = cursor_col - text_width + 1;
+        }
+        editor_state.set_scroll(top_line, left_col);
+
+        const Style cur_style = editor_state.is_selected()    ? info.cursor_style_sel
+                                : editor_state.is_insert_mode() ? info.cursor_style_ins
+                                                                : info.cursor_style;
+        const auto [selection_start, selection_end] = editor_state.get_selection_range();
+        const auto is_selected = [&](const size_t pos) {
+            return editor_state.is_selected() && selection_start <= pos && pos < selection_end;
+        };
+
+        BeginPane(state, info.pos, info.size);
+        for (size_t row = 0; row < info.size.height; row++) {
+            const size_t line = top_line + row;
+
+            // Draw the line number right aligned
+            if (gutter_width > 0) {
+                size_t number = line + 1;
+                for (size_t col = gutter_width; col > 0; col--) {
+                    wchar_t value = ' ';
+                    if (col < gutter_width && line < line_count && number > 0) {
+                        value = static_cast<wchar_t>('0' + number % 10);
+                        number /= 10;
+                    }
+                    state.impl->set_cell(col - 1, row, value, info.gutter_style);
+                }
+            }
+
+            size_t col = 0;
+            if (line < line_count) {
+                const size_t end = editor_state.get_line_end(line);
+                // Walk from the start of the line, but draw only the columns inside the viewport
+                for (size_t pos = editor_state.get_line_start(line); pos < end && col < left_col + text_width;) {
+                    wchar_t wc;
+                    const size_t len = decode_text_char(editor_state, pos, end, wc);
+                    const size_t width = glyph_width(wc, col, info.tab_width);
+                    const Style style = pos == cursor ? cur_style : is_selected(pos) ? info.selection_style : info.text_style;
+
+                    // Show the control characters as control pictures
+                    const bool is_tab = wc == L'\t';
+                    if (is_tab)
+                        wc = ' ';
+                    else if (wc < 0x20)
+                        wc = static_cast<wchar_t>(0x2400 + wc);
+                    else if (wc == 0x7f)
+                        wc = static_cast<wchar_t>(0x2421);
+
+                    if (width == 0) {
+                        // Joins the glyph before it if that is visible
+                        if (col > left_col && col <= left_col + text_width)
+                            state.impl->set_cell(gutter_width + col - left_col, row, wc, style);
+                    } else if (!is_tab && col >= left_col && col + width <= left_col + text_width) {
+                        state.impl->set_cell(gutter_width + col - left_col, row, wc, style);
+                        col += width;
+                    } else
+                        // The tabs and the wide glyphs cut by the viewport are drawn as blanks
+                        for (size_t i = 0; i < width; i++, col++)
+                            if (col >= left_col && col < left_col + text_width)
+                                state.impl->set_cell(gutter_width + col - left_col, row, L' ', style);
+                    pos += len;
+                }
+
+                // The cursor or the selection on the line break
+                if (col >= left_col && col < left_col + text_width && (cursor == end || is_selected(end))) {
+                    state.impl->set_cell(gutter_width + col - left_col, row, ' ', cursor == end ? cur_style : info.selection_style);
+                    col++;
+                }
+            }
+
+            for (col = std::max(col, left_col); col < left_col + text_width; col++)
+                state.impl->set_cell(gutter_width + col - left_col, row, ' ', info.text_style);
+        }
+        EndPane(state);
+    }
+
+    static void compute_check_box(std::pmr::vector<StyledChar> &result, const CheckBoxValue value, const CheckBoxInfo &info) {
+        result.clear();
+        switch (value) {
+        case CheckBoxValue::UNCHECKED:
+            result.push_back(info.check_box.unchecked);
+            result.push_back({' ', info.check_box.unchecked.style});
+            // result.push_back({' ', info.check_box.unchecked.style});
+            break;
+        case CheckBoxValue::CHECKED:
+            result.push_back(info.check_box.checked);
+            result.push_back({' ', info.check_box.checked.style});
+            // result.push_back({' ', info.check_box.checked.style});
+            break;
+        case CheckBoxValue::INDETERMINATE:
+            result.push_back(info.check_box.indeterm);
+            result.push_back({' ', info.check_box.indeterm.style});
+            // result.push_back({' ', info.check_box.indeterm.style});
+            break;
+        }
+        for (size_t i = 0; i < info.text.size();) {
+            wchar_t wc;
+            i += decode_char(info.text, i, wc);
+            result.push_back(StyledChar{wc, info.style});
+        }
+    }
+
+    void CheckBox(State &state, CheckBoxValue &value, CheckBoxInfo info) {
+        if (!info.allow_indeterm && value == CheckBoxValue::INDETERMINATE)
+            value = CheckBoxValue::UNCHECKED;
+
+        const auto click_action = [&]() {
+            switch (value) {
+            case CheckBoxValue::UNCHECKED:
+                value = CheckBoxValue::CHECKED;
+                break;
+            case CheckBoxValue::CHECKED:
+                value = info.allow_indeterm ? CheckBoxValue::INDETERMINATE : CheckBoxValue::UNCHECKED;
+                break;
+            case CheckBoxValue::INDETERMINATE:
+                value = CheckBoxValue::UNCHECKED;
+                break;
+            }
+        };
+
+        if (info.focus)
+            for (const auto &event: state.impl->events)
+                HandleEvent(event, [&](const KeyEvent &ev) {
+                    if (ev.key_down && ev.modifiers == 0 && ev.key_code == KeyCode::ENTER) {
+                        click_action();
+                        if (info.on_click)
+                            info.on_click(std::ref(info));
+                    }
+                });
+
+        // The text lives in the frame allocator, the handlers recompute it in place
+        std::pmr::vector<StyledChar> text(GetFrameAllocator(state));
+        compute_check_box(text, value, info);
+        // clang-format off
+        RichTextView(state, {
+            .text = text,
+            .pos = info.pos,
+            .on_hover =
+                [&](RichTextViewInfo &text_info) {
+                    if (info.on_hover)
+                        info.on_hover(std::ref(info));
+                    compute_check_box(text, value, info);
+                    text_info.text = text;
+                },
+            .on_click =
+                [&](RichTextViewInfo &text_info) {
+                    click_action();
+                    if (info.on_click)
+                        info.on_click(std::ref(info));
+                    compute_check_box(text, value, info);
+                    text_info.text = text;
+                },
+            .on_click2 =
+                [&](RichTextViewInfo &text_info) {
+                    click_action();
+                    if (info.on_click2)
+                        info.on_click2(std::ref(info));
+                    compute_check_box(text, value, info);
+                    text_info.text = text;
+                },
+            .on_menu =
+                [&](RichTextViewInfo &text_info) {
+                    if (info.on_menu)
+                        info.on_menu(std::ref(info));
+                    compute_check_box(text, value, info);
+                    text_info.text = text;
+                }    
+        });
+        // clang-format on
+    }
+
+    // Merges event into the mouse event if both are motion events or scroll events in the same direction
+    static bool merge_mouse_event(MouseEvent &into, const Event &event) {
+        const MouseEvent *mev = std::get_if<MouseEvent>(&event);
+        if (mev == nullptr || mev->kind != into.kind || mev->modifiers != into.modifiers)
+            return false;
+
+        switch (into.kind) {
+        case MouseEventKind::MOVED:
+            into.pos = mev->pos;
+            return true;
+        case MouseEventKind::SCROLL_DOWN:
+        case MouseEventKind::SCROLL_UP:
+        case MouseEventKind::SCROLL_LEFT:
+        case MouseEventKind::SCROLL_RIGHT:
+            if (mev->pos != into.pos)
+                return false;
+            into.count += mev->count;
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    static bool poll_coalesced_event(State &state, Event &event) {
+        if (state.impl->held_event) {
+            event = std::move(*state.impl->held_event);
+            state.impl->held_event.reset();
+        } else if (!internal::PollRawEvent(event))
+            return false;
+
+        if (!state.impl->coalesce_events)
+            return true;
+        MouseEvent *mev = std::get_if<MouseEvent>(&event);
+        if (mev == nullptr || mev->kind == MouseEventKind::CLICK || mev->kind == MouseEventKind::DOUBLE_CLICK)
+            return true;
+
+        // Read ahead until an event that cannot be merged, which is kept for the next call
+        Event next;
+        while (internal::PollRawEvent(next)) {
+            if (!merge_mouse_event(*mev, next)) {
+                state.impl->held_event = std::move(next);
+                break;
+            }
+        }
+        return true;
+    }
+
+    bool PollEvent(State &state, Event &event) {
+        const size_t allocations = GetAllocationCount();
+        const bool polled = poll_coalesced_event(state, event);
+        if (polled) {
+            state.impl->events.push_back(event);
+            // clang-format off
+            HandleEvent(
+                event,
+                [&](const KeyEvent &ev) {
+                    const size_t index = static_cast<size_t>(ev.key_code);
+                    if (ev.key_down) {
+                        if (!state.impl->keys_down.test(index))
+                            state.impl->keys_pressed.set(index);
+                        state.impl->keys_down.set(index);
+                    } else {
+                        if (state.impl->keys_down.test(index))
+                            state.impl->keys_released.set(index);
+                        state.impl->keys_down.reset(index);
+                    }
+                },
+                [&](const MouseEvent &ev) {
+                    switch (ev.kind) {
+                    case MouseEventKind::MOVED:
+                        state.impl->mouse_pos = ev.pos;
+                        break;
+                    default:
+                        break;
+                    }
+                }
+            );
+            // clang-format on
+        }
+        state.impl->frame_stats.event_allocations += GetAllocationCount() - allocations;
+        return polled;
+    }
+
+    void SetEventCoalescing(const State &state, bool enabled) {
+        state.impl->coalesce_events = enabled;
+    }
+
+    bool IsEventCoalescing(const State &state) {
+        return state.impl->coalesce_events;
+    }
+
+    Result SetInputThread(State &state, bool enabled) {
+        $(internal::SetInputThread(enabled));
+        state.impl->input_thread = enabled;
+        return Result::Ok;
+    }
+
+    bool IsInputThreadEnabled(const State &state) {
+        return state.impl->input_thread;
+    }
+
+    bool IsKeyPressed(const State &state, KeyCode key_code) {
+        return state.impl->keys_pressed.test(static_cast<size_t>(key_code));
+    }
+
+    bool IsKeyReleased(const State &state, KeyCode key_code) {
+        return state.impl->keys_released.test(static_cast<size_t>(key_code));
+    }
+
+    bool IsKeyDown(const State &state, KeyCode key_code) {
+        return state.impl->keys_down.test(static_cast<size_t>(key_code));
+    }
+
+    bool IsKeyUp(const State &state, KeyCode key_code) {
+        return !IsKeyDown(state, key_code);
+    }
+
+    Position GetMousePos(const State &state) {
+        return state.impl->mouse_pos;
+    }
+
+    Position GetMouseRelPos(const State &state) {
+        return GetMousePos(state) - GetPanePosition(state);
+    }
+}    // namespace nite
+
+namespace nite::internal::console
+{
+    void set_style(const Style style) {
+        // Refer to: https://learn.microsoft.com/en-us/windows/console/console-virtual-terminal-sequences
+        // Refer to: https://invisible-island.net/xterm/ctlseqs/ctlseqs.html#h4-Functions-using-CSI-_-ordered-by-the-final-character-lparen-s-rparen:CSI-Pm-m.1CA7
+        if (style.mode & STYLE_RESET)
+            print(CSI "0m");
+        if (style.mode & STYLE_BOLD)
+            print(CSI "1m");
+        if (style.mode & STYLE_LIGHT)
+            print(CSI "2m");
+        if (style.mode & STYLE_ITALIC)
+            print(CSI "3m");
+        if (style.mode & STYLE_UNDERLINE)
+            print(CSI "4m");
+        if (style.mode & STYLE_BLINK)
+            print(CSI "5m");
+        if (style.mode & STYLE_INVERSE)
+            print(CSI "7m");
+        if (style.mode & STYLE_INVISIBLE)
+            print(CSI "8m");
+        if (style.mode & STYLE_CROSSED_OUT)
+            print(CSI "9m");
+        if (style.mode & STYLE_UNDERLINE2)
+            print(CSI "21m");
+
+        if ((style.mode & STYLE_NO_FG) == 0)
+            // Set foreground color
+            print(CSI "38;2;" + std::to_string(style.fg.r) + ";" + std::to_string(style.fg.g) + ";" + std::to_string(style.fg.b) + "m");
+
+        if ((style.mode & STYLE_NO_BG) == 0)
+            // Set background color
+            print(CSI "48;2;" + std::to_string(style.bg.r) + ";" + std::to_string(style.bg.g) + ";" + std::to_string(style.bg.b) + "m");
+    }
+
+    void gotoxy(const size_t col, const size_t row) {
+        print(CSI "" + std::to_string(row + 1) + ";" + std::to_string(col + 1) + "H");
+    }
+
+    static size_t prev_col = 0;
+    static size_t prev_row = 0;
+    static std::optional<Style> prev_style = std::nullopt;
+
+    // Appends the strings and numbers to out, without building temporary strings
+    template<typename... Parts>
+    static void append_sequence(std::string &out, const Parts... parts) {
+        const auto append = [&out]<typename Part>(const Part part) {
+            if constexpr (std::is_integral_v<Part>) {
+                char buf[std::numeric_limits<Part>::digits10 + 2];
+                const auto end = std::to_chars(buf, buf + sizeof(buf), part).ptr;
+                out.append(buf, end);
+            } else
+                out += part;
+        };
+        (append(parts), ...);
+    }
+
+    void encode_cell(std::string &out, const size_t col, const size_t row, const std::span<const wchar_t> cluster, const size_t width, const Style style) {
+        if (prev_col + 1 == col && prev_row == row)
+            // no change, go with the flow
+            ;
+        else
+            // goto to the specified coords
+            append_sequence(out, CSI, row + 1, ";", col + 1, "H");
+
+        // update these, a wide glyph moves the cursor past its continuation
+        prev_col = col + std::max<size_t>(width, 1) - 1;
+        prev_row = row;
+
+        if (!prev_style || *prev_style != style) {
+            // set the console style
+            if (style.mode & STYLE_RESET)
+                out += (CSI "0m");
+            if (style.mode & STYLE_BOLD)
+                out += (CSI "1m");
+            if (style.mode & STYLE_LIGHT)
+                out += (CSI "2m");
+            if (style.mode & STYLE_ITALIC)
+                out += (CSI "3m");
+            if (style.mode & STYLE_UNDERLINE)
+                out += (CSI "4m");
+            if (style.mode & STYLE_BLINK)
+                out += (CSI "5m");
+            if (style.mode & STYLE_INVERSE)
+                out += (CSI "7m");
+            if (style.mode & STYLE_INVISIBLE)
+                out += (CSI "8m");
+            if (style.mode & STYLE_CROSSED_OUT)
+                out += (CSI "9m");
+            if (style.mode & STYLE_UNDERLINE2)
+                out += (CSI "21m");
+
+            if ((style.mode & STYLE_NO_FG) == 0)
+                // Set foreground color
+                append_sequence(out, CSI "38;2;", style.fg.r, ";", style.fg.g, ";", style.fg.b, "m");
+
+            if ((style.mode & STYLE_NO_BG) == 0)
+                // Set background color
+                append_sequence(out, CSI "48;2;", style.bg.r, ";", style.bg.g, ";", style.bg.b, "m");
+
+            prev_style = style;
+        }
+        // Now the main thing
+        for (const wchar_t value: cluster)
+            internal::utf8::append(out, value);
+    }
+
+    void set_cell(const size_t col, const size_t row, const wchar_t value, const Style style) {
+        std::string out;
+        encode_cell(out, col, row, std::span<const wchar_t>(&value, 1), internal::unicode::char_width(value), style);
+        print(out);
+    }
+
+    // Sink that the output is redirected to, the console itself if null
+    static std::shared_ptr<OutputSink> output_sink;
+
+    void set_sink(std::shared_ptr<OutputSink> sink) {
+        output_sink = std::move(sink);
+    }
+
+    // Makes the next set_cell() write an explicit position and style,
+    // used when the console may have moved the cursor or changed attributes
+    static void forget_cursor() {
+        prev_row = std::numeric_limits<size_t>::max();
+        prev_style = std::nullopt;
+    }
+
+    // void set_cell(const size_t col, const size_t row, const wchar_t value, const Style style) {
+    //     gotoxy(col, row);
+    //     set_style(style);
+    //     print(wc_to_str(value));
+    // }
+}    // namespace nite::internal::console
+
+#ifdef OS_WINDOWS
+#    include <fcntl.h>
+#    include <io.h>
+#    include <sys/stat.h>
+#else
+#    include <fcntl.h>
+#    include <unistd.h>
+#endif
+
+namespace nite
+{
+    FdSink::FdSink(const int fd) : fd(fd) {}
+
+    Result FdSink::write(std::string_view data, size_t &calls) {
+        if (fd < 0)
+            return Result::Error("error writing to the sink: invalid file descriptor");
+        while (!data.empty()) {
+#ifdef OS_WINDOWS
+            const int written = _write(fd, data.data(), static_cast<unsigned>(std::min<size_t>(data.size(), INT_MAX)));
+#else
+            const ssize_t written = ::write(fd, data.data(), data.size());
+#endif
+            calls++;
+            if (written == -1) {
+                if (errno == EINTR)
+                    continue;
+                return Result::Error("error writing to the sink: {}", std::strerror(errno));
+            }
+            data.remove_prefix(static_cast<size_t>(written));
+        }
+        return Result::Ok;
+    }
+
+#ifdef OS_WINDOWS
+    FileSink::FileSink(const std::string &path)
+        : FdSink(_open(path.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE)) {}
+
+    FileSink::~FileSink() {
+        if (fd >= 0)
+            _close(fd);
+    }
+#else
+    FileSink::FileSink(const std::string &path) : FdSink(open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) {}
+
+    FileSink::~FileSink() {
+        if (fd >= 0)
+            close(fd);
+    }
+#endif
+
+    Result MemorySink::write(const std::string_view data, size_t &) {
+        buffer.append(data);
+        return Result::Ok;
+    }
+}    // namespace nite
+
+namespace nite
+{
+    size_t ScriptedInput::read(char *buffer, const size_t size) {
+        const size_t count = std::min(size, pending.size() - offset);
+        std::memcpy(buffer, pending.data() + offset, count);
+        offset += count;
+        if (offset == pending.size()) {
+            pending.clear();
+            offset = 0;
+        }
+        return count;
+    }
+
+    class VirtualTerminal::VirtualTerminalImpl {
+        enum class ParseState {
+            GROUND,
+            ESCAPE,
+            CSI_PARAM,
+            OSC_STRING,
+            OSC_ESCAPE,
+        };
+
+        internal::CellBuffer screen;
+        Position cursor;
+        Position saved_cursor;
+        bool wrap_pending = false;    // The last column was printed, the next character wraps
+        Style style = {.mode = 0};
+
+        ParseState parse_state = ParseState::GROUND;
+        std::array<uint32_t, 16> params = {};
+        size_t num_params = 0;
+        char marker = 0;    // Private marker of a CSI sequence: '?', '<', '=' or '>'
+        uint32_t code_point = 0;
+        size_t utf8_remaining = 0;
+        size_t compacted_clusters = 0;    // Size of the cluster pool after it was last compacted
+
+      public:
+        Stats stats;
+
+        VirtualTerminalImpl(const Size size) : screen(size) {
+            screen.fill(blank());
+        }
+
+        const internal::CellBuffer &get_screen() const {
+            return screen;
+        }
+
+        Position get_cursor() const {
+            return cursor;
+        }
+
+        void resize(const Size size) {
+            screen.resize(size, blank());
+            cursor.col = std::min(cursor.col, size.width == 0 ? 0 : size.width - 1);
+            cursor.row = std::min(cursor.row, size.height == 0 ? 0 : size.height - 1);
+            wrap_pending = false;
+        }
+
+        void feed(const std::string_view data) {
+            stats.bytes += data.size();
+            for (const char c : data)
+                feed(static_cast<unsigned char>(c));
+            // The clusters that were overwritten stay in the pool until it is compacted
+            if (screen.get_cluster_pool_size() > 2 * compacted_clusters + 1024) {
+                screen.compact_clusters();
+                compacted_clusters = screen.get_cluster_pool_size();
+            }
+        }
+
+      private:
+        internal::Cell blank() const {
+            return internal::Cell{.value = ' ', .style = {.bg = style.bg, .fg = style.fg, .mode = 0}};
+        }
+
+        uint32_t param(const size_t index, const uint32_t default_value) const {
+            return index < num_params && params[index] != 0 ? params[index] : default_value;
+        }
+
+        void erase(const size_t from, const size_t to) {
+            const internal::Cell cell = blank();
+            const Size size = screen.size();
+            if (from >= to || from >= size.width * size.height)
+                return;
+            // The wide glyphs at the ends of the range are erased entirely
+            screen.split_glyph(from % size.width, from / size.width);
+            const size_t last = std::min(to, size.width * size.height) - 1;
+            screen.split_glyph(last % size.width, last / size.width);
+            for (size_t i = from; i < to && i < size.width * size.height; i++)
+                screen.at(i % size.width, i / size.width) = cell;
+        }
+
+        // Moves the rows in [top, bottom) up by count, filling the exposed rows with blanks
+        void scroll_up(const size_t top, const size_t bottom, size_t count) {
+            const size_t width = screen.get_width();
+            count = std::min(count, bottom - top);
+            for (size_t row = top; row + count < bottom; row++)
+                for (size_t col = 0; col < width; col++)
+                    screen.at(col, row) = screen.at(col, row + count);
+            erase((bottom - count) * width, bottom * width);
+        }
+
+        // Moves the rows in [top, bottom) down by count, filling the exposed rows with blanks
+        void scroll_down(const size_t top, const size_t bottom, size_t count) {
+            const size_t width = screen.get_width();
+            count = std::min(count, bottom - top);
+            for (size_t row = bottom; row-- > top + count;)
+                for (size_t col = 0; col < width; col++)
+                    screen.at(col, row) = screen.at(col, row - count);
+            erase(top * width, (top + count) * width);
+        }
+
+        void line_feed() {
+            if (cursor.row + 1 >= screen.get_height())
+                scroll_up(0, screen.get_height(), 1);
+            else
+                cursor.row++;
+        }
+
+        void print(const uint32_t cp) {
+            stats.printed++;
+            const Size size = screen.size();
+            if (size.width == 0 || size.height == 0)
+                return;
+
+            // A zero width character joins the glyph printed before the cursor
+            wchar_t value = internal::utf8::to_wchar(cp);
+            size_t width = internal::unicode::char_width(value);
+            if (width != 1 && (wrap_pending || cursor.col > 0)) {
+                size_t col = wrap_pending ? cursor.col : cursor.col - 1;
+                if (col > 0 && screen.at(col, cursor.row).width == 0)
+                    col--;
+                if (internal::unicode::joins_cluster(screen.get_cluster(screen.at(col, cursor.row)).back(), value)) {
+                    screen.append_to_cluster(col, cursor.row, value);
+                    return;
+                }
+            } else if (width == 0)
+                return;
+
+            if (wrap_pending) {
+                cursor.col = 0;
+                line_feed();
+                wrap_pending = false;
+            }
+            // A wide glyph that does not fit in the rest of the row goes to the next row
+            if (width == 2 && cursor.col + 1 >= size.width) {
+                if (size.width < 2) {
+                    value = ' ';
+                    width = 1;
+                } else {
+                    screen.split_glyph(cursor.col, cursor.row);
+                    screen.at(cursor) = blank();
+                    cursor.col = 0;
+                    line_feed();
+                }
+            }
+
+            screen.split_glyph(cursor.col, cursor.row);
+            if (width == 2)
+                screen.split_glyph(cursor.col + 1, cursor.row);
+            screen.at(cursor) = internal::Cell{.value = value, .style = style, .width = static_cast<uint8_t>(width)};
+            if (width == 2)
+                screen.at(cursor.col + 1, cursor.row) = internal::Cell{.value = 0, .style = style, .width = 0};
+            if (cursor.col + width >= size.width) {
+                cursor.col = size.width - 1;
+                wrap_pending = true;
+            } else
+                cursor.col += width;
+        }
+
+        void move_cursor(const int64_t col, const int64_t row) {
+            const Size size = screen.size();
+            cursor.col = static_cast<size_t>(std::clamp<int64_t>(col, 0, std::max<int64_t>(size.width, 1) - 1));
+            cursor.row = static_cast<size_t>(std::clamp<int64_t>(row, 0, std::max<int64_t>(size.height, 1) - 1));
+            wrap_pending = false;
+        }
+
+        void select_graphic_rendition() {
+            // Refer to: https://invisible-island.net/xterm/ctlseqs/ctlseqs.html#h4-Functions-using-CSI-_-ordered-by-the-final-character-lparen-s-rparen:CSI-Pm-m.1CA7
+            if (num_params == 0) {
+                style = Style{.mode = 0};
+                return;
+            }
+            for (size_t i = 0; i < num_params; i++) {
+                switch (params[i]) {
+                case 0:
+                    style = Style{.mode = 0};
+                    break;
+                case 1:
+                    style.mode |= STYLE_BOLD;
+                    break;
+                case 2:
+                    style.mode |= STYLE_LIGHT;
+                    break;
+                case 3:
+                    style.mode |= STYLE_ITALIC;
+                    break;
+                case 4:
+                    style.mode |= STYLE_UNDERLINE;
+                    break;
+                case 5:
+                    style.mode |= STYLE_BLINK;
+                    break;
+                case 7:
+                    style.mode |= STYLE_INVERSE;
+                    break;
+                case 8:
+                    style.mode |= STYLE_INVISIBLE;
+                    break;
+                case 9:
+                    style.mode |= STYLE_CROSSED_OUT;
+                    break;
+                case 21:
+                    style.mode |= STYLE_UNDERLINE2;
+                    break;
+                case 22:
+                    style.mode &= ~(STYLE_BOLD | STYLE_LIGHT);
+                    break;
+                case 23:
+                    style.mode &= ~STYLE_ITALIC;
+                    break;
+                case 24:
+                    style.mode &= ~(STYLE_UNDERLINE | STYLE_UNDERLINE2);
+                    break;
+                case 25:
+                    style.mode &= ~STYLE_BLINK;
+                    break;
+                case 27:
+                    style.mode &= ~STYLE_INVERSE;
+                    break;
+                case 28:
+                    style.mode &= ~STYLE_INVISIBLE;
+                    break;
+                case 29:
+                    style.mode &= ~STYLE_CROSSED_OUT;
+                    break;
+                case 38:
+                case 48: {
+                    // Only true colors are modelled, indexed colors are skipped
+                    Color &color = params[i] == 38 ? style.fg : style.bg;
+                    if (i + 1 < num_params && params[i + 1] == 2 && i + 4 < num_params) {
+                        color = Color::from_rgb(params[i + 2], params[i + 3], params[i + 4]);
+                        i += 4;
+                    } else if (i + 1 < num_params && params[i + 1] == 5)
+                        i += 2;
+                    break;
+                }
+                case 39:
+                    style.fg = Style{}.fg;
+                    break;
+                case 49:
+                    style.bg = Style{}.bg;
+                    break;
+                default:
+                    break;
+                }
+            }
+        }
+
+        void dispatch_csi(const char final) {
+            stats.sequences++;
+            // Modes, mouse and keyboard protocol requests do not change the screen
+            if (marker != 0)
+                return;
+
+            const Size size = screen.size();
+            const int64_t col = static_cast<int64_t>(cursor.col), row = static_cast<int64_t>(cursor.row);
+            const size_t index = cursor.row * size.width + cursor.col;
+            switch (final) {
+            case 'H':
+            case 'f':
+                move_cursor(param(1, 1) - 1, param(0, 1) - 1);
+                break;
+            case 'A':
+                move_cursor(col, row - param(0, 1));
+                break;
+            case 'B':
+                move_cursor(col, row + param(0, 1));
+                break;
+            case 'C':
+                move_cursor(col + param(0, 1), row);
+                break;
+            case 'D':
+                move_cursor(col - param(0, 1), row);
+                break;
+            case 'G':
+                move_cursor(param(0, 1) - 1, row);
+                break;
+            case 'd':
+                move_cursor(col, param(0, 1) - 1);
+                break;
+            case 'J':
+                switch (param(0, 0)) {
+                case 0:
+                    erase(index, size.width * size.height);
+                    break;
+                case 1:
+                    erase(0, index + 1);
+                    break;
+                default:
+                    erase(0, size.width * size.height);
+                    break;
+                }
+                break;
+            case 'K': {
+                const size_t line = cursor.row * size.width;
+                switch (param(0, 0)) {
+                case 0:
+                    erase(index, line + size.width);
+                    break;
+                case 1:
+                    erase(line, index + 1);
+                    break;
+                default:
+                    erase(line, line + size.width);
+                    break;
+                }
+                break;
+            }
+            case 'X':
+                erase(index, std::min<size_t>(index + param(0, 1), (cursor.row + 1) * size.width));
+                break;
+            case 'S':
+                scroll_up(0, size.height, param(0, 1));
+                break;
+            case 'T':
+                scroll_down(0, size.height, param(0, 1));
+                break;
+            case 'L':
+                scroll_down(cursor.row, size.height, param(0, 1));
+                break;
+            case 'M':
+                scroll_up(cursor.row, size.height, param(0, 1));
+                break;
+            case 'm':
+                select_graphic_rendition();
+                break;
+            default:
+                break;
+            }
+        }
+
+        void dispatch_escape(const char c) {
+            stats.sequences++;
+            switch (c) {
+            case '7':
+                saved_cursor = cursor;
+                break;
+            case '8':
+                move_cursor(saved_cursor.col, saved_cursor.row);
+                break;
+            case 'D':
+                line_feed();
+                break;
+            case 'E':
+                cursor.col = 0;
+                line_feed();
+                break;
+            case 'M':
+                if (cursor.row == 0)
+                    scroll_down(0, screen.get_height(), 1);
+                else
+                    cursor.row--;
+                break;
+            case 'c':
+                style = Style{.mode = 0};
+                screen.fill(blank());
+                move_cursor(0, 0);
+                break;
+            default:
+                break;
+            }
+        }
+
+        void feed(const unsigned char c) {
+            switch (parse_state) {
+            case ParseState::GROUND:
+                if (utf8_remaining > 0) {
+                    if ((c & 0xC0) == 0x80) {
+                        code_point = (code_point << 6) | (c & 0x3F);
+                        if (--utf8_remaining == 0)
+                            print(code_point);
+                        return;
                     }
+                    // Truncated sequence
+                    utf8_remaining = 0;
+                    print(0xFFFD);
                 }
-            );
-            // clang-format on
-            return true;
+
+                if (c == 0x1B)
+                    parse_state = ParseState::ESCAPE;
+                else if (c == '\r') {
+                    cursor.col = 0;
+                    wrap_pending = false;
+                } else if (c == '\n' || c == '\v' || c == '\f')
+                    line_feed();
+                else if (c == '\b')
+                    move_cursor(static_cast<int64_t>(cursor.col) - 1, cursor.row);
+                else if (c == '\t')
+                    move_cursor((cursor.col / 8 + 1) * 8, cursor.row);
+                else if (c < 0x20 || c == 0x7F)
+                    ;    // Other control characters do not change the screen
+                else if (c < 0x80)
+                    print(c);
+                else if ((c & 0xE0) == 0xC0) {
+                    code_point = c & 0x1F;
+                    utf8_remaining = 1;
+                } else if ((c & 0xF0) == 0xE0) {
+                    code_point = c & 0x0F;
+                    utf8_remaining = 2;
+                } else if ((c & 0xF8) == 0xF0) {
+                    code_point = c & 0x07;
+                    utf8_remaining = 3;
+                } else
+                    print(0xFFFD);
+                break;
+            case ParseState::ESCAPE:
+                if (c == '[') {
+                    parse_state = ParseState::CSI_PARAM;
+                    params.fill(0);
+                    num_params = 0;
+                    marker = 0;
+                } else if (c == ']')
+                    parse_state = ParseState::OSC_STRING;
+                else {
+                    parse_state = ParseState::GROUND;
+                    dispatch_escape(static_cast<char>(c));
+                }
+                break;
+            case ParseState::CSI_PARAM:
+                if (c >= '0' && c <= '9') {
+                    if (num_params == 0)
+                        num_params = 1;
+                    if (num_params <= params.size())
+                        params[num_params - 1] = params[num_params - 1] * 10 + (c - '0');
+                } else if (c == ';' || c == ':') {
+                    num_params = std::max<size_t>(num_params, 1) + 1;
+                } else if (c >= '<' && c <= '?') {
+                    marker = static_cast<char>(c);
+                } else if (c >= 0x40 && c <= 0x7E) {
+                    parse_state = ParseState::GROUND;
+                    num_params = std::min(num_params, params.size());
+                    dispatch_csi(static_cast<char>(c));
+                } else if (c == 0x1B)
+                    parse_state = ParseState::ESCAPE;
+                break;
+            case ParseState::OSC_STRING:
+                if (c == '\a') {
+                    parse_state = ParseState::GROUND;
+                    stats.sequences++;
+                } else if (c == 0x1B)
+                    parse_state = ParseState::OSC_ESCAPE;
+                break;
+            case ParseState::OSC_ESCAPE:
+                // Any escape ends the string, the string terminator is ESC '\'
+                parse_state = ParseState::GROUND;
+                stats.sequences++;
+                if (c != '\\')
+                    feed(c);
+                break;
+            }
         }
-        return false;
-    }
+    };
 
-    bool IsKeyPressed(const State &state, KeyCode key_code) {
-        if (const auto it = state.impl->key_states.find(key_code); it != state.impl->key_states.end())
-            return it->second.down && it->second.printable;
-        return false;
-    }
+    VirtualTerminal::VirtualTerminal(const Size size) : impl(std::make_unique<VirtualTerminalImpl>(size)) {}
 
-    bool IsKeyDown(const State &state, KeyCode key_code) {
-        if (const auto it = state.impl->key_states.find(key_code); it != state.impl->key_states.end())
-            return it->second.down;
-        return false;
-    }
+    VirtualTerminal::~VirtualTerminal() = default;
 
-    bool IsKeyUp(const State &state, KeyCode key_code) {
-        return !IsKeyDown(state, key_code);
+    Result VirtualTerminal::write(const std::string_view data, size_t &) {
+        impl->feed(data);
+        return Result::Ok;
     }
 
-    Position GetMousePos(const State &state) {
-        return state.impl->mouse_pos;
+    Size VirtualTerminal::get_size() const {
+        return impl->get_screen().size();
     }
 
-    Position GetMouseRelPos(const State &state) {
-        return GetMousePos(state) - GetPanePosition(state);
+    void VirtualTerminal::resize(const Size size) {
+        impl->resize(size);
     }
-}    // namespace nite
-
-namespace nite::internal::console
-{
-    void set_style(const Style style) {
-        // Refer to: https://learn.microsoft.com/en-us/windows/console/console-virtual-terminal-sequences
-        // Refer to: https://invisible-island.net/xterm/ctlseqs/ctlseqs.html#h4-Functions-using-CSI-_-ordered-by-the-final-character-lparen-s-rparen:CSI-Pm-m.1CA7
-        if (style.mode & STYLE_RESET)
-            print(CSI "0m");
-        if (style.mode & STYLE_BOLD)
-            print(CSI "1m");
-        if (style.mode & STYLE_LIGHT)
-            print(CSI "2m");
-        if (style.mode & STYLE_ITALIC)
-            print(CSI "3m");
-        if (style.mode & STYLE_UNDERLINE)
-            print(CSI "4m");
-        if (style.mode & STYLE_BLINK)
-            print(CSI "5m");
-        if (style.mode & STYLE_INVERSE)
-            print(CSI "7m");
-        if (style.mode & STYLE_INVISIBLE)
-            print(CSI "8m");
-        if (style.mode & STYLE_CROSSED_OUT)
-            print(CSI "9m");
-        if (style.mode & STYLE_UNDERLINE2)
-            print(CSI "21m");
-
-        if ((style.mode & STYLE_NO_FG) == 0)
-            // Set foreground color
-            print(CSI "38;2;" + std::to_string(style.fg.r) + ";" + std::to_string(style.fg.g) + ";" + std::to_string(style.fg.b) + "m");
 
-        if ((style.mode & STYLE_NO_BG) == 0)
-            // Set background color
-            print(CSI "48;2;" + std::to_string(style.bg.r) + ";" + std::to_string(style.bg.g) + ";" + std::to_string(style.bg.b) + "m");
+    StyledChar VirtualTerminal::get_cell(const size_t col, const size_t row) const {
+        const auto &screen = impl->get_screen();
+        if (!screen.contains(col, row))
+            return StyledChar{};
+        const internal::Cell &cell = screen.at(col, row);
+        return StyledChar{.value = screen.get_cluster(cell)[0], .style = cell.style};
     }
 
-    void gotoxy(const size_t col, const size_t row) {
-        print(CSI "" + std::to_string(row + 1) + ";" + std::to_string(col + 1) + "H");
+    std::string VirtualTerminal::get_text(const size_t row) const {
+        const auto &screen = impl->get_screen();
+        std::string text;
+        for (size_t col = 0; screen.contains(col, row); col++)
+            for (const wchar_t value: screen.get_cluster(screen.at(col, row)))
+                if (screen.at(col, row).width > 0)
+                    internal::utf8::append(text, value);
+        return text;
     }
 
-    static size_t prev_col = 0;
-    static size_t prev_row = 0;
-    static std::optional<Style> prev_style = std::nullopt;
-
-    void set_cell(const size_t col, const size_t row, const wchar_t value, const Style style) {
-        std::string out;
-
-        if (prev_col + 1 == col && prev_row == row)
-            // no change, go with the flow
-            ;
-        else
-            // goto to the specified coords
-            out += (CSI + std::to_string(row + 1) + ";" + std::to_string(col + 1) + "H");
-
-        // update these
-        prev_col = col;
-        prev_row = row;
+    Position VirtualTerminal::get_cursor() const {
+        return impl->get_cursor();
+    }
 
-        if (!prev_style || *prev_style != style) {
-            // set the console style
-            if (style.mode & STYLE_RESET)
-                out += (CSI "0m");
-            if (style.mode & STYLE_BOLD)
-                out += (CSI "1m");
-            if (style.mode & STYLE_LIGHT)
-                out += (CSI "2m");
-            if (style.mode & STYLE_ITALIC)
-                out += (CSI "3m");
-            if (style.mode & STYLE_UNDERLINE)
-                out += (CSI "4m");
-            if (style.mode & STYLE_BLINK)
-                out += (CSI "5m");
-            if (style.mode & STYLE_INVERSE)
-                out += (CSI "7m");
-            if (style.mode & STYLE_INVISIBLE)
-                out += (CSI "8m");
-            if (style.mode & STYLE_CROSSED_OUT)
-                out += (CSI "9m");
-            if (style.mode & STYLE_UNDERLINE2)
-                out += (CSI "21m");
+    const VirtualTerminal::Stats &VirtualTerminal::get_stats() const {
+        return impl->stats;
+    }
 
-            if ((style.mode & STYLE_NO_FG) == 0)
-                // Set foreground color
-                out += (CSI "38;2;" + std::to_string(style.fg.r) + ";" + std::to_string(style.fg.g) + ";" + std::to_string(style.fg.b) + "m");
+    void VirtualTerminal::reset_stats() {
+        impl->stats = Stats{};
+    }
 
-            if ((style.mode & STYLE_NO_BG) == 0)
-                // Set background color
-                out += (CSI "48;2;" + std::to_string(style.bg.r) + ";" + std::to_string(style.bg.g) + ";" + std::to_string(style.bg.b) + "m");
+    bool VirtualTerminal::matches(const State &state, Position *mismatch) const {
+        const internal::CellBuffer &frame = state.impl->get_front_buffer();
+        const internal::CellBuffer &screen = impl->get_screen();
+        if (frame.size() != screen.size()) {
+            if (mismatch)
+                *mismatch = Position{};
+            return false;
+        }
 
-            prev_style = style;
+        for (size_t row = 0; row < frame.get_height(); row++) {
+            for (size_t col = 0; col < frame.get_width(); col++) {
+                internal::Cell expected = frame.at(col, row);
+                expected.style.mode &= ~STYLE_RESET;
+                if (!frame.same_cell(expected, screen, screen.at(col, row))) {
+                    if (mismatch)
+                        *mismatch = Position{.col = col, .row = row};
+                    return false;
+                }
+            }
         }
-        // Now the main thing
-        out += wc_to_str(value);
-        print(out);
+        return true;
     }
-
-    // void set_cell(const size_t col, const size_t row, const wchar_t value, const Style style) {
-    //     gotoxy(col, row);
-    //     set_style(style);
-    //     print(wc_to_str(value));
-    // }
-}    // namespace nite::internal::console
+}    // namespace nite
 
 #ifdef OS_WINDOWS
 #    include <windows.h>
@@ -2703,6 +5703,13 @@ namespace nite::internal::console
         return Result::Ok;
     }
 
+    Result resize(const Size, const Size, bool &preserved) {
+        // The console reflows its buffer on resize, so start over from a blank screen
+        forget_cursor();
+        preserved = false;
+        return clear();
+    }
+
     Result size(size_t &width, size_t &height) {
         static const HANDLE h_con = GetStdHandle(STD_OUTPUT_HANDLE);
 
@@ -2719,11 +5726,29 @@ namespace nite::internal::console
 
     Result print(const std::string &text) {
         static const HANDLE h_con = GetStdHandle(STD_OUTPUT_HANDLE);
+        if (output_sink) {
+            size_t calls = 0;
+            return output_sink->write(text, calls);
+        }
         if (!WriteConsole(h_con, text.c_str(), text.size(), NULL, NULL))
             return Result::Error("error printing to console: {}", get_last_error());
         return Result::Ok;
     }
 
+    Result write_all(std::string_view text, size_t &calls) {
+        static const HANDLE h_con = GetStdHandle(STD_OUTPUT_HANDLE);
+        if (output_sink)
+            return output_sink->write(text, calls);
+        while (!text.empty()) {
+            DWORD written = 0;
+            calls++;
+            if (!WriteConsole(h_con, text.data(), static_cast<DWORD>(text.size()), &written, NULL))
+                return Result::Error("error printing to console: {}", get_last_error());
+            text.remove_prefix(written);
+        }
+        return Result::Ok;
+    }
+
     static DWORD old_in_mode = 0, old_out_mode = 0;
     static UINT old_console_cp = 0;
     static std::string old_locale;
@@ -2758,9 +5783,7 @@ namespace nite::internal::console
             return Result::Error("error setting console code page: {}", get_last_error());
 
         // Set locale to utf-8
-        old_locale = std::setlocale(LC_CTYPE, NULL);
-        if (std::setlocale(LC_CTYPE, NITE_DEFAULT_LOCALE) == NULL)
-            return Result::Error("error setting locale to '{}'", NITE_DEFAULT_LOCALE);
+        set_utf8_locale(old_locale);
 
         $(print(CSI "?1049h"));    // Enter alternate buffer
         $(print(CSI "?25l"));      // Hide console cursor
@@ -2778,8 +5801,7 @@ namespace nite::internal::console
         $(print(CSI "?1049l"));    // Exit alternate buffer
 
         // Restore locale
-        if (std::setlocale(LC_CTYPE, old_locale.c_str()) == NULL)
-            return Result::Error("error restoring locale to '{}'", old_locale);
+        restore_locale(old_locale);
 
         if (!SetConsoleOutputCP(old_console_cp))
             return Result::Error("error setting console code page: {}", get_last_error());
@@ -2799,6 +5821,18 @@ namespace nite::internal
     static bool get_key_mod(WORD virtual_key_code, uint8_t &key_mod);
     static bool get_key_code(WORD virtual_key_code, char key_char, KeyCode &key_code);
 
+    Result SetInputThread(bool enabled) {
+        if (enabled)
+            return Result::Error("input thread is not supported by this backend");
+        return Result::Ok;
+    }
+
+    Result SetInputSource(std::shared_ptr<InputSource> source) {
+        if (source)
+            return Result::Error("input sources are not supported by this backend");
+        return Result::Ok;
+    }
+
     bool PollRawEvent(Event &event) {
         // Console input handle
         static const HANDLE h_conin = GetStdHandle(STD_INPUT_HANDLE);
@@ -3427,6 +6461,13 @@ namespace nite::internal::console
         return Result::Ok;
     }
 
+    Result resize(const Size, const Size, bool &preserved) {
+        // curses redraws its own screen on resize, so start over from a blank screen
+        forget_cursor();
+        preserved = false;
+        return clear();
+    }
+
     Result size(size_t &width, size_t &height) {
         width = COLS;
         height = LINES;
@@ -3434,19 +6475,38 @@ namespace nite::internal::console
     }
 
     Result print(const std::string &text) {
+        if (output_sink) {
+            size_t calls = 0;
+            return output_sink->write(text, calls);
+        }
         if (write(STDOUT_FILENO, text.data(), text.size()) == -1)
             return Result::Error("error writing to the console: {}", get_last_error());
         return Result::Ok;
     }
 
+    Result write_all(std::string_view text, size_t &calls) {
+        if (output_sink)
+            return output_sink->write(text, calls);
+        // A single write() may be cut short by a signal or a full pipe
+        while (!text.empty()) {
+            const ssize_t written = write(STDOUT_FILENO, text.data(), text.size());
+            calls++;
+            if (written == -1) {
+                if (errno == EINTR)
+                    continue;
+                return Result::Error("error writing to the console: {}", get_last_error());
+            }
+            text.remove_prefix(static_cast<size_t>(written));
+        }
+        return Result::Ok;
+    }
+
     static std::string old_locale;
     static mmask_t old_mmask;
 
     Result init() {
         // Set locale to utf-8
-        old_locale = std::setlocale(LC_CTYPE, NULL);
-        if (std::setlocale(LC_CTYPE, NITE_DEFAULT_LOCALE) == NULL)
-            return Result::Error("error setting locale to '{}'", NITE_DEFAULT_LOCALE);
+        set_utf8_locale(old_locale);
 
         initscr();               // Start curses mode
         raw();                   // Make the terminal raw
@@ -3471,8 +6531,7 @@ namespace nite::internal::console
         endwin();    // End curses mode
 
         // Restore locale
-        if (std::setlocale(LC_CTYPE, old_locale.c_str()) == NULL)
-            return Result::Error("error restoring locale to '{}'", old_locale);
+        restore_locale(old_locale);
         return Result::Ok;
     }
 }    // namespace nite::internal::console
@@ -3481,6 +6540,18 @@ namespace nite::internal
 {
     Result get_key_code(char c, KeyCode &key_code);
 
+    Result SetInputThread(bool enabled) {
+        if (enabled)
+            return Result::Error("input thread is not supported by this backend");
+        return Result::Ok;
+    }
+
+    Result SetInputSource(std::shared_ptr<InputSource> source) {
+        if (source)
+            return Result::Error("input sources are not supported by this backend");
+        return Result::Ok;
+    }
+
     bool PollRawEvent(Event &event) {
         static std::vector<Event> pending_events;
 
@@ -3853,6 +6924,7 @@ namespace nite::internal
 #    else
 
 #        include <bits/types/struct_timeval.h>
+#        include <poll.h>
 #        include <sys/ioctl.h>
 #        include <sys/select.h>
 #        include <sys/types.h>
@@ -3875,21 +6947,71 @@ namespace nite::internal::console
         return Result::Ok;
     }
 
+    Result resize(const Size old_size, const Size new_size, bool &preserved) {
+        // Terminals keep the content of the region common to the old and new sizes
+        // in place, but may move the cursor to keep it on screen
+        forget_cursor();
+        // When the height shrinks with the cursor below the new bottom row, xterm and VTE
+        // scroll the content up instead, so the content is no longer where it was drawn
+        preserved = new_size.height >= old_size.height;
+        if (!preserved)
+            return clear();
+        return Result::Ok;
+    }
+
+    // Set from the SIGWINCH handler, which must not do anything other than
+    // storing to lock-free atomics (see: man 7 signal-safety)
+    static std::atomic<bool> size_changed = true;
+    static std::atomic<bool> resize_pending = false;
+    static_assert(std::atomic<bool>::is_always_lock_free);
+
+    static bool resize_handler_installed = false;
+    static struct sigaction old_winch_action;
+    static size_t cached_width = 0, cached_height = 0;
+
     Result size(size_t &width, size_t &height) {
-        struct winsize w;
-        if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &w) == -1)
-            return Result::Error("error getting console size: {}", get_last_error());
-        width = w.ws_col;
-        height = w.ws_row;
+        // While the handler is installed the size is queried only after a resize was signalled
+        if (!resize_handler_installed || size_changed.exchange(false, std::memory_order_acq_rel)) {
+            struct winsize w;
+            if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &w) == -1) {
+                size_changed.store(true, std::memory_order_release);
+                return Result::Error("error getting console size: {}", get_last_error());
+            }
+            cached_width = w.ws_col;
+            cached_height = w.ws_row;
+        }
+        width = cached_width;
+        height = cached_height;
         return Result::Ok;
     }
 
     Result print(const std::string &text) {
+        if (output_sink) {
+            size_t calls = 0;
+            return output_sink->write(text, calls);
+        }
         if (write(STDOUT_FILENO, text.data(), text.size()) == -1)
             return Result::Error("error writing to the console: {}", get_last_error());
         return Result::Ok;
     }
 
+    Result write_all(std::string_view text, size_t &calls) {
+        if (output_sink)
+            return output_sink->write(text, calls);
+        // A single write() may be cut short by a signal or a full pipe
+        while (!text.empty()) {
+            const ssize_t written = write(STDOUT_FILENO, text.data(), text.size());
+            calls++;
+            if (written == -1) {
+                if (errno == EINTR)
+                    continue;
+                return Result::Error("error writing to the console: {}", get_last_error());
+            }
+            text.remove_prefix(static_cast<size_t>(written));
+        }
+        return Result::Ok;
+    }
+
     static struct termios old_term, new_term;
     static std::string old_locale;
 
@@ -3912,9 +7034,20 @@ namespace nite::internal::console
             return Result::Error("error setting terminal attributes: {}", get_last_error());
 
         // Set locale to utf-8
-        old_locale = std::setlocale(LC_CTYPE, NULL);
-        if (std::setlocale(LC_CTYPE, NITE_DEFAULT_LOCALE) == NULL)
-            return Result::Error("error setting locale to '{}'", NITE_DEFAULT_LOCALE);
+        set_utf8_locale(old_locale);
+
+        // Track resizes, see: man 2 sigaction
+        struct sigaction sa{};
+        sa.sa_flags = SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        sa.sa_handler = [](int) {
+            size_changed.store(true, std::memory_order_release);
+            resize_pending.store(true, std::memory_order_release);
+        };
+        if (sigaction(SIGWINCH, &sa, &old_winch_action) == -1)
+            return Result::Error("error installing resize handler: {}", get_last_error());
+        size_changed.store(true, std::memory_order_release);
+        resize_handler_installed = true;
 
         $(print(CSI "?1049h"));    // Enter alternate buffer
         $(print(CSI "?25l"));      // Hide console cursor
@@ -3926,9 +7059,11 @@ namespace nite::internal::console
 
         // Enable kitty keyboard protocol
         // Refer to: https://sw.kovidgoyal.net/kitty/keyboard-protocol/#progressive-enhancement
-        // flags = 1 | 4 = 5
-        //       = `Disambiguate escape codes` and `Report alternate keys`
-        $(print(CSI ">5u"));
+        // flags = 1 | 2 | 4 | 8 = 15
+        //       = `Disambiguate escape codes`, `Report event types`, `Report alternate keys`
+        //         and `Report all keys as escape codes` (key releases are reported only for escape codes)
+        $(print(CSI ">15u"));
+        $(print(CSI "?u"));    // Query the enabled flags, terminals without support do not reply
 
         // Mouse specific
         $(print(CSI "?1000h"));    // Send Mouse X & Y on button press and release
@@ -3937,6 +7072,7 @@ namespace nite::internal::console
         $(print(CSI "?1006h"));    // Enable SGR Mouse Mode
         // Other specific
         $(print(CSI "?1004h"));    // Send FocusIn/FocusOut events
+        $(print(CSI "?2004h"));    // Enable bracketed paste mode
         $(print(CSI "?30l"));      // Do not show scroll bar
         return Result::Ok;
     }
@@ -3944,6 +7080,7 @@ namespace nite::internal::console
     Result restore() {
         // Other specific
         $(print(CSI "?30h"));      // Show scroll bar
+        $(print(CSI "?2004l"));    // Disable bracketed paste mode
         $(print(CSI "?1004l"));    // Do not send FocusIn/FocusOut events
         // Mouse specific
         $(print(CSI "?1006l"));    // Disable SGR Mouse Mode
@@ -3959,841 +7096,1094 @@ namespace nite::internal::console
         $(print(CSI "?1049l"));    // Exit alternate buffer
 
         // Restore locale
-        if (std::setlocale(LC_CTYPE, old_locale.c_str()) == NULL)
-            return Result::Error("error restoring locale to '{}'", old_locale);
+        restore_locale(old_locale);
         // Restore old terminal modes
         if (tcsetattr(STDIN_FILENO, TCSANOW, &old_term) == -1)
             return Result::Error("error setting terminal attributes: {}", get_last_error());
+        // Restore old resize handler
+        if (resize_handler_installed) {
+            resize_handler_installed = false;
+            if (sigaction(SIGWINCH, &old_winch_action, NULL) == -1)
+                return Result::Error("error restoring resize handler: {}", get_last_error());
+        }
         return Result::Ok;
     }
 }    // namespace nite::internal::console
 
 namespace nite::internal
 {
-    Result get_key_code(char c, KeyCode &key_code);
-
-    bool con_read(std::string &str) {
-        // more efficient version and takes all available input
-        static char buf[256];
-        memset(buf, 0, sizeof(buf));
-        str = "";
+    static bool get_key_code(char c, KeyCode &key_code);
 
+    // Reads the available input into the buffer waiting at most timeout_ms for it,
+    // returns the number of bytes read
+    static size_t con_read(char *buffer, const size_t size, const int timeout_ms) {
         fd_set rfds;
         FD_ZERO(&rfds);
         FD_SET(STDIN_FILENO, &rfds);
 
         struct timeval tv;
         tv.tv_sec = 0;
-        tv.tv_usec = 2 * 1000;
+        tv.tv_usec = timeout_ms * 1000;
 
-        for (;;) {
-            int ret = select(STDIN_FILENO + 1, &rfds, NULL, NULL, &tv);
-            if (ret == -1)
-                break;    // Call failed
-            if (ret == 0)
-                break;    // Nothing available
+        const int ret = select(STDIN_FILENO + 1, &rfds, NULL, NULL, &tv);
+        if (ret <= 0)
+            return 0;    // Call failed or nothing available
 
-            ssize_t len = read(STDIN_FILENO, buf, sizeof(buf));
-            if (len == -1)
-                break;    // Call failed
-            if (len == 0)
-                break;    // Nothing available
-
-            str.append(buf, len);
-        }
-        return !str.empty();
+        const ssize_t len = read(STDIN_FILENO, buffer, size);
+        if (len <= 0)
+            return 0;    // Call failed or nothing available
+        return static_cast<size_t>(len);
     }
 
     // -------------------------------------------------------------------
-    // <mouse_sequence> := CSI '<' NUMBER ';' NUMBER ';' NUMBER 'M';
+    // The input is decoded by a table driven state machine modelled after the DEC ANSI parser.
+    // Refer to: https://vt100.net/emu/dec_ansi_parser
+    //
+    // <mouse_sequence> := CSI '<' NUMBER ';' NUMBER ';' NUMBER ('M' | 'm');
     // <focus_sequence> := CSI ('O' | 'I');
+    // <paste_sequence> := CSI '200~' TEXT CSI '201~';
+    // <key_sequence>   := CSI NUMBER (':' NUMBER? (':' NUMBER?)?)? (';' NUMBER? (':' NUMBER)?)? [ABCDEFHPQSZu~]
+    //                   | ESC 'O' [ABCDFHPQRS]
+    //                   | ESC CHAR
+    //                   | CHAR;
     //
     // ESC      := \033
     // CSI      := \033\[
     // DIGIT    := [0-9]+
     // NUMBER   := DIGIT+
+    //
+    // The parser is fed the input as it arrives, so a sequence split across reads
+    // is completed by the next read. Apart from pasted text, nothing is allocated.
     // -------------------------------------------------------------------
 
-#        define PARSER_TERMINATOR '\n'
-
     class Parser {
-        size_t index = 0;
-        std::string text;
+        enum ParserState : uint8_t {
+            STATE_GROUND,
+            STATE_ESCAPE,
+            STATE_ESCAPE_INTERMEDIATE,
+            STATE_CSI_ENTRY,
+            STATE_CSI_PARAM,
+            STATE_CSI_INTERMEDIATE,
+            STATE_CSI_IGNORE,
+            STATE_SS3,
+            STATE_COUNT,
+        };
 
-        // Previous mouse click time point
-        nite_clock::time_point prev_mcl_tp = nite_clock::time_point();
+        enum ParserAction : uint8_t {
+            ACTION_NONE,
+            ACTION_KEY,             // Plain key typed in the ground state
+            ACTION_CLEAR,           // Start of a new sequence
+            ACTION_COLLECT,         // Private marker or intermediate byte
+            ACTION_PARAM,           // Parameter digit or separator
+            ACTION_ESC_DISPATCH,    // Final byte of an escape sequence
+            ACTION_CSI_DISPATCH,    // Final byte of a control sequence
+            ACTION_SS3_DISPATCH,    // Final byte of a single shift 3 sequence
+        };
 
-        Result parse_mouse(Event &event) {
-            const auto mev_tp = nite_clock::now();
+        struct Transition {
+            ParserAction action = ACTION_NONE;
+            ParserState next = STATE_GROUND;
+        };
 
-            $(expect_csi());
-            $(expect('<'));
+        using TransitionTable = std::array<std::array<Transition, 256>, STATE_COUNT>;
 
-            uint8_t control_byte = 0;
-            size_t x_coord = 0;
-            size_t y_coord = 0;
+        static constexpr TransitionTable make_transition_table() {
+            TransitionTable table{};
+            const auto set = [&](ParserState state, uint8_t first, uint8_t last, ParserAction action, ParserState next) {
+                for (size_t byte = first; byte <= last; byte++)
+                    table[state][byte] = {action, next};
+            };
 
-            $(expect_number(control_byte));
-            $(expect(';'));
-            $(expect_number(x_coord));
-            $(expect(';'));
-            $(expect_number(y_coord));
-            if (!match_any('M', 'm'))
-                return Result::Error("expected 'm' or 'M'");
+            set(STATE_GROUND, 0x00, 0xff, ACTION_KEY, STATE_GROUND);
 
-            // Bit layout of `control_byte`
-            // 0x * * * * * * * *
-            //    7 6 5 4 3 2 1 0
-            // 0 - button number
-            // 1 - button number
-            // 2 - shift
-            // 3 - meta or alt
-            // 4 - control
-            // 5 - mouse dragging (ignored)
-            // 6 - button number
-            // 7 - button number
-            MouseEventKind kind;
-            MouseButton button = MouseButton::NONE;
-            uint8_t modifiers = 0;
+            // ESC followed by a key is the key with alt pressed
+            set(STATE_ESCAPE, 0x00, 0x7f, ACTION_ESC_DISPATCH, STATE_GROUND);
+            set(STATE_ESCAPE, 0x20, 0x2f, ACTION_COLLECT, STATE_ESCAPE_INTERMEDIATE);
+            table[STATE_ESCAPE]['['] = {ACTION_CLEAR, STATE_CSI_ENTRY};
+            table[STATE_ESCAPE]['O'] = {ACTION_NONE, STATE_SS3};
 
-            const uint8_t button_number = (control_byte & 0b0000'0011) | ((control_byte & 0b1100'0000) >> 4);
-            const bool dragging = (control_byte & 0b0010'0000) == 0b0010'0000;
+            set(STATE_ESCAPE_INTERMEDIATE, 0x20, 0x2f, ACTION_COLLECT, STATE_ESCAPE_INTERMEDIATE);
+            set(STATE_ESCAPE_INTERMEDIATE, 0x30, 0x7e, ACTION_NONE, STATE_GROUND);
 
-            switch (button_number) {
-            case 0:
-                kind = dragging ? MouseEventKind::MOVED : MouseEventKind::CLICK;
-                button = dragging ? MouseButton::NONE : MouseButton::LEFT;
+            set(STATE_CSI_ENTRY, 0x20, 0x2f, ACTION_COLLECT, STATE_CSI_INTERMEDIATE);
+            set(STATE_CSI_ENTRY, 0x30, 0x3b, ACTION_PARAM, STATE_CSI_PARAM);
+            set(STATE_CSI_ENTRY, 0x3c, 0x3f, ACTION_COLLECT, STATE_CSI_PARAM);
+            set(STATE_CSI_ENTRY, 0x40, 0x7e, ACTION_CSI_DISPATCH, STATE_GROUND);
+
+            set(STATE_CSI_PARAM, 0x20, 0x2f, ACTION_COLLECT, STATE_CSI_INTERMEDIATE);
+            set(STATE_CSI_PARAM, 0x30, 0x3b, ACTION_PARAM, STATE_CSI_PARAM);
+            set(STATE_CSI_PARAM, 0x3c, 0x3f, ACTION_NONE, STATE_CSI_IGNORE);
+            set(STATE_CSI_PARAM, 0x40, 0x7e, ACTION_CSI_DISPATCH, STATE_GROUND);
+
+            set(STATE_CSI_INTERMEDIATE, 0x20, 0x2f, ACTION_COLLECT, STATE_CSI_INTERMEDIATE);
+            set(STATE_CSI_INTERMEDIATE, 0x30, 0x3f, ACTION_NONE, STATE_CSI_IGNORE);
+            set(STATE_CSI_INTERMEDIATE, 0x40, 0x7e, ACTION_CSI_DISPATCH, STATE_GROUND);
+
+            set(STATE_CSI_IGNORE, 0x20, 0x3f, ACTION_NONE, STATE_CSI_IGNORE);
+            set(STATE_CSI_IGNORE, 0x40, 0x7e, ACTION_NONE, STATE_GROUND);
+
+            set(STATE_SS3, 0x00, 0xff, ACTION_SS3_DISPATCH, STATE_GROUND);
+
+            // Control bytes inside a sequence are ignored, CAN and SUB abort it and ESC starts a new one
+            for (const ParserState state : {STATE_ESCAPE_INTERMEDIATE, STATE_CSI_ENTRY, STATE_CSI_PARAM, STATE_CSI_INTERMEDIATE,
+                                            STATE_CSI_IGNORE}) {
+                set(state, 0x00, 0x1f, ACTION_NONE, state);
+                table[state][0x7f] = {ACTION_NONE, state};
+            }
+            for (const ParserState state : {STATE_ESCAPE_INTERMEDIATE, STATE_CSI_ENTRY, STATE_CSI_PARAM, STATE_CSI_INTERMEDIATE,
+                                            STATE_CSI_IGNORE, STATE_SS3}) {
+                table[state][0x18] = {ACTION_NONE, STATE_GROUND};
+                table[state][0x1a] = {ACTION_NONE, STATE_GROUND};
+                table[state][0x1b] = {ACTION_CLEAR, STATE_ESCAPE};
+            }
+            table[STATE_GROUND][0x1b] = {ACTION_CLEAR, STATE_ESCAPE};
+            return table;
+        }
+
+        static constexpr size_t MAX_PARAMS = 16;
+        static constexpr uint32_t MAX_PARAM_VALUE = 0xFF'FFFF;
+
+        // Text between the bracketed paste markers is delivered as a single event
+        // Refer to: https://invisible-island.net/xterm/ctlseqs/ctlseqs.html#h2-Bracketed-Paste-Mode
+        static constexpr std::string_view PASTE_END = "\033[201~";
+
+        ParserState state = STATE_GROUND;
+
+        // Parameters of the current sequence
+        std::array<uint32_t, MAX_PARAMS> params{};
+        size_t num_params = 0;
+        uint32_t present_mask = 0;    // Bit i is set if params[i] has any digits
+        uint32_t sub_mask = 0;        // Bit i is set if params[i] was separated by ':'
+        bool params_overflow = false;
+        char marker = 0;
+        char intermediate = 0;
+
+        bool key_releases_reported = false;    // Whether the terminal reports key releases
+
+        bool in_paste = false;
+        bool paste_cr = false;    // Whether the previous pasted byte was a carriage return
+        size_t paste_matched = 0;
+        std::string paste_text;
+
+        // Previous mouse click time point
+        nite_clock::time_point prev_mcl_tp = nite_clock::time_point();
+
+        uint32_t param(const size_t i, const uint32_t default_value) const {
+            return i < num_params && (present_mask >> i & 1) ? params[i] : default_value;
+        }
+
+        bool is_sub_param(const size_t i) const {
+            return i < num_params && (sub_mask >> i & 1);
+        }
+
+        template<typename Emit>
+        void perform(const ParserAction action, const uint8_t byte, Emit &emit) {
+            switch (action) {
+            case ACTION_NONE:
                 break;
-            case 1:
-                kind = dragging ? MouseEventKind::MOVED : MouseEventKind::CLICK;
-                button = dragging ? MouseButton::NONE : MouseButton::MIDDLE;
+            case ACTION_KEY:
+                dispatch_key(byte, 0, emit);
                 break;
-            case 2:
-                kind = dragging ? MouseEventKind::MOVED : MouseEventKind::CLICK;
-                button = dragging ? MouseButton::NONE : MouseButton::RIGHT;
+            case ACTION_CLEAR:
+                num_params = 0;
+                present_mask = 0;
+                sub_mask = 0;
+                params_overflow = false;
+                marker = 0;
+                intermediate = 0;
                 break;
-            case 3:
-                kind = MouseEventKind::MOVED;
+            case ACTION_COLLECT:
+                if (0x3c <= byte && byte <= 0x3f)
+                    marker = static_cast<char>(byte);
+                else
+                    intermediate = static_cast<char>(byte);
                 break;
-            case 4:
-                kind = dragging ? MouseEventKind::MOVED : MouseEventKind::SCROLL_UP;
+            case ACTION_PARAM:
+                if (num_params == 0) {
+                    params[0] = 0;
+                    num_params = 1;
+                }
+                if (byte == ';' || byte == ':') {
+                    if (num_params == MAX_PARAMS) {
+                        params_overflow = true;
+                        break;
+                    }
+                    params[num_params] = 0;
+                    if (byte == ':')
+                        sub_mask |= 1u << num_params;
+                    num_params++;
+                } else if (!params_overflow) {
+                    uint32_t &value = params[num_params - 1];
+                    value = std::min(value * 10 + (byte - '0'), MAX_PARAM_VALUE);
+                    present_mask |= 1u << (num_params - 1);
+                }
                 break;
-            case 5:
-                kind = dragging ? MouseEventKind::MOVED : MouseEventKind::SCROLL_DOWN;
+            case ACTION_ESC_DISPATCH:
+                if (intermediate == 0)
+                    dispatch_key(byte, KEY_ALT, emit);
                 break;
-            case 6:
-                if (dragging)
-                    return Result::Error();
-                kind = MouseEventKind::SCROLL_LEFT;
+            case ACTION_CSI_DISPATCH:
+                dispatch_csi(byte, emit);
                 break;
-            case 7:
-                if (dragging)
-                    return Result::Error();
-                kind = MouseEventKind::SCROLL_RIGHT;
+            case ACTION_SS3_DISPATCH:
+                dispatch_ss3(byte, emit);
                 break;
-            default:
-                return Result::Error();
             }
+        }
 
-            if (kind == MouseEventKind::CLICK) {
-                // avoid mouse down events
-                if (current() == 'M') {
-                    kind = MouseEventKind::MOVED;
-                    button = MouseButton::NONE;
-                } else {
-                    // Double click time difference is 500ms
-                    if (mev_tp - prev_mcl_tp <= std::chrono::milliseconds(500)) {
-                        kind = MouseEventKind::DOUBLE_CLICK;
-                        prev_mcl_tp = nite_clock::time_point();
-                    } else
-                        prev_mcl_tp = mev_tp;
-                }
+        // Emits the key event followed by its release unless the terminal reports releases
+        template<typename Emit>
+        void emit_key(KeyEvent kev, const bool release_reported, Emit &emit) {
+            emit(kev);
+            if (kev.key_down && !release_reported) {
+                kev.key_down = false;
+                emit(kev);
             }
-
-            if ((control_byte >> 2) & 0b001)
-                modifiers |= KEY_SHIFT;
-            if ((control_byte >> 2) & 0b010)
-                modifiers |= KEY_ALT;
-            if ((control_byte >> 2) & 0b100)
-                modifiers |= KEY_CTRL;
-
-            event = MouseEvent{
-                    .kind = kind,
-                    .button = button,
-                    .pos = {.col = x_coord - 1, .row = y_coord - 1},
-                    .modifiers = modifiers,
-            };
-            return Result::Ok;
         }
 
-        // CSI NUMBER (':' NUMBER? (':' NUMBER?)?)? (';' NUMBER?)? [ABCDEFHPQSu~]
         // 0x0d         -> Enter key
         // 0x7f | 0x08  -> Backspace
         // 0x09         -> Tab
+        // 0x00         -> Ctrl + Space
+        // 0x01 - 0x1a  -> Ctrl + letter
         // any printable char
-        Result parse_key_and_focus(Event &event) {
-            switch (advance()) {
-            case 0x0d:    // Enter key
-                event = KeyEvent{
-                        .key_down = true,
-                        .key_code = KeyCode::ENTER,
-                        .key_char = current(),
-                        .modifiers = 0,
-                };
-                return Result::Ok;
+        template<typename Emit>
+        void dispatch_key(const uint8_t byte, const uint8_t modifiers, Emit &emit) {
+            KeyEvent kev{
+                    .key_down = true,
+                    .key_code = KeyCode::ESCAPE,
+                    .key_char = static_cast<char>(byte),
+                    .modifiers = modifiers,
+            };
+            switch (byte) {
+            case 0x0d:
+                kev.key_code = KeyCode::ENTER;
+                break;
             case 0x7f:
-            case 0x08:    // Backspace key
-                event = KeyEvent{
-                        .key_down = true,
-                        .key_code = KeyCode::BACKSPACE,
-                        .key_char = current(),
-                        .modifiers = 0,
-                };
-                return Result::Ok;
-            case 0x09:    // Tab key
-                event = KeyEvent{
-                        .key_down = true,
-                        .key_code = KeyCode::TAB,
-                        .key_char = current(),
-                        .modifiers = 0,
-                };
-                return Result::Ok;
-            case *ESC: {
-                $(expect('['));    // Now we are past the CSI
-
-                if (match('O')) {
-                    event = FocusEvent{.focus_gained = false};
-                    return Result::Ok;
-                } else if (match('I')) {
-                    event = FocusEvent{.focus_gained = true};
-                    return Result::Ok;
-                }
-
-                int key_val_unsh = 0;              // unshifted key val
-                std::optional<char> key_val_sh;    // shifted key val
-                std::optional<uint8_t> key_modifiers;
-                char functional;
-
-                $(expect_number(key_val_unsh));
-
-                if (match(':')) {
-                    if (uint8_t val; match_number(val))
-                        key_val_sh = val;
-                    if (match(':')) {
-                        size_t val;
-                        match_number(val);    // base layout key (ignored)
-                    }
-                }
-
-                if (match(';'))
-                    // Refer to: https://sw.kovidgoyal.net/kitty/keyboard-protocol/#modifiers
-                    if (uint8_t val; match_number(val))
-                        key_modifiers = saturated_sub(val, static_cast<uint8_t>(1));
-
-                if (match_any('A', 'B', 'C', 'D', 'E', 'F', 'H', 'P', 'Q', 'S', 'u', '~'))
-                    functional = current();
-                else
-                    return Result::Error("expected one of 'ABCDEFHPQSu~'");
-
-                KeyEvent kev;
+            case 0x08:
+                kev.key_code = KeyCode::BACKSPACE;
+                break;
+            case 0x09:
+                kev.key_code = KeyCode::TAB;
+                break;
+            case 0x00:
+                kev.key_code = KeyCode::SPACE;
+                kev.key_char = ' ';
+                kev.modifiers |= KEY_CTRL;
+                break;
+            default:
+                if (0x01 <= byte && byte <= 0x1a) {
+                    kev.key_code = static_cast<KeyCode>(byte - 0x01 + static_cast<int>(KeyCode::K_A));
+                    kev.key_char = static_cast<char>('a' + byte - 0x01);
+                    kev.modifiers |= KEY_CTRL;
+                } else if (!get_key_code(kev.key_char, kev.key_code))
+                    return;
+                break;
+            }
+            emit_key(kev, false, emit);
+        }
 
-                if (key_val_sh) {
-                    kev.key_char = *key_val_sh;
-                    $(get_key_code(kev.key_char, kev.key_code));
-                } else {
-                    if (key_val_unsh == 1) {
-                        switch (functional) {
-                        case 'A':
-                            kev.key_code = KeyCode::UP;
-                            break;
-                        case 'B':
-                            kev.key_code = KeyCode::DOWN;
-                            break;
-                        case 'C':
-                            kev.key_code = KeyCode::RIGHT;
-                            break;
-                        case 'D':
-                            kev.key_code = KeyCode::LEFT;
-                            break;
-                        case 'F':
-                            kev.key_code = KeyCode::END;
-                            break;
-                        case 'H':
-                            kev.key_code = KeyCode::HOME;
-                            break;
-                        case 'P':
-                            kev.key_code = KeyCode::F1;
-                            break;
-                        case 'Q':
-                            kev.key_code = KeyCode::F2;
-                            break;
-                        case 'S':
-                            kev.key_code = KeyCode::F4;
-                            break;
-                        default:
-                            return Result::Error("key not supported");
-                        }
-                    } else if (functional == '~') {
-                        switch (key_val_unsh) {
-                        case 1:
-                            // VT220 supports this
-                            kev.key_code = KeyCode::HOME;
-                            break;
-                        case 2:
-                            kev.key_code = KeyCode::INSERT;
-                            break;
-                        case 3:
-                            kev.key_code = KeyCode::DELETE;
-                            break;
-                        case 5:
-                            kev.key_code = KeyCode::PAGE_UP;
-                            break;
-                        case 6:
-                            kev.key_code = KeyCode::PAGE_DOWN;
-                            break;
-                        case 7:
-                            kev.key_code = KeyCode::HOME;
-                            break;
-                        case 8:
-                            kev.key_code = KeyCode::END;
-                            break;
-                        case 11:
-                            kev.key_code = KeyCode::F1;
-                            break;
-                        case 12:
-                            kev.key_code = KeyCode::F2;
-                            break;
-                        case 13:
-                            kev.key_code = KeyCode::F3;
-                            break;
-                        case 14:
-                            kev.key_code = KeyCode::F4;
-                            break;
-                        case 15:
-                            kev.key_code = KeyCode::F5;
-                            break;
-                        case 17:
-                            kev.key_code = KeyCode::F6;
-                            break;
-                        case 18:
-                            kev.key_code = KeyCode::F7;
-                            break;
-                        case 19:
-                            kev.key_code = KeyCode::F8;
-                            break;
-                        case 20:
-                            kev.key_code = KeyCode::F9;
-                            break;
-                        case 21:
-                            kev.key_code = KeyCode::F10;
-                            break;
-                        case 23:
-                            kev.key_code = KeyCode::F11;
-                            break;
-                        case 24:
-                            kev.key_code = KeyCode::F12;
-                            break;
-                        case 25:
-                            // VT220 supports this
-                            kev.key_code = KeyCode::F13;
-                            break;
-                        case 26:
-                            // VT220 supports this
-                            kev.key_code = KeyCode::F14;
-                            break;
-                        case 28:
-                            // VT220 supports this
-                            kev.key_code = KeyCode::F15;
-                            break;
-                        case 29:
-                            // VT220 supports this
-                            kev.key_code = KeyCode::F16;
-                            break;
-                        case 31:
-                            // VT220 supports this
-                            kev.key_code = KeyCode::F17;
-                            break;
-                        case 32:
-                            // VT220 supports this
-                            kev.key_code = KeyCode::F18;
-                            break;
-                        case 33:
-                            // VT220 supports this
-                            kev.key_code = KeyCode::F19;
-                            break;
-                        case 34:
-                            // VT220 supports this
-                            kev.key_code = KeyCode::F20;
-                            break;
-                        default:
-                            return Result::Error("key not supported");
-                        }
-                    } else if (functional == 'u') {
-                        switch (key_val_unsh) {
-                        case 9:
-                            kev.key_code = KeyCode::TAB;
-                            break;
-                        case 13:
-                            kev.key_code = KeyCode::ENTER;
-                            break;
-                        case 27:
-                            kev.key_code = KeyCode::ESCAPE;
-                            break;
-                        case 127:
-                            kev.key_code = KeyCode::BACKSPACE;
-                            break;
-                        case 57376:
-                            kev.key_code = KeyCode::F13;
-                            break;
-                        case 57377:
-                            kev.key_code = KeyCode::F14;
-                            break;
-                        case 57378:
-                            kev.key_code = KeyCode::F15;
-                            break;
-                        case 57379:
-                            kev.key_code = KeyCode::F16;
-                            break;
-                        case 57380:
-                            kev.key_code = KeyCode::F17;
-                            break;
-                        case 57381:
-                            kev.key_code = KeyCode::F18;
-                            break;
-                        case 57382:
-                            kev.key_code = KeyCode::F19;
-                            break;
-                        case 57383:
-                            kev.key_code = KeyCode::F20;
-                            break;
-                        case 57384:
-                            kev.key_code = KeyCode::F21;
-                            break;
-                        case 57385:
-                            kev.key_code = KeyCode::F22;
-                            break;
-                        case 57386:
-                            kev.key_code = KeyCode::F23;
-                            break;
-                        case 57387:
-                            kev.key_code = KeyCode::F24;
-                            break;
-                        case 57417:
-                            kev.key_code = KeyCode::LEFT;
-                            break;
-                        case 57418:
-                            kev.key_code = KeyCode::RIGHT;
-                            break;
-                        case 57419:
-                            kev.key_code = KeyCode::UP;
-                            break;
-                        case 57420:
-                            kev.key_code = KeyCode::DOWN;
-                            break;
-                        case 57421:
-                            kev.key_code = KeyCode::PAGE_UP;
-                            break;
-                        case 57422:
-                            kev.key_code = KeyCode::PAGE_DOWN;
-                            break;
-                        case 57423:
-                            kev.key_code = KeyCode::HOME;
-                            break;
-                        case 57424:
-                            kev.key_code = KeyCode::END;
-                            break;
-                        case 57425:
-                            kev.key_code = KeyCode::INSERT;
-                            break;
-                        case 57426:
-                            kev.key_code = KeyCode::DELETE;
-                            break;
-                        default:
-                            kev.key_char = static_cast<char>(key_val_unsh);
-                            $(get_key_code(kev.key_char, kev.key_code));
-                            break;
-                        }
-                    } else {
-                        kev.key_char = static_cast<char>(key_val_unsh);
-                        $(get_key_code(kev.key_char, kev.key_code));
-                    }
-                }
+        // ESC 'O' [ABCDFHPQRS]
+        template<typename Emit>
+        void dispatch_ss3(const uint8_t byte, Emit &emit) {
+            KeyCode key_code;
+            switch (byte) {
+            case 'A':
+                key_code = KeyCode::UP;
+                break;
+            case 'B':
+                key_code = KeyCode::DOWN;
+                break;
+            case 'C':
+                key_code = KeyCode::RIGHT;
+                break;
+            case 'D':
+                key_code = KeyCode::LEFT;
+                break;
+            case 'F':
+                key_code = KeyCode::END;
+                break;
+            case 'H':
+                key_code = KeyCode::HOME;
+                break;
+            case 'P':
+                key_code = KeyCode::F1;
+                break;
+            case 'Q':
+                key_code = KeyCode::F2;
+                break;
+            case 'R':
+                key_code = KeyCode::F3;
+                break;
+            case 'S':
+                key_code = KeyCode::F4;
+                break;
+            default:
+                return;
+            }
+            emit_key(
+                    KeyEvent{
+                            .key_down = true,
+                            .key_code = key_code,
+                            .key_char = 0,
+                            .modifiers = 0,
+                    },
+                    false, emit
+            );
+        }
 
-                if (key_modifiers) {
-                    const auto val = *key_modifiers;
-                    if (val & 0b0000'0001)
-                        kev.modifiers |= KEY_SHIFT;
-                    if (val & 0b0000'0010)
-                        kev.modifiers |= KEY_ALT;
-                    if (val & 0b0000'0100)
-                        kev.modifiers |= KEY_CTRL;
-                    if (val & 0b0000'1000)
-                        kev.modifiers |= KEY_SUPER;
-                    if (val & 0b0010'0000)
-                        kev.modifiers |= KEY_META;
-                }
+        template<typename Emit>
+        void dispatch_csi(const uint8_t final, Emit &emit) {
+            if (intermediate != 0)
+                return;
+            if (marker == '<') {
+                if (final == 'M' || final == 'm')
+                    dispatch_mouse(final, emit);
+                return;
+            }
+            if (marker == '?' && final == 'u') {
+                // Refer to: https://sw.kovidgoyal.net/kitty/keyboard-protocol/#progressive-enhancement
+                key_releases_reported = (param(0, 0) & 0b10) != 0;
+                return;
+            }
+            if (marker != 0)
+                return;    // Replies to other queries are not input
 
-                event = kev;
-                return Result::Ok;
+            if (num_params == 0 && (final == 'I' || final == 'O')) {
+                emit(FocusEvent{.focus_gained = final == 'I'});
+                return;
             }
-            default: {
-                KeyCode key_code;
-                $(get_key_code(current(), key_code));
-                event = KeyEvent{
-                        .key_down = true,
-                        .key_code = key_code,
-                        .key_char = current(),
-                        .modifiers = 0,
-                };
-                return Result::Ok;
+            if (final == '~' && param(0, 0) == 200) {
+                in_paste = true;
+                paste_cr = false;
+                paste_matched = 0;
+                paste_text.clear();
+                return;
             }
+            if (final == 'Z') {
+                emit_key(
+                        KeyEvent{
+                                .key_down = true,
+                                .key_code = KeyCode::TAB,
+                                .key_char = 0x09,
+                                .modifiers = KEY_SHIFT,
+                        },
+                        false, emit
+                );
+                return;
             }
+            dispatch_csi_key(final, emit);
         }
 
-        // CSI [ABCDHF]
-        // ESC 'O' [PQRS]
-        Result parse_key_legacy(Event &event) {
-            // TODO: implement all legacy key codes
-            $(expect(*ESC));
+        // CSI NUMBER (':' NUMBER? (':' NUMBER?)?)? (';' NUMBER? (':' NUMBER)?)? [ABCDEFHPQSu~]
+        template<typename Emit>
+        void dispatch_csi_key(const uint8_t functional, Emit &emit) {
+            const uint32_t key_val_unsh = param(0, 1);    // unshifted key val
+            // Shifted and base layout keys are sub parameters of the key
+            size_t mods_index = 1;
+            while (is_sub_param(mods_index))
+                mods_index++;
+            // Refer to: https://sw.kovidgoyal.net/kitty/keyboard-protocol/#modifiers
+            const uint32_t key_modifiers = saturated_sub(param(mods_index, 1), 1u);
+            // Refer to: https://sw.kovidgoyal.net/kitty/keyboard-protocol/#event-types
+            const uint32_t event_type = is_sub_param(mods_index + 1) ? param(mods_index + 1, 1) : 1;
+
+            KeyEvent kev{
+                    .key_down = event_type != 3,
+                    .key_code = KeyCode::ESCAPE,
+                    .key_char = 0,
+                    .modifiers = 0,
+                    .repeat = event_type == 2,
+            };
 
-            if (match('O')) {
-                KeyCode key_code;
-                switch (advance()) {
+            if (is_sub_param(1) && param(1, 0) != 0) {
+                if (param(1, 0) > 0x7f)
+                    return;
+                kev.key_char = static_cast<char>(param(1, 0));
+                if (!get_key_code(kev.key_char, kev.key_code))
+                    return;
+            } else if (key_val_unsh == 1 && functional != '~') {
+                switch (functional) {
+                case 'A':
+                    kev.key_code = KeyCode::UP;
+                    break;
+                case 'B':
+                    kev.key_code = KeyCode::DOWN;
+                    break;
+                case 'C':
+                    kev.key_code = KeyCode::RIGHT;
+                    break;
+                case 'D':
+                    kev.key_code = KeyCode::LEFT;
+                    break;
+                case 'F':
+                    kev.key_code = KeyCode::END;
+                    break;
+                case 'H':
+                    kev.key_code = KeyCode::HOME;
+                    break;
                 case 'P':
-                    key_code = KeyCode::F1;
+                    kev.key_code = KeyCode::F1;
                     break;
                 case 'Q':
-                    key_code = KeyCode::F2;
+                    kev.key_code = KeyCode::F2;
                     break;
                 case 'R':
-                    key_code = KeyCode::F3;
+                    kev.key_code = KeyCode::F3;
                     break;
                 case 'S':
-                    key_code = KeyCode::F4;
+                    kev.key_code = KeyCode::F4;
+                    break;
+                default:
+                    return;
+                }
+            } else if (functional == '~') {
+                switch (key_val_unsh) {
+                case 1:
+                    // VT220 supports this
+                    kev.key_code = KeyCode::HOME;
+                    break;
+                case 2:
+                    kev.key_code = KeyCode::INSERT;
+                    break;
+                case 3:
+                    kev.key_code = KeyCode::DELETE;
+                    break;
+                case 5:
+                    kev.key_code = KeyCode::PAGE_UP;
+                    break;
+                case 6:
+                    kev.key_code = KeyCode::PAGE_DOWN;
+                    break;
+                case 7:
+                    kev.key_code = KeyCode::HOME;
+                    break;
+                case 8:
+                    kev.key_code = KeyCode::END;
+                    break;
+                case 11:
+                    kev.key_code = KeyCode::F1;
+                    break;
+                case 12:
+                    kev.key_code = KeyCode::F2;
+                    break;
+                case 13:
+                    kev.key_code = KeyCode::F3;
+                    break;
+                case 14:
+                    kev.key_code = KeyCode::F4;
+                    break;
+                case 15:
+                    kev.key_code = KeyCode::F5;
+                    break;
+                case 17:
+                    kev.key_code = KeyCode::F6;
+                    break;
+                case 18:
+                    kev.key_code = KeyCode::F7;
+                    break;
+                case 19:
+                    kev.key_code = KeyCode::F8;
+                    break;
+                case 20:
+                    kev.key_code = KeyCode::F9;
+                    break;
+                case 21:
+                    kev.key_code = KeyCode::F10;
+                    break;
+                case 23:
+                    kev.key_code = KeyCode::F11;
+                    break;
+                case 24:
+                    kev.key_code = KeyCode::F12;
+                    break;
+                case 25:
+                    // VT220 supports this
+                    kev.key_code = KeyCode::F13;
+                    break;
+                case 26:
+                    // VT220 supports this
+                    kev.key_code = KeyCode::F14;
+                    break;
+                case 28:
+                    // VT220 supports this
+                    kev.key_code = KeyCode::F15;
+                    break;
+                case 29:
+                    // VT220 supports this
+                    kev.key_code = KeyCode::F16;
+                    break;
+                case 31:
+                    // VT220 supports this
+                    kev.key_code = KeyCode::F17;
+                    break;
+                case 32:
+                    // VT220 supports this
+                    kev.key_code = KeyCode::F18;
+                    break;
+                case 33:
+                    // VT220 supports this
+                    kev.key_code = KeyCode::F19;
+                    break;
+                case 34:
+                    // VT220 supports this
+                    kev.key_code = KeyCode::F20;
+                    break;
+                default:
+                    return;
+                }
+            } else if (functional == 'u') {
+                switch (key_val_unsh) {
+                case 9:
+                    kev.key_code = KeyCode::TAB;
+                    break;
+                case 13:
+                    kev.key_code = KeyCode::ENTER;
+                    break;
+                case 27:
+                    kev.key_code = KeyCode::ESCAPE;
+                    break;
+                case 127:
+                    kev.key_code = KeyCode::BACKSPACE;
+                    break;
+                case 57376:
+                    kev.key_code = KeyCode::F13;
+                    break;
+                case 57377:
+                    kev.key_code = KeyCode::F14;
+                    break;
+                case 57378:
+                    kev.key_code = KeyCode::F15;
+                    break;
+                case 57379:
+                    kev.key_code = KeyCode::F16;
+                    break;
+                case 57380:
+                    kev.key_code = KeyCode::F17;
+                    break;
+                case 57381:
+                    kev.key_code = KeyCode::F18;
+                    break;
+                case 57382:
+                    kev.key_code = KeyCode::F19;
+                    break;
+                case 57383:
+                    kev.key_code = KeyCode::F20;
+                    break;
+                case 57384:
+                    kev.key_code = KeyCode::F21;
+                    break;
+                case 57385:
+                    kev.key_code = KeyCode::F22;
+                    break;
+                case 57386:
+                    kev.key_code = KeyCode::F23;
+                    break;
+                case 57387:
+                    kev.key_code = KeyCode::F24;
+                    break;
+                case 57417:
+                    kev.key_code = KeyCode::LEFT;
+                    break;
+                case 57418:
+                    kev.key_code = KeyCode::RIGHT;
+                    break;
+                case 57419:
+                    kev.key_code = KeyCode::UP;
+                    break;
+                case 57420:
+                    kev.key_code = KeyCode::DOWN;
                     break;
-                default:
-                    return Result::Error("key not supported");
-                }
-                event = KeyEvent{
-                        .key_down = true,
-                        .key_code = key_code,
-                        .key_char = 0,
-                        .modifiers = 0,
-                };
-                return Result::Ok;
-            } else if (match('[')) {
-                KeyCode key_code;
-                switch (advance()) {
-                case 'A':
-                    key_code = KeyCode::UP;
+                case 57421:
+                    kev.key_code = KeyCode::PAGE_UP;
                     break;
-                case 'B':
-                    key_code = KeyCode::DOWN;
+                case 57422:
+                    kev.key_code = KeyCode::PAGE_DOWN;
                     break;
-                case 'C':
-                    key_code = KeyCode::RIGHT;
+                case 57423:
+                    kev.key_code = KeyCode::HOME;
                     break;
-                case 'D':
-                    key_code = KeyCode::LEFT;
+                case 57424:
+                    kev.key_code = KeyCode::END;
                     break;
-                case 'H':
-                    key_code = KeyCode::HOME;
+                case 57425:
+                    kev.key_code = KeyCode::INSERT;
                     break;
-                case 'F':
-                    key_code = KeyCode::END;
+                case 57426:
+                    kev.key_code = KeyCode::DELETE;
                     break;
                 default:
-                    return Result::Error("key not supported");
+                    if (key_val_unsh > 0x7f)
+                        return;
+                    kev.key_char = static_cast<char>(key_val_unsh);
+                    if (!get_key_code(kev.key_char, kev.key_code))
+                        return;
+                    break;
                 }
-                event = KeyEvent{
-                        .key_down = true,
-                        .key_code = key_code,
-                        .key_char = 0,
-                        .modifiers = 0,
-                };
-                return Result::Ok;
-            }
-
-            return Result::Error("key not supported");
+            } else
+                return;
+
+            if (key_modifiers & 0b0000'0001)
+                kev.modifiers |= KEY_SHIFT;
+            if (key_modifiers & 0b0000'0010)
+                kev.modifiers |= KEY_ALT;
+            if (key_modifiers & 0b0000'0100)
+                kev.modifiers |= KEY_CTRL;
+            if (key_modifiers & 0b0000'1000)
+                kev.modifiers |= KEY_SUPER;
+            if (key_modifiers & 0b0010'0000)
+                kev.modifiers |= KEY_META;
+            emit_key(kev, key_releases_reported, emit);
         }
 
-        bool parse(Event &event) {
-            if (text == ESC) {
-                advance();
-                event = KeyEvent{
-                        .key_down = true,
-                        .key_code = KeyCode::ESCAPE,
-                        .key_char = *ESC,
-                        .modifiers = 0,
-                };
-                return true;
+        // CSI '<' NUMBER ';' NUMBER ';' NUMBER ('M' | 'm')
+        template<typename Emit>
+        void dispatch_mouse(const uint8_t final, Emit &emit) {
+            if (num_params != 3 || sub_mask != 0 || present_mask != 0b111)
+                return;
+            const auto mev_tp = nite_clock::now();
+
+            const uint32_t control_byte = params[0];
+            const size_t x_coord = params[1];
+            const size_t y_coord = params[2];
+
+            // Bit layout of `control_byte`
+            // 0x * * * * * * * *
+            //    7 6 5 4 3 2 1 0
+            // 0 - button number
+            // 1 - button number
+            // 2 - shift
+            // 3 - meta or alt
+            // 4 - control
+            // 5 - mouse dragging (ignored)
+            // 6 - button number
+            // 7 - button number
+            MouseEventKind kind;
+            MouseButton button = MouseButton::NONE;
+            uint8_t modifiers = 0;
+
+            const uint8_t button_number = (control_byte & 0b0000'0011) | ((control_byte & 0b1100'0000) >> 4);
+            const bool dragging = (control_byte & 0b0010'0000) == 0b0010'0000;
+
+            switch (button_number) {
+            case 0:
+                kind = dragging ? MouseEventKind::MOVED : MouseEventKind::CLICK;
+                button = dragging ? MouseButton::NONE : MouseButton::LEFT;
+                break;
+            case 1:
+                kind = dragging ? MouseEventKind::MOVED : MouseEventKind::CLICK;
+                button = dragging ? MouseButton::NONE : MouseButton::MIDDLE;
+                break;
+            case 2:
+                kind = dragging ? MouseEventKind::MOVED : MouseEventKind::CLICK;
+                button = dragging ? MouseButton::NONE : MouseButton::RIGHT;
+                break;
+            case 3:
+                kind = MouseEventKind::MOVED;
+                break;
+            case 4:
+                kind = dragging ? MouseEventKind::MOVED : MouseEventKind::SCROLL_UP;
+                break;
+            case 5:
+                kind = dragging ? MouseEventKind::MOVED : MouseEventKind::SCROLL_DOWN;
+                break;
+            case 6:
+                if (dragging)
+                    return;
+                kind = MouseEventKind::SCROLL_LEFT;
+                break;
+            case 7:
+                if (dragging)
+                    return;
+                kind = MouseEventKind::SCROLL_RIGHT;
+                break;
+            default:
+                return;
             }
 
-            const size_t old_index = index;
-            if (parse_mouse(event))
-                return true;
+            if (kind == MouseEventKind::CLICK) {
+                // avoid mouse down events
+                if (final == 'M') {
+                    kind = MouseEventKind::MOVED;
+                    button = MouseButton::NONE;
+                } else {
+                    // Double click time difference is 500ms
+                    if (mev_tp - prev_mcl_tp <= std::chrono::milliseconds(500)) {
+                        kind = MouseEventKind::DOUBLE_CLICK;
+                        prev_mcl_tp = nite_clock::time_point();
+                    } else
+                        prev_mcl_tp = mev_tp;
+                }
+            }
 
-            index = old_index;
-            if (const auto result = parse_key_and_focus(event))
-                return true;
+            if ((control_byte >> 2) & 0b001)
+                modifiers |= KEY_SHIFT;
+            if ((control_byte >> 2) & 0b010)
+                modifiers |= KEY_ALT;
+            if ((control_byte >> 2) & 0b100)
+                modifiers |= KEY_CTRL;
 
-            index = old_index;
-            if (const auto result = parse_key_legacy(event))
-                return true;
-            return false;
+            emit(MouseEvent{
+                    .kind = kind,
+                    .button = button,
+                    .pos = {.col = saturated_sub(x_coord, size_t(1)), .row = saturated_sub(y_coord, size_t(1))},
+                    .modifiers = modifiers,
+            });
         }
 
-        Result expect_csi() {
-            if (peek() == *ESC && peek(1) == '[') {
-                advance();
-                advance();
-                return Result::Ok;
-            } else
-                return Result::Error("expected CSI sequence");
+        void append_paste(const char *data, const size_t size) {
+            // Terminals usually send line breaks as carriage returns
+            for (size_t i = 0; i < size; i++) {
+                const char c = data[i];
+                if (!(c == '\n' && paste_cr))
+                    paste_text.push_back(c == '\r' ? '\n' : c);
+                paste_cr = c == '\r';
+            }
         }
 
-        bool match_digit() {
-            if (const char c = peek(); '0' <= c && c <= '9') {
-                advance();
-                return true;
+        // Consumes pasted text up to and including the end marker, returns the number of bytes consumed
+        template<typename Emit>
+        size_t feed_paste(const char *data, const size_t size, Emit &emit) {
+            size_t i = 0;
+            while (i < size) {
+                if (paste_matched == 0 && data[i] != *ESC) {
+                    const void *esc = std::memchr(data + i, *ESC, size - i);
+                    const size_t end = esc != nullptr ? static_cast<size_t>(static_cast<const char *>(esc) - data) : size;
+                    append_paste(data + i, end - i);
+                    i = end;
+                    continue;
+                }
+                if (data[i] == PASTE_END[paste_matched]) {
+                    i++;
+                    if (++paste_matched == PASTE_END.size()) {
+                        in_paste = false;
+                        paste_matched = 0;
+                        emit(PasteEvent{std::move(paste_text)});
+                        paste_text.clear();
+                        return i;
+                    }
+                    continue;
+                }
+                // The partial marker turned out to be pasted text
+                append_paste(PASTE_END.data(), paste_matched);
+                paste_matched = 0;
             }
-            return false;
+            return i;
         }
 
-        template<std::integral Integer>
-        bool match_number(Integer &number) {
-            std::string str;
-            while (str.size() <= 4 && match_digit())
-                str += current();
-            if (str.empty())
-                return false;
+      public:
+        Parser() = default;
 
-            const auto result = std::from_chars<Integer>(str.data(), str.data() + str.size(), number, 10);
-            if (result.ec == std::errc())
-                return true;
-            return false;
-        }
+        ~Parser() = default;
 
-        template<std::integral Integer>
-        Result expect_number(Integer &number) {
-            if (match_number(number))
-                return Result::Ok;
-            return Result::Error("expected number");
+        // Returns true if the input ended in the middle of a sequence or a paste
+        bool is_incomplete() const {
+            return state != STATE_GROUND || in_paste;
         }
 
-        template<typename... Char>
-            requires(std::same_as<Char, char> && ...)
-        bool match_any(Char... chars) {
-            const char p = peek();
-            if (((p == chars) || ...)) {
-                advance();
-                return true;
+        template<typename Emit>
+        void feed(const char *data, const size_t size, Emit &&emit) {
+            static constexpr TransitionTable transition_table = make_transition_table();
+            size_t i = 0;
+            while (i < size) {
+                if (in_paste) {
+                    i += feed_paste(data + i, size - i, emit);
+                    continue;
+                }
+                const uint8_t byte = static_cast<uint8_t>(data[i++]);
+                const Transition transition = transition_table[state][byte];
+                perform(transition.action, byte, emit);
+                state = transition.next;
             }
-            return false;
         }
 
-        bool match(char c) {
-            if (peek() == c) {
-                advance();
-                return true;
-            }
-            return false;
+        // Emits an escape not followed by anything else as the escape key
+        template<typename Emit>
+        void flush(Emit &&emit) {
+            if (state != STATE_ESCAPE)
+                return;
+            state = STATE_GROUND;
+            emit_key(
+                    KeyEvent{
+                            .key_down = true,
+                            .key_code = KeyCode::ESCAPE,
+                            .key_char = *ESC,
+                            .modifiers = 0,
+                    },
+                    false, emit
+            );
         }
+    };
 
-        Result expect(char c) {
-            if (peek() == c) {
-                advance();
-                return Result::Ok;
+    static Parser parser;
+
+    // Reads and parses the input on a dedicated thread as soon as it arrives
+    class InputThread {
+        SpscRing<Event, 1024> ring;
+        std::thread thread;
+        std::atomic<bool> running = false;
+        int wake_pipe[2] = {-1, -1};    // Written to wake the thread up when it should stop
+
+        void run() {
+            char buffer[4096];
+            const auto emit = [this](Event ev) {
+                // Wait for the app to drain the ring instead of dropping input
+                while (!ring.push(std::move(ev)) && running.load(std::memory_order_relaxed))
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            };
+
+            // Block until input arrives, but wait only a little for the rest of an incomplete sequence
+            int timeout_ms = -1;
+            while (running.load(std::memory_order_relaxed)) {
+                struct pollfd fds[2] = {
+                        {.fd = STDIN_FILENO, .events = POLLIN, .revents = 0},
+                        {.fd = wake_pipe[0], .events = POLLIN, .revents = 0},
+                };
+                const int ret = poll(fds, 2, timeout_ms);
+                if (ret == -1) {
+                    if (errno == EINTR)
+                        continue;
+                    break;    // Call failed
+                }
+                if (ret == 0) {
+                    // An escape not followed by anything else is the escape key
+                    parser.flush(emit);
+                    timeout_ms = -1;
+                    continue;
+                }
+                if (fds[1].revents != 0)
+                    break;    // Asked to stop
+
+                const ssize_t len = read(STDIN_FILENO, buffer, sizeof(buffer));
+                if (len <= 0)
+                    break;    // Call failed or the input was closed
+                parser.feed(buffer, static_cast<size_t>(len), emit);
+                timeout_ms = parser.is_incomplete() ? 2 : -1;
             }
-            return Result::Error("expected '{}' found '{}'", c, peek());
         }
 
-        char current() const {
-            if (index == 0 || index - 1 >= text.size())
-                return PARSER_TERMINATOR;
-            return text[index - 1];
-        }
+      public:
+        InputThread() = default;
+        InputThread(const InputThread &) = delete;
+        InputThread &operator=(const InputThread &) = delete;
 
-        char peek(const size_t i = 0) const {
-            if (index + i >= text.size())
-                return PARSER_TERMINATOR;
-            return text[index + i];
+        ~InputThread() {
+            stop();
         }
 
-        char advance() {
-            if (index >= text.size())
-                return PARSER_TERMINATOR;
-            return text[index++];
+        bool is_running() const {
+            return thread.joinable();
         }
 
-      public:
-        explicit Parser(const std::string &text) : text(text) {}
+        Result start() {
+            if (is_running())
+                return Result::Ok;
+            if (pipe(wake_pipe) == -1)
+                return Result::Error("error creating pipe: {}", console::get_last_error());
+            running = true;
+            thread = std::thread(&InputThread::run, this);
+            return Result::Ok;
+        }
 
-        ~Parser() = default;
+        void stop() {
+            if (!is_running())
+                return;
+            running = false;
+            const char byte = 0;
+            [[maybe_unused]] const ssize_t ret = write(wake_pipe[1], &byte, 1);
+            thread.join();
+            close(wake_pipe[0]);
+            close(wake_pipe[1]);
+            wake_pipe[0] = wake_pipe[1] = -1;
+        }
 
-        std::queue<Event> parse_events() {
-            std::queue<Event> events;
-            while (index < text.size()) {
-                if (Event event; parse(event))
-                    events.push(event);
-            }
-            return events;
+        bool pop(Event &event) {
+            return ring.pop(event);
         }
     };
 
-    bool PollRawEvent(Event &event) {
-        static std::queue<Event> pending_events = []() {
-            // See: man 2 sigaction
-            static struct sigaction sa{};
-            sa.sa_flags = 0;
-            sigemptyset(&sa.sa_mask);
-            sa.sa_handler = [](int) { pending_events.push(ResizeEvent{GetWindowSize()}); };
-            sigaction(SIGWINCH, &sa, NULL);
+    static InputThread input_thread;
 
-            return std::queue<Event>();
-        }();
+    static std::shared_ptr<InputSource> input_source;
 
-        std::string text;
-        if (con_read(text)) {
-            std::queue<Event> events = Parser(text).parse_events();
-
-            while (!events.empty()) {
-                auto ev = events.front();
-                pending_events.push(ev);
-                if (const KeyEvent *kev = std::get_if<KeyEvent>(&ev)) {
-                    KeyEvent kev_release = *kev;
-                    kev_release.key_down = false;
-                    pending_events.push(kev_release);
-                }
-                events.pop();
+    Result SetInputThread(bool enabled) {
+        if (enabled && input_source)
+            return Result::Error("input thread cannot read from an input source");
+        if (enabled)
+            return input_thread.start();
+        input_thread.stop();
+        return Result::Ok;
+    }
+
+    Result SetInputSource(std::shared_ptr<InputSource> source) {
+        if (source && input_thread.is_running())
+            return Result::Error("input thread cannot read from an input source");
+        input_source = std::move(source);
+        return Result::Ok;
+    }
+
+    bool PollRawEvent(Event &event) {
+        // Parsed events are taken from pending_next on, the vector keeps its capacity when drained
+        static std::vector<Event> pending_events;
+        static size_t pending_next = 0;
+        static char buffer[4096];
+
+        const auto pop_pending = [&event]() {
+            if (pending_next == pending_events.size()) {
+                pending_events.clear();
+                pending_next = 0;
+                return false;
             }
-        }
+            event = std::move(pending_events[pending_next++]);
+            return true;
+        };
 
-        if (!pending_events.empty()) {
-            event = pending_events.front();
-            pending_events.pop();
+        // Any number of resizes signalled since the last poll are delivered as a single event
+        if (console::resize_pending.exchange(false, std::memory_order_acq_rel)) {
+            event = ResizeEvent{GetWindowSize()};
             return true;
         }
-        return false;
+
+        if (input_thread.is_running()) {
+            if (pop_pending())
+                return true;
+            return input_thread.pop(event);
+        }
+
+        const auto emit = [](Event ev) { pending_events.push_back(std::move(ev)); };
+
+        if (input_source) {
+            while (const size_t len = input_source->read(buffer, sizeof(buffer)))
+                parser.feed(buffer, len, emit);
+        } else {
+            // Wait a little for input, then take what is available unless a sequence is incomplete
+            int timeout_ms = 2;
+            while (const size_t len = con_read(buffer, sizeof(buffer), timeout_ms)) {
+                parser.feed(buffer, len, emit);
+                timeout_ms = parser.is_incomplete() ? 2 : 0;
+            }
+        }
+        parser.flush(emit);
+        return pop_pending();
     }
 
-    Result get_key_code(char c, KeyCode &key_code) {
+    static bool get_key_code(char c, KeyCode &key_code) {
         switch (c) {
         case '\033':
             key_code = KeyCode::ESCAPE;
-            return Result::Ok;
+            return true;
         case ' ':
             key_code = KeyCode::SPACE;
-            return Result::Ok;
+            return true;
         case '!':
             key_code = KeyCode::BANG;
-            return Result::Ok;
+            return true;
         case '@':
             key_code = KeyCode::AT;
-            return Result::Ok;
+            return true;
         case '#':
             key_code = KeyCode::HASH;
-            return Result::Ok;
+            return true;
         case '$':
             key_code = KeyCode::DOLLAR;
-            return Result::Ok;
+            return true;
         case '%':
             key_code = KeyCode::PERCENT;
-            return Result::Ok;
+            return true;
         case '^':
             key_code = KeyCode::CARET;
-            return Result::Ok;
+            return true;
         case '&':
             key_code = KeyCode::AMPERSAND;
-            return Result::Ok;
+            return true;
         case '*':
             key_code = KeyCode::ASTERISK;
-            return Result::Ok;
+            return true;
         case '(':
             key_code = KeyCode::LPAREN;
-            return Result::Ok;
+            return true;
         case ')':
             key_code = KeyCode::RPAREN;
-            return Result::Ok;
+            return true;
         case '_':
             key_code = KeyCode::UNDERSCORE;
-            return Result::Ok;
+            return true;
         case '+':
             key_code = KeyCode::PLUS;
-            return Result::Ok;
+            return true;
         case '-':
             key_code = KeyCode::MINUS;
-            return Result::Ok;
+            return true;
         case '=':
             key_code = KeyCode::EQUAL;
-            return Result::Ok;
+            return true;
         case '{':
             key_code = KeyCode::LBRACE;
-            return Result::Ok;
+            return true;
         case '}':
             key_code = KeyCode::RBRACE;
-            return Result::Ok;
+            return true;
         case '[':
             key_code = KeyCode::LBRACKET;
-            return Result::Ok;
+            return true;
         case ']':
             key_code = KeyCode::RBRACKET;
-            return Result::Ok;
+            return true;
         case '|':
             key_code = KeyCode::PIPE;
-            return Result::Ok;
+            return true;
         case '\\':
             key_code = KeyCode::BACKSLASH;
-            return Result::Ok;
+            return true;
         case ':':
             key_code = KeyCode::COLON;
-            return Result::Ok;
+            return true;
         case '"':
             key_code = KeyCode::DQUOTE;
-            return Result::Ok;
+            return true;
         case ';':
             key_code = KeyCode::SEMICOLON;
-            return Result::Ok;
+            return true;
         case '\'':
             key_code = KeyCode::SQUOTE;
-            return Result::Ok;
+            return true;
         case '<':
             key_code = KeyCode::LESS;
-            return Result::Ok;
+            return true;
         case '>':
             key_code = KeyCode::GREATER;
-            return Result::Ok;
+            return true;
         case '?':
             key_code = KeyCode::HOOK;
-            return Result::Ok;
+            return true;
         case ',':
             key_code = KeyCode::COMMA;
-            return Result::Ok;
+            return true;
         case '.':
             key_code = KeyCode::PERIOD;
-            return Result::Ok;
+            return true;
         case '/':
             key_code = KeyCode::SLASH;
-            return Result::Ok;
+            return true;
         case '`':
             key_code = KeyCode::BQUOTE;
-            return Result::Ok;
+            return true;
         case '~':
             key_code = KeyCode::TILDE;
-            return Result::Ok;
+            return true;
         default:
             if ('a' <= c && c <= 'z') {
                 key_code = static_cast<KeyCode>(c - 'a' + static_cast<int>(KeyCode::K_A));
-                return Result::Ok;
+                return true;
             } else if ('A' <= c && c <= 'Z') {
                 key_code = static_cast<KeyCode>(c - 'A' + static_cast<int>(KeyCode::K_A));
-                return Result::Ok;
+                return true;
             } else if ('0' <= c && c <= '9') {
                 key_code = static_cast<KeyCode>(c - '0' + static_cast<int>(KeyCode::K_0));
-                return Result::Ok;
+                return true;
             }
         }
-        return Result::Error("key not supported: 0x{:x}", c);
+        return false;
     }
 }    // namespace nite::internal
 